@@ -0,0 +1,368 @@
+#include "corpus_generator.h"
+
+#include <charconv>
+#include <random>
+#include "utils/special_tokens.h"
+#include "utils/timestamp_utils.h"
+
+namespace
+{
+using RP::Tokens::TokenId;
+
+constexpr std::string_view WORDS[] = {
+    "the",    "encoder", "window", "recording", "function", "return", "value",  "const",  "string", "meeting",
+    "notes",  "hello",   "world",  "build",     "test",     "review", "merge",  "branch", "commit", "error",
+    "a",      "to",      "of",     "and",       "is",       "in",     "it",     "for",    "with",   "that",
+};
+
+// Typed now and then, so the corpora aren't pure ASCII
+constexpr std::string_view NON_ASCII_WORDS[] = {"café", "naïve", "über", "日本語", "résumé", "😀"};
+
+constexpr std::string_view WINDOW_TITLES[] = {
+    "main.cpp - replay-recorder - Visual Studio Code",
+    "Inbox - Outlook",
+    "Windows PowerShell",
+    "general | Slack",
+    "New Tab - Google Chrome",
+    "Pull requests - GitHub",
+};
+
+// Keys that are held or hammered, so they show up as runs of the same token
+constexpr TokenId REPEATED_KEYS[] = {TokenId::Backspace, TokenId::LeftShift, TokenId::Space,
+                                     TokenId::Enter,     TokenId::LeftCtrl,  TokenId::CapsLock};
+
+constexpr std::string_view BASE64_CHARACTERS = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+constexpr std::string_view MALFORMED_PIECES[] = {
+    "[LSHIFT",        "[UNKNOWN_KEY]", "]",          "[]",         "a{12}",      "\\[",
+    "\\]",            "\xc3",          "\xff\xfe",   "\xe6\x97",   "[[ENTER]]",  "[SCREENSHOT_BASE64]",
+    "[/SCREENSHOT]",  "[ENTERx3]",     "{{}}",       "\\\\[TAB]",  "[^3,4]",     "[CHANGE_WINDOW]",
+};
+
+constexpr size_t MIN_SCREENSHOT_LENGTH = 10000;
+constexpr size_t MAX_SCREENSHOT_LENGTH = 210000;
+
+class CorpusWriter
+{
+  public:
+    CorpusWriter(size_t size, uint32_t seed) : size(size), rng(seed)
+    {
+        // The last record may go past the end, screenshots are the longest ones
+        corpus.reserve(size + MAX_SCREENSHOT_LENGTH + 64);
+    }
+
+    bool isFull() const
+    {
+        return corpus.size() >= size;
+    }
+
+    std::string take()
+    {
+        corpus.resize(size);
+        return std::move(corpus);
+    }
+
+    // Returns a number in [0, n). std::uniform_int_distribution isn't used since its output differs between
+    // standard libraries.
+    uint32_t random(uint32_t n)
+    {
+        return static_cast<uint32_t>(rng() % n);
+    }
+
+    bool chance(uint32_t percent)
+    {
+        return random(100) < percent;
+    }
+
+    void append(std::string_view text)
+    {
+        corpus += text;
+    }
+
+    void appendToken(TokenId tokenId)
+    {
+        corpus += RP::Tokens::getTokenString(tokenId);
+    }
+
+    void appendRun(std::string_view unit, size_t count)
+    {
+        for (size_t i = 0; i < count && !isFull(); i++)
+        {
+            corpus += unit;
+        }
+    }
+
+    // Types a word, with shift for capitals and the occasional typo that is fixed with backspace
+    void appendWord()
+    {
+        if (chance(3))
+        {
+            append(NON_ASCII_WORDS[random(std::size(NON_ASCII_WORDS))]);
+            return;
+        }
+
+        const std::string_view word = WORDS[random(std::size(WORDS))];
+        size_t start = 0;
+        if (chance(10))
+        {
+            appendToken(TokenId::LeftShift);
+            corpus += static_cast<char>(word[0] - 'a' + 'A');
+            start = 1;
+        }
+        append(word.substr(start));
+        if (chance(5))
+        {
+            corpus += static_cast<char>('a' + random(26));
+            appendToken(TokenId::Backspace);
+        }
+    }
+
+    // Writes a window change record like UserWindowActivityEventSource does, minutesLater after the last one
+    void appendWindowChange(int minutesLater)
+    {
+        advanceTimestamp(minutesLater);
+        char formatted[RP::Utils::MAX_LLM_READABLE_TIMESTAMP_LENGTH];
+        const size_t length = RP::Utils::formatTimestampToLLMReadable(timestamp, formatted, sizeof(formatted));
+
+        append("\n");
+        appendToken(TokenId::ChangeWindow);
+        append("\"");
+        append(WINDOW_TITLES[random(std::size(WINDOW_TITLES))]);
+        append("\" TIMESTAMP: ");
+        append(std::string_view(formatted, length));
+        appendToken(TokenId::ChangeWindowEnd);
+        append("\n");
+    }
+
+    void appendScreenshot(size_t length)
+    {
+        appendToken(TokenId::ScreenshotBase64);
+        // Each random number gives five base64 characters
+        for (size_t i = 0; i < length; i += 5)
+        {
+            uint32_t bits = static_cast<uint32_t>(rng());
+            for (size_t k = i; k < i + 5 && k < length; k++, bits >>= 6)
+            {
+                corpus += BASE64_CHARACTERS[bits & 63];
+            }
+        }
+        appendRun("=", random(3));
+        appendToken(TokenId::ScreenshotEnd);
+    }
+
+  private:
+    void advanceTimestamp(int minutes)
+    {
+        timestamp.minute += minutes;
+        timestamp.hour += timestamp.minute / 60;
+        timestamp.minute %= 60;
+        timestamp.day += timestamp.hour / 24;
+        timestamp.hour %= 24;
+        // Every month has 28 days here, which keeps every date valid
+        if (timestamp.day > 28)
+        {
+            timestamp.day = 1;
+            timestamp.month++;
+        }
+        if (timestamp.month > 12)
+        {
+            timestamp.month = 1;
+            timestamp.year++;
+        }
+    }
+
+    size_t size;
+    std::string corpus;
+    std::mt19937 rng;
+    RP::Utils::LLMReadableTimestamp timestamp{2026, 10, 17, 9, 0};
+};
+
+void generateTyping(CorpusWriter& writer)
+{
+    while (!writer.isFull())
+    {
+        writer.appendWord();
+        const uint32_t next = writer.random(1000);
+        if (next < 850)
+        {
+            writer.appendToken(TokenId::Space);
+        }
+        else if (next < 950)
+        {
+            writer.append(next < 900 ? "," : ".");
+            writer.appendToken(TokenId::Space);
+        }
+        else if (next < 995)
+        {
+            writer.appendToken(TokenId::Enter);
+        }
+        else
+        {
+            writer.appendWindowChange(static_cast<int>(writer.random(30)));
+        }
+    }
+}
+
+void generateTokens(CorpusWriter& writer)
+{
+    while (!writer.isFull())
+    {
+        const uint32_t next = writer.random(100);
+        if (next < 50)
+        {
+            const TokenId key = REPEATED_KEYS[writer.random(std::size(REPEATED_KEYS))];
+            for (uint32_t i = writer.random(20) + 1; i > 0; i--)
+            {
+                writer.appendToken(key);
+            }
+        }
+        else if (next < 70)
+        {
+            // Alt-tabbing through windows writes a window change for every window passed
+            for (uint32_t i = writer.random(5) + 2; i > 0; i--)
+            {
+                writer.appendToken(TokenId::Alt);
+                writer.appendToken(writer.chance(50) ? TokenId::Tab : TokenId::AltTab);
+                writer.appendWindowChange(0);
+            }
+        }
+        else if (next < 80)
+        {
+            writer.appendWindowChange(static_cast<int>(writer.random(10)));
+        }
+        else
+        {
+            writer.appendWord();
+            writer.appendToken(TokenId::Space);
+        }
+    }
+}
+
+void generateBase64(CorpusWriter& writer)
+{
+    while (!writer.isFull())
+    {
+        for (uint32_t i = writer.random(20); i > 0; i--)
+        {
+            writer.appendWord();
+            writer.appendToken(TokenId::Space);
+        }
+        writer.appendScreenshot(MIN_SCREENSHOT_LENGTH +
+                                writer.random(static_cast<uint32_t>(MAX_SCREENSHOT_LENGTH - MIN_SCREENSHOT_LENGTH)));
+    }
+}
+
+void generateRuns(CorpusWriter& writer)
+{
+    constexpr std::string_view RUN_UNITS[] = {"a", "Z", " ", "-", ".", "é", "日", "😀"};
+    while (!writer.isFull())
+    {
+        // Mostly short runs, with lengths up to 100000
+        const size_t length = (size_t(1) << writer.random(17)) + writer.random(1000);
+        const uint32_t next = writer.random(100);
+        if (next < 60)
+        {
+            writer.appendRun(RUN_UNITS[writer.random(std::size(RUN_UNITS))], length);
+        }
+        else if (next < 80)
+        {
+            writer.appendRun(RP::Tokens::getTokenString(REPEATED_KEYS[writer.random(std::size(REPEATED_KEYS))]),
+                             length / 8 + 1);
+        }
+        else if (next < 90)
+        {
+            writer.append("\\");
+            writer.appendRun("[", length);
+        }
+        else
+        {
+            writer.appendWord();
+        }
+    }
+}
+
+void generateMalformed(CorpusWriter& writer)
+{
+    while (!writer.isFull())
+    {
+        if (writer.chance(40))
+        {
+            writer.append(MALFORMED_PIECES[writer.random(std::size(MALFORMED_PIECES))]);
+        }
+        else
+        {
+            writer.appendWord();
+            if (writer.chance(50))
+            {
+                writer.appendToken(TokenId::Space);
+            }
+        }
+    }
+}
+} // namespace
+
+namespace RP::Benchmarks
+{
+std::string_view getCorpusName(CorpusKind kind)
+{
+    return CORPUS_NAMES[static_cast<size_t>(kind)];
+}
+
+bool parseCorpusKind(std::string_view name, CorpusKind& kind)
+{
+    for (size_t i = 0; i < CORPUS_NAMES.size(); i++)
+    {
+        if (CORPUS_NAMES[i] == name)
+        {
+            kind = static_cast<CorpusKind>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseCorpusSize(std::string_view text, uint64_t& size)
+{
+    const char* end = text.data() + text.size();
+    const auto result = std::from_chars(text.data(), end, size);
+    if (result.ec != std::errc() || end - result.ptr > 1)
+    {
+        return false;
+    }
+    if (result.ptr != end)
+    {
+        const size_t shift = std::string_view("KMG").find(*result.ptr);
+        if (shift == std::string_view::npos)
+        {
+            return false;
+        }
+        size <<= 10 * (shift + 1);
+    }
+    return true;
+}
+
+std::string generateCorpus(CorpusKind kind, size_t size, uint32_t seed)
+{
+    CorpusWriter writer(size, seed);
+    switch (kind)
+    {
+    case CorpusKind::Typing:
+        generateTyping(writer);
+        break;
+    case CorpusKind::Tokens:
+        generateTokens(writer);
+        break;
+    case CorpusKind::Base64:
+        generateBase64(writer);
+        break;
+    case CorpusKind::Runs:
+        generateRuns(writer);
+        break;
+    case CorpusKind::Malformed:
+    case CorpusKind::Count:
+        generateMalformed(writer);
+        break;
+    }
+    return writer.take();
+}
+} // namespace RP::Benchmarks
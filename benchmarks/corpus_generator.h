@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Synthetic recordings for the benchmarks. They are generated with a fixed seed and std::mt19937, whose output is the
+// same everywhere, so a benchmark run on any machine encodes exactly the same bytes.
+namespace RP::Benchmarks
+{
+enum class CorpusKind
+{
+    // Words typed with shift, backspaces and the occasional non-ASCII word, with window changes in between
+    Typing,
+    // Mostly special tokens: held keys, alt-tabbing through windows and bursts of window changes
+    Tokens,
+    // Screenshots embedded as base64 between short bits of typing
+    Base64,
+    // Long runs of a single character, including multi-byte ones and escaped brackets
+    Runs,
+    // Unclosed and unknown tokens, stray brackets, empty tokens, braces and bytes that aren't UTF-8
+    Malformed,
+    Count
+};
+
+constexpr std::array<std::string_view, static_cast<size_t>(CorpusKind::Count)> CORPUS_NAMES = {
+    "typing", "tokens", "base64", "runs", "malformed",
+};
+
+constexpr uint32_t DEFAULT_CORPUS_SEED = 20261017;
+
+/// @brief Returns the name of the corpus kind, e.g. "typing".
+std::string_view getCorpusName(CorpusKind kind);
+
+/// @brief Looks up a corpus kind by name. Returns false if there is none with that name.
+bool parseCorpusKind(std::string_view name, CorpusKind& kind);
+
+/// @brief Parses a size in bytes with an optional K, M or G suffix for KiB, MiB or GiB, e.g. "32M". Returns false if
+/// the text isn't one.
+bool parseCorpusSize(std::string_view text, uint64_t& size);
+
+/// @brief Generates a recording of exactly size bytes. The last record may be cut off.
+std::string generateCorpus(CorpusKind kind, size_t size, uint32_t seed = DEFAULT_CORPUS_SEED);
+} // namespace RP::Benchmarks
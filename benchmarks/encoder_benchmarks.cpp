@@ -0,0 +1,266 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "corpus_generator.h"
+#include "encoder/encoder.h"
+#include "encoder/pipeline.h"
+
+// Benchmarks every encoder stage over the generated corpora and over recordings passed with --corpus. Throughput is
+// reported in bytes of the recording per second, along with the heap allocations per iteration and the size of the
+// output relative to the recording.
+
+// Every heap allocation in this executable goes through these, so the benchmarks can count them
+static std::atomic<size_t> allocationCount{0};
+
+void* operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size == 0 ? 1 : size))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+namespace
+{
+constexpr uint64_t CORPUS_SIZES[] = {uint64_t(1) << 20, uint64_t(32) << 20, uint64_t(1) << 30};
+constexpr std::string_view CORPUS_SIZE_NAMES[] = {"1M", "32M", "1G"};
+constexpr uint64_t DEFAULT_MAX_CORPUS_SIZE = uint64_t(32) << 20;
+
+// Input is fed to the passes in pieces of this size, like replay_encoder does when streaming a file
+constexpr size_t CHUNK_SIZE = 1024 * 1024;
+
+struct CorpusSource
+{
+    // Either a generated corpus of the given kind and size, or a recording read from path
+    std::string name;
+    RP::Benchmarks::CorpusKind kind = RP::Benchmarks::CorpusKind::Typing;
+    uint64_t size = 0;
+    std::string path;
+};
+
+// Benchmarks are registered corpus by corpus, so only the corpus that is being benchmarked is kept in memory
+const std::string& loadCorpus(const CorpusSource& source)
+{
+    static std::string loadedName;
+    static std::string corpus;
+    if (loadedName == source.name)
+    {
+        return corpus;
+    }
+
+    corpus.clear();
+    corpus.shrink_to_fit();
+    if (source.path.empty())
+    {
+        corpus = RP::Benchmarks::generateCorpus(source.kind, source.size);
+    }
+    else
+    {
+        std::ifstream file(source.path, std::ios::in | std::ios::binary);
+        corpus.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    loadedName = source.name;
+    return corpus;
+}
+
+class StageCounters
+{
+  public:
+    explicit StageCounters(benchmark::State& state)
+        : state(state), allocationsBefore(allocationCount.load(std::memory_order_relaxed))
+    {
+    }
+
+    // Called once the loop over the iterations is done
+    void report(size_t inputSize, size_t outputSize)
+    {
+        const double allocations = double(allocationCount.load(std::memory_order_relaxed) - allocationsBefore);
+        state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(inputSize));
+        state.counters["allocs"] = benchmark::Counter(allocations, benchmark::Counter::kAvgIterations);
+        state.counters["ratio"] = inputSize == 0 ? 0.0 : double(outputSize) / double(inputSize);
+    }
+
+  private:
+    benchmark::State& state;
+    size_t allocationsBefore;
+};
+
+void feedInChunks(RP::Encoder::EncoderPass& pass, std::string_view input)
+{
+    for (size_t offset = 0; offset < input.size(); offset += CHUNK_SIZE)
+    {
+        pass.feed(input.substr(offset, CHUNK_SIZE));
+    }
+    pass.finish();
+}
+
+// rle() into a buffer that is reused between iterations
+void benchmarkRle(benchmark::State& state, const CorpusSource& source)
+{
+    const std::string& input = loadCorpus(source);
+    std::string encoded;
+    encoded.reserve(input.size() + input.size() / 8);
+    StageCounters counters(state);
+    for (auto _ : state)
+    {
+        encoded.clear();
+        RP::Encoder::rle(input, encoded);
+        benchmark::DoNotOptimize(encoded.data());
+    }
+    counters.report(input.size(), encoded.size());
+}
+
+void benchmarkRleParallel(benchmark::State& state, const CorpusSource& source)
+{
+    const std::string& input = loadCorpus(source);
+    const unsigned threadCount = std::max(1u, std::thread::hardware_concurrency());
+    size_t encodedSize = 0;
+    StageCounters counters(state);
+    for (auto _ : state)
+    {
+        encodedSize = 0;
+        RP::Encoder::rleParallel(input, threadCount, [&](std::string_view encoded) { encodedSize += encoded.size(); });
+    }
+    counters.report(input.size(), encodedSize);
+}
+
+// A single pass fed the corpus in chunks, as it would be as part of a pipeline
+void benchmarkPass(benchmark::State& state, const CorpusSource& source, std::string_view passName)
+{
+    const std::string& input = loadCorpus(source);
+    size_t encodedSize = 0;
+    StageCounters counters(state);
+    for (auto _ : state)
+    {
+        encodedSize = 0;
+        const auto pass =
+            RP::Encoder::createPass(passName, [&](std::string_view encoded) { encodedSize += encoded.size(); });
+        feedInChunks(*pass, input);
+    }
+    counters.report(input.size(), encodedSize);
+}
+
+// Decodes the output of a pass, throughput is in bytes of the decoded recording
+void benchmarkDecode(benchmark::State& state, const CorpusSource& source, const RP::Encoder::PassInfo& passInfo)
+{
+    const std::string& input = loadCorpus(source);
+    std::string encoded;
+    const auto pass = RP::Encoder::createPass(passInfo.name, [&](std::string_view piece) { encoded.append(piece); });
+    feedInChunks(*pass, input);
+
+    size_t decodedSize = 0;
+    StageCounters counters(state);
+    for (auto _ : state)
+    {
+        decodedSize = 0;
+        const auto decoder =
+            passInfo.createDecoder([&](std::string_view decoded) { decodedSize += decoded.size(); });
+        feedInChunks(*decoder, encoded);
+    }
+    counters.report(decodedSize, encoded.size());
+}
+
+void registerBenchmarks(const CorpusSource& source)
+{
+    const std::string prefix = "/" + source.name;
+    benchmark::RegisterBenchmark(("rle" + prefix).c_str(), benchmarkRle, source)->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark(("rle_parallel" + prefix).c_str(), benchmarkRleParallel, source)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+    for (const RP::Encoder::PassInfo& passInfo : RP::Encoder::getAvailablePasses())
+    {
+        const std::string passName(passInfo.name);
+        benchmark::RegisterBenchmark(("pass/" + passName + prefix).c_str(), benchmarkPass, source, passInfo.name)
+            ->Unit(benchmark::kMillisecond);
+        if (passInfo.createDecoder != nullptr)
+        {
+            benchmark::RegisterBenchmark(("decode/" + passName + prefix).c_str(), benchmarkDecode, source, passInfo)
+                ->Unit(benchmark::kMillisecond);
+        }
+    }
+}
+
+void printUsage(const char *programName)
+{
+    std::cerr << "Usage: " << programName << " [benchmark options] [--max_corpus_size=<size>] [--corpus=<file>...]\n"
+              << "\t--max_corpus_size\t largest generated corpus to benchmark, 1M, 32M or 1G (default 32M)\n"
+              << "\t--corpus\t\t also benchmarks a captured recording, can be given more than once\n";
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    benchmark::Initialize(&argc, argv);
+
+    // Google Benchmark removed the options it knows, the rest are ours
+    uint64_t maxCorpusSize = DEFAULT_MAX_CORPUS_SIZE;
+    std::vector<std::string> capturedCorpora;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string_view arg = argv[i];
+        const std::string_view maxSizeOption = "--max_corpus_size=";
+        const std::string_view corpusOption = "--corpus=";
+        if (arg.substr(0, maxSizeOption.size()) == maxSizeOption &&
+            RP::Benchmarks::parseCorpusSize(arg.substr(maxSizeOption.size()), maxCorpusSize))
+        {
+            continue;
+        }
+        if (arg.substr(0, corpusOption.size()) == corpusOption && arg.size() > corpusOption.size())
+        {
+            capturedCorpora.emplace_back(arg.substr(corpusOption.size()));
+            continue;
+        }
+        std::cerr << "Unknown argument: " << arg << "\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    for (size_t kind = 0; kind < RP::Benchmarks::CORPUS_NAMES.size(); kind++)
+    {
+        for (size_t i = 0; i < std::size(CORPUS_SIZES) && CORPUS_SIZES[i] <= maxCorpusSize; i++)
+        {
+            CorpusSource source;
+            source.kind = static_cast<RP::Benchmarks::CorpusKind>(kind);
+            source.size = CORPUS_SIZES[i];
+            source.name = std::string(RP::Benchmarks::CORPUS_NAMES[kind]) + "/" + std::string(CORPUS_SIZE_NAMES[i]);
+            registerBenchmarks(source);
+        }
+    }
+    for (const std::string& path : capturedCorpora)
+    {
+        if (!std::ifstream(path, std::ios::in | std::ios::binary))
+        {
+            std::cerr << "Error opening " << path << "\n";
+            return 1;
+        }
+        CorpusSource source;
+        source.path = path;
+        source.name = "file:" + path;
+        registerBenchmarks(source);
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
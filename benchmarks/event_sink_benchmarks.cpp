@@ -0,0 +1,82 @@
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "recorder/event_sink.h"
+#include "utils/logging.h"
+
+// Producers writing keystroke-sized events to one EventSink, like the keyboard, focus and screenshot threads of the
+// recorder do. The writer thread writes to a temporary file.
+
+namespace
+{
+std::shared_ptr<EventSink> sharedSink;
+
+std::string getSinkPath()
+{
+    return (std::filesystem::temp_directory_path() / "replay_benchmarks_event_sink.txt").string();
+}
+
+void setUpSink(benchmark::State& state)
+{
+    if (state.thread_index() == 0)
+    {
+        // Every buffer the writer writes is logged
+        spdlog::set_level(spdlog::level::warn);
+        std::filesystem::remove(getSinkPath());
+        sharedSink = std::make_shared<EventSink>(getSinkPath());
+    }
+}
+
+void tearDownSink(benchmark::State& state, size_t bytesPerIteration)
+{
+    state.SetItemsProcessed(int64_t(state.iterations()));
+    state.SetBytesProcessed(int64_t(state.iterations() * bytesPerIteration));
+    if (state.thread_index() == 0)
+    {
+        sharedSink->drain();
+        sharedSink.reset();
+        std::filesystem::remove(getSinkPath());
+        spdlog::set_level(spdlog::level::info);
+    }
+}
+
+void benchmarkSinkUtf8(benchmark::State& state)
+{
+    setUpSink(state);
+    for (auto _ : state)
+    {
+        *sharedSink << "[BACKSPACE]";
+    }
+    tearDownSink(state, sizeof("[BACKSPACE]") - 1);
+}
+
+void benchmarkSinkUtf16(benchmark::State& state)
+{
+    setUpSink(state);
+    const std::u16string_view text = u"é";
+    for (auto _ : state)
+    {
+        *sharedSink << text;
+    }
+    tearDownSink(state, 2);
+}
+
+void benchmarkSinkPieces(benchmark::State& state)
+{
+    setUpSink(state);
+    const std::string_view prefix = "\n[CHANGE_WINDOW]\"";
+    const std::string title = "main.cpp - replay-recorder - Visual Studio Code";
+    const std::string_view suffix = "\" TIMESTAMP: 2026 October seventeenth 09:00[/CHANGE_WINDOW]\n";
+    for (auto _ : state)
+    {
+        sharedSink->write({prefix, title, suffix});
+    }
+    tearDownSink(state, prefix.size() + title.size() + suffix.size());
+}
+} // namespace
+
+BENCHMARK(benchmarkSinkUtf8)->Name("sink/utf8")->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(benchmarkSinkUtf16)->Name("sink/utf16")->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(benchmarkSinkPieces)->Name("sink/window_change")->ThreadRange(1, 16)->UseRealTime();
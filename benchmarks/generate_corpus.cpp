@@ -0,0 +1,47 @@
+#include <charconv>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include "corpus_generator.h"
+
+// Writes one of the benchmark corpora to a file, e.g. to encode it with replay_encoder or to keep it next to results
+
+static void printUsage(const char *programName)
+{
+    std::cerr << "Usage: " << programName << " <kind> <size> <output_file> [seed]\n"
+              << "\tkind\t one of:";
+    for (std::string_view name : RP::Benchmarks::CORPUS_NAMES)
+    {
+        std::cerr << " " << name;
+    }
+    std::cerr << "\n"
+              << "\tsize\t in bytes, with an optional K, M or G suffix for KiB, MiB or GiB\n"
+              << "\tseed\t defaults to " << RP::Benchmarks::DEFAULT_CORPUS_SEED << ", the seed the benchmarks use\n";
+}
+
+int main(int argc, char *argv[])
+{
+    RP::Benchmarks::CorpusKind kind;
+    uint64_t size = 0;
+    uint32_t seed = RP::Benchmarks::DEFAULT_CORPUS_SEED;
+    const std::string_view seedText = argc > 4 ? argv[4] : "";
+    if ((argc != 4 && argc != 5) || !RP::Benchmarks::parseCorpusKind(argv[1], kind) ||
+        !RP::Benchmarks::parseCorpusSize(argv[2], size) ||
+        (argc == 5 && std::from_chars(seedText.data(), seedText.data() + seedText.size(), seed).ec != std::errc()))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    const std::string corpus = RP::Benchmarks::generateCorpus(kind, size, seed);
+    std::ofstream file(argv[3], std::ios::out | std::ios::binary | std::ios::trunc);
+    file.write(corpus.data(), static_cast<std::streamsize>(corpus.size()));
+    if (!file)
+    {
+        std::cerr << "Error writing " << argv[3] << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+// Picking the files of replay_encoder --batch
+namespace RP::Encoder
+{
+/// @brief A recording of a batch and where its encoded output goes.
+struct BatchFile
+{
+    std::filesystem::path inputFilename;
+    std::filesystem::path outputFilename;
+    uintmax_t size = 0;
+};
+
+/// @brief Returns whether name matches pattern, where '*' matches any sequence of characters and '?' any one
+/// character.
+bool matchesPattern(std::string_view name, std::string_view pattern);
+
+/// @brief Returns the default output file of a recording, '<stem>_encoded<extension>' next to it.
+std::filesystem::path getEncodedFilename(const std::filesystem::path& inputFilename);
+
+/// @brief Returns whether the file is itself an encoded output ('*_encoded.*'), which a batch never picks up.
+bool isEncodedFilename(const std::filesystem::path& filename);
+
+/// @brief Returns whether the encoded output of the file was written after its input was last modified. An empty
+/// output is only up to date for an empty input, in case a previous run was interrupted.
+bool isUpToDate(const BatchFile& file);
+
+/// @brief Lists the recordings matched by a batch input, largest first so a big file doesn't end up running alone
+/// at the end.
+///
+/// The input is a directory or a pattern in the file name, see matchesPattern(). Outputs go next to the inputs, or
+/// into outputDirectory if it isn't empty. Throws std::filesystem::filesystem_error if the directory can't be read.
+std::vector<BatchFile> collectBatchFiles(const std::filesystem::path& input,
+                                         const std::filesystem::path& outputDirectory);
+} // namespace RP::Encoder
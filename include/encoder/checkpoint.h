@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace RP::Encoder
+{
+/// @brief Where an incremental encode of a growing recording stopped.
+///
+/// The encoded output is only final up to committedLength, the bytes after it were written by finish() for the
+/// pending token and run. The next run truncates the output there, restores the encoder state and continues with the
+/// input from inputOffset, which gives the same output as encoding the whole recording again.
+struct EncodeCheckpoint
+{
+    uint64_t inputOffset = 0;
+    // Hash of the input before inputOffset, to notice when the recording was replaced rather than appended to
+    uint64_t inputHash = 0;
+    uint64_t committedLength = 0;
+    // Length of the encoded file when the checkpoint was written, to notice when it was modified since
+    uint64_t encodedLength = 0;
+    // Returned by RleStreamEncoder::saveState()
+    std::string encoderState;
+};
+
+/// @brief Progress of an in-place encode, see InPlaceEncoder.
+///
+/// The file holds the encoded output before writeOffset and the original input from readOffset on. pendingOutput is
+/// encoded output that belongs at writeOffset but may not be on disk yet, because writing it overwrites input that an
+/// older journal still pointed to.
+struct InPlaceJournal
+{
+    // Size of the file before it was encoded
+    uint64_t originalLength = 0;
+    uint64_t readOffset = 0;
+    uint64_t writeOffset = 0;
+    // Returned by RleStreamEncoder::saveState(), empty once the whole input was encoded
+    std::string encoderState;
+    std::string pendingOutput;
+};
+
+/// @brief Returns the path of the checkpoint file kept next to an encoded file.
+std::filesystem::path getCheckpointPath(const std::filesystem::path& encodedFilename);
+
+/// @brief Hashes the first and last few KiB of the input before offset. This is cheap enough to run on every
+/// incremental encode and catches a recording that was restarted or rewritten.
+uint64_t hashInputPrefix(std::string_view input, uint64_t offset);
+
+/// @brief Reads a checkpoint file. Returns false if it doesn't exist or is malformed.
+bool loadCheckpoint(const std::filesystem::path& path, EncodeCheckpoint& checkpoint);
+
+/// @brief Writes a checkpoint file, replacing the previous one. Throws std::runtime_error on I/O errors.
+void saveCheckpoint(const std::filesystem::path& path, const EncodeCheckpoint& checkpoint);
+
+/// @brief Returns the path of the journal kept next to a file that is being encoded in place.
+std::filesystem::path getJournalPath(const std::filesystem::path& filename);
+
+/// @brief Reads a journal file. Returns false if it doesn't exist, throws std::runtime_error if it is malformed: the
+/// file it belongs to is half encoded, so starting over isn't an option.
+bool loadJournal(const std::filesystem::path& path, InPlaceJournal& journal);
+
+/// @brief Writes a journal file, replacing the previous one, and returns once it is on disk. Throws
+/// std::runtime_error on I/O errors.
+void saveJournal(const std::filesystem::path& path, const InPlaceJournal& journal);
+} // namespace RP::Encoder
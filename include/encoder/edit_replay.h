@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "encoder.h"
+#include "token_scanner.h"
+#include "utils/special_tokens.h"
+
+namespace RP::Encoder
+{
+/// @brief Optional stage in front of the encoder that replays the edits in a recording.
+///
+/// Typed text is collected per window segment, and a '[BACKSPACE]' removes the last character (or the last
+/// '[SPACE]', '[ENTER]' or '[TAB]') from it instead of being written. '[LSHIFT]' and '[RSHIFT]' are dropped, since
+/// the typed characters already have the right case. The output is what was typed rather than how it was typed, so
+/// unlike the encoder this stage is lossy.
+///
+/// A backspace is only applied to text it can be sure about. Any other token ends the editable text, since we can't
+/// tell what it did (a backspace after '[LCTRL]' deletes a whole word), and so do line breaks, which the recorder
+/// only writes around window changes. Backspaces that reach past the start of the editable text, or that would leave
+/// a '\' escaping the next token, are written as they are. Window change records and screenshots are copied untouched.
+class EditReplayStage
+{
+  public:
+    // Editable text is written out once it grows past this, so memory use doesn't depend on the recording
+    static constexpr size_t MAX_EDITABLE_TEXT_SIZE = 1024 * 1024;
+
+    explicit EditReplayStage(RleStreamEncoder::Sink sink, size_t outputBufferSize = StageOutput::DEFAULT_BUFFER_SIZE);
+
+    void feed(std::string_view chunk);
+
+    /// @brief Writes out the remaining text. No more input may be fed afterwards.
+    void finish();
+
+    /// @brief Number of backspace and shift tokens that were applied and removed from the output.
+    size_t getRemovedTokenCount() const;
+
+  private:
+    friend class TokenScanner;
+    void onText(const char* data, size_t size);
+    void onToken(std::string_view content);
+    void onUnclosedToken(std::string_view content);
+
+    void appendText(const char* data, size_t size);
+    void appendEditableToken(RP::Tokens::TokenId tokenId);
+    bool eraseLastTypedUnit();
+    void commitText();
+
+  private:
+    StageOutput output;
+
+    TokenScanner scanner;
+
+    // End token of the window change record or screenshot being copied, TokenId::Unknown outside of them
+    RP::Tokens::TokenId recordEndToken = RP::Tokens::TokenId::Unknown;
+
+    // Text a backspace can still delete. Edits only ever happen at its end, so a plain string works as the buffer
+    // and both typing and deleting are amortized O(1).
+    std::string editableText;
+    // Where the tokens in editableText end, so a backspace removes a token as a whole
+    std::vector<size_t> tokenEnds;
+    // The text written before editableText ends in a '\', which happens when it was written out for its size
+    bool outputEndsInBackslash = false;
+
+    size_t removedTokenCount = 0;
+};
+} // namespace RP::Encoder
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <functional>
 #include <iostream>
 #include <string>
+#include <string_view>
+#include "utils/special_tokens.h"
 
 // @brief Our objective with "encoding" differs from traditional encoding.
 // We aim to encode the file such that the resulting file is easier for LLMs to
@@ -20,4 +23,168 @@ namespace RP::Encoder
 /// user activity related events.
 /// @return A RLE'd version of the string that is smaller.
 std::string rle(const std::string &userActivityString);
-} // namespace RP::Encoder
\ No newline at end of file
+
+/// @brief Same as rle(), but appends the encoded string to encodedString instead of returning a new one.
+///
+/// Uses one encoder per thread that is kept between calls. Once it has seen the longest special token, encoding
+/// doesn't allocate any memory as long as encodedString has enough capacity, so a caller that reuses its buffer
+/// can encode any number of recordings without allocating.
+void rle(std::string_view userActivityString, std::string &encodedString);
+
+/// @brief Incremental version of rle() for recordings that don't fit in memory.
+///
+/// Input is passed in arbitrarily sized chunks with feed(), and finish() must be called once the whole recording
+/// was fed. Pending special tokens and character runs are carried across chunk boundaries, so the concatenation of
+/// everything passed to the sink is identical to what rle() returns for the concatenated input.
+///
+/// Encoded output is collected in an internal buffer and handed to the sink whenever it grows past
+/// outputBufferSize, and once more at the end of finish(). Apart from that buffer, the encoder only keeps the
+/// special token it is currently reading, so memory use is bounded by the longest special token in the recording.
+///
+/// Screenshots embedded as '[SCREENSHOT_BASE64]<payload>[/SCREENSHOT]' are not run-length encoded: the payload (the
+/// base64 characters following the token) is copied to the output untouched, or handed to a payload sink.
+class RleStreamEncoder
+{
+  public:
+    // Receives encoded output. The view is only valid for the duration of the call.
+    using Sink = std::function<void(std::string_view)>;
+
+    // Receives screenshot payloads in pieces, followed by a call with endOfPayload set and an empty piece. The text
+    // returned by that last call is written to the output in place of the payload.
+    using PayloadSink = std::function<std::string(std::string_view piece, bool endOfPayload)>;
+
+    static constexpr size_t DEFAULT_OUTPUT_BUFFER_SIZE = 64 * 1024;
+
+    explicit RleStreamEncoder(Sink sink, size_t outputBufferSize = DEFAULT_OUTPUT_BUFFER_SIZE);
+
+    /// @brief Moves screenshot payloads out of the encoded output. Must be set before the first call to feed().
+    void setPayloadSink(PayloadSink payloadSink);
+
+    /// @brief Encodes the next chunk of the recording.
+    void feed(std::string_view chunk);
+
+    /// @brief Flushes pending tokens and runs to the sink. No more input may be fed afterwards.
+    void finish();
+
+    /// @brief Discards all state and unflushed output, so the encoder can be fed a new recording.
+    void reset();
+
+    /// @brief Encodes a complete recording and appends it to encodedString, bypassing the sink and the output
+    /// buffer. Calls reset() first, so one encoder can encode any number of recordings this way.
+    void encode(std::string_view userActivityString, std::string& encodedString);
+
+    /// @brief Hands all buffered output to the sink and returns the state needed to continue encoding later, e.g.
+    /// in another process once more of the recording was written. Pending tokens and runs are part of the state, so
+    /// anything finish() writes afterwards must be discarded before continuing from it. Payload sinks are not saved.
+    std::string saveState();
+
+    /// @brief Continues from a state returned by saveState(). Throws std::runtime_error if the state is malformed.
+    void restoreState(std::string_view state);
+
+  private:
+    //~ Begin special token stage
+    void closeToken();
+    void flushPendingToken();
+    bool hasPendingToken() const;
+    std::string_view getPendingToken() const;
+    size_t findUnescaped(const char* data, size_t size, size_t from, char delimiter) const;
+    void appendPayload(const char* data, size_t size);
+    void endPayload();
+    //~ End special token stage
+
+    //~ Begin character stage
+    void appendToken(std::string_view content, size_t count, bool withCount);
+    void appendUnclosedToken(const std::string& content);
+    bool canAppendTokenDirectly() const;
+    void appendCharacters(const char* data, size_t size);
+    size_t completePartialUnit(const char* data, size_t size);
+    void appendUnit(const char* unit, size_t unitSize);
+    size_t countUnitRepeats(const char* data, size_t size) const;
+    void appendVerbatim(const char* data, size_t size);
+    void flushRun();
+    //~ End character stage
+
+    void flushOutput();
+
+  private:
+    Sink sink;
+    size_t outputBufferSize;
+    std::string output;
+
+    // Special token stage state
+    char prevInputChar = '\0';
+    bool inToken = false;
+    std::string tokenContent;
+    // Tokens from the special token dictionary are kept as their id, pendingToken only holds unknown ones
+    RP::Tokens::TokenId pendingTokenId = RP::Tokens::TokenId::Unknown;
+    std::string pendingToken;
+    size_t repeatCount = 0;
+    bool inPayload = false;
+    size_t payloadLength = 0;
+    PayloadSink payloadSink;
+
+    // Character stage state. Runs are made of units, which are UTF-8 sequences or single bytes that aren't part of one.
+    bool inCopy = false;
+    char prevChar = '\0';
+    char runUnit[4] = {};
+    size_t runUnitSize = 0;
+    size_t runLength = 0;
+    // Start of a UTF-8 sequence at the end of the input so far, completed by the next input
+    char partialUnit[4] = {};
+    size_t partialUnitSize = 0;
+};
+
+/// @brief Size of the chunks rleParallel() splits the input into by default
+constexpr size_t PARALLEL_CHUNK_SIZE = 4 * 1024 * 1024;
+
+/// @brief Multi-threaded version of rle().
+///
+/// The input is split into chunks of roughly chunkSize bytes, which are encoded on threadCount worker threads.
+/// Chunks are only split where the encoder state doesn't depend on what came before (outside of special tokens,
+/// screenshot payloads and character runs), so the encoded chunks passed to the sink in order are byte-identical to
+/// the output of rle().
+/// At most two chunks per thread are buffered at a time.
+void rleParallel(std::string_view userActivityString, unsigned threadCount, const RleStreamEncoder::Sink& sink,
+                 size_t chunkSize = PARALLEL_CHUNK_SIZE);
+
+/// @brief Reverses rle(): expands character runs ('A{4}', 'é{4}') and repeated special tokens ('[SPACEx2]').
+///
+/// Encoding is only reversible if the recording doesn't already contain text that looks like an encoded run or
+/// token (e.g. a typed 'a{5}'), so compare the result with the original before relying on it. Throws
+/// std::runtime_error if the counts in corrupt input add up to more than 1 TiB of output.
+std::string rleDecode(std::string_view encodedString);
+
+/// @brief Streaming version of rleDecode(), the decoded output is handed to the sink in pieces of bounded size.
+void rleDecode(std::string_view encodedString, const RleStreamEncoder::Sink& sink);
+
+/// @brief Incremental version of rleDecode(), the counterpart of RleStreamEncoder.
+///
+/// Encoded input is passed in arbitrarily sized chunks with feed(), and finish() must be called after the last one.
+/// What may continue in the next chunk is held back: an unclosed special token, a run whose count isn't closed yet
+/// and the last four bytes, which may be a character that a run count follows. Decoded output is handed to the sink
+/// in pieces of at most OUTPUT_BUFFER_SIZE bytes. Throws std::runtime_error like rleDecode().
+class RleStreamDecoder
+{
+  public:
+    static constexpr size_t OUTPUT_BUFFER_SIZE = 64 * 1024;
+
+    explicit RleStreamDecoder(RleStreamEncoder::Sink sink);
+
+    void feed(std::string_view chunk);
+
+    /// @brief Decodes the held back input and hands the remaining output to the sink. No more input may be fed
+    /// afterwards.
+    void finish();
+
+  private:
+    RleStreamEncoder::Sink sink;
+    std::string output;
+    size_t decodedSize = 0;
+
+    // Input held back until the next chunk, and the last decoded character before it
+    std::string pending;
+    char prevChar = '\0';
+    // Set if pending starts with a token that isn't closed in it, only a ']' in the next chunk can close it
+    bool pendingToken = false;
+};
+} // namespace RP::Encoder
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+
+// File I/O helpers used by replay_encoder to move recordings in and out of memory without going through iostreams.
+namespace RP::Encoder
+{
+/// @brief Read-only memory mapping of a whole file.
+///
+/// The mapping is advised for sequential access, so the OS reads ahead while the encoder walks the view and no
+/// copy of the recording is ever made in user space. Throws std::runtime_error if the file can't be mapped.
+class MappedFile
+{
+  public:
+    explicit MappedFile(const std::filesystem::path& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view view() const;
+
+  private:
+    const char* data = nullptr;
+    size_t size = 0;
+
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+/// @brief Writes a file in large blocks that are a multiple of the page size.
+///
+/// Small writes are collected in a block buffer and only full blocks are passed to the OS, so encoding output in
+/// small pieces doesn't turn into many small system calls. Throws std::runtime_error on I/O errors.
+///
+/// An existing file is truncated to keepLength bytes and written after them, which lets an interrupted or
+/// incremental encode continue an earlier output.
+class BlockFileWriter
+{
+  public:
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 4 * 1024 * 1024;
+
+    explicit BlockFileWriter(const std::filesystem::path& path, size_t blockSize = DEFAULT_BLOCK_SIZE,
+                             uint64_t keepLength = 0);
+    // Flushes buffered data, errors are logged instead of thrown. Call close() to handle them.
+    ~BlockFileWriter();
+
+    BlockFileWriter(const BlockFileWriter&) = delete;
+    BlockFileWriter& operator=(const BlockFileWriter&) = delete;
+
+    void write(std::string_view data);
+
+    // Writes out the partially filled block and closes the file
+    void close();
+
+  private:
+    void writeToFile(const char* data, size_t size);
+
+    std::unique_ptr<char[]> block;
+    size_t blockSize;
+    size_t blockUsed = 0;
+
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+/// @brief A file that is read and overwritten at explicit offsets, used to encode a recording in place.
+///
+/// Nothing is buffered, every read() and write() goes to the OS. Throws std::runtime_error on I/O errors.
+class InPlaceFile
+{
+  public:
+    explicit InPlaceFile(const std::filesystem::path& path);
+    ~InPlaceFile();
+
+    InPlaceFile(const InPlaceFile&) = delete;
+    InPlaceFile& operator=(const InPlaceFile&) = delete;
+
+    uint64_t size() const;
+
+    // Reads up to size bytes at offset, returns the number of bytes read. That is less than size only at the end of
+    // the file.
+    size_t read(uint64_t offset, char* data, size_t size);
+
+    void write(uint64_t offset, std::string_view data);
+
+    // Returns once everything written so far is on disk
+    void sync();
+
+    void truncate(uint64_t length);
+
+  private:
+    std::filesystem::path path;
+
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+/// @brief Replaces the file with contents and returns once the new contents are on disk. The file is written under a
+/// temporary name and renamed, so after a crash it holds either the old or the new contents. Throws
+/// std::runtime_error on I/O errors.
+void writeFileDurably(const std::filesystem::path& path, std::string_view contents);
+
+/// @brief Returns the page size of the system, used to size I/O blocks.
+size_t getPageSize();
+} // namespace RP::Encoder
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include "checkpoint.h"
+#include "encoder.h"
+#include "file_io.h"
+
+namespace RP::Encoder
+{
+/// @brief Encodes a file with the rle pass and writes the output over the input, so no space for a copy is needed.
+///
+/// The encoded output of a prefix of the recording is never longer than that prefix, so the output can be written
+/// behind the position the input is read from. The file is read a window at a time, and the output for a window is
+/// written once it was read. At the end the file is truncated to the encoded output. Memory use is the window and the
+/// output of one window, whatever the size of the file.
+///
+/// Progress is kept in a journal next to the file (see InPlaceJournal). It is written before anything overwrites
+/// input that the previous journal still relies on, so when the process dies an InPlaceEncoder constructed for the
+/// same file continues from the journal and ends up with the same file as an uninterrupted run.
+class InPlaceEncoder
+{
+  public:
+    static constexpr size_t DEFAULT_WINDOW_SIZE = 16 * 1024 * 1024;
+
+    /// @brief Opens the file, continuing from its journal if it has one. Throws std::runtime_error if the journal
+    /// doesn't match the file.
+    explicit InPlaceEncoder(const std::filesystem::path& path, size_t windowSize = DEFAULT_WINDOW_SIZE);
+
+    /// @brief Encodes the next window of the input. Returns false once the whole input was read.
+    bool encodeWindow();
+
+    /// @brief Encodes the rest of the input, truncates the file to the encoded output and removes the journal.
+    void finish();
+
+    uint64_t getOriginalLength() const;
+    uint64_t getEncodedLength() const;
+
+    /// @brief Input offset an interrupted run stopped at, 0 if the file wasn't being encoded yet.
+    uint64_t getResumedFrom() const;
+
+  private:
+    // Writes the output collected so far, along with a journal that covers it
+    void commit();
+
+  private:
+    InPlaceFile file;
+    std::filesystem::path journalPath;
+    size_t windowSize;
+    std::unique_ptr<char[]> window;
+
+    RleStreamEncoder encoder;
+    // Encoded output that isn't written to the file yet
+    std::string pending;
+
+    uint64_t originalLength = 0;
+    uint64_t readOffset = 0;
+    uint64_t writeOffset = 0;
+    // Read offset of the journal on disk, the input after it must stay untouched until the next journal is written
+    uint64_t journaledReadOffset = 0;
+    uint64_t resumedFrom = 0;
+};
+} // namespace RP::Encoder
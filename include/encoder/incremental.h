@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+#include "file_io.h"
+
+namespace RP::Encoder
+{
+/// @brief What encodeIncrementally() did.
+struct IncrementalEncodeResult
+{
+    // Input offset the encode continued from, 0 if it started over
+    uint64_t resumedFrom = 0;
+    // Encoded bytes written by this run
+    uint64_t encodedLength = 0;
+};
+
+/// @brief Encodes a growing recording with the rle pass, continuing where the last run on the same encoded file
+/// stopped.
+///
+/// Only the input after the inputOffset of the checkpoint next to the encoded file is encoded, and its output
+/// replaces what the encoded file holds after committedLength (see EncodeCheckpoint). The encode starts over if the
+/// checkpoint is missing or malformed, or the input or the encoded file changed since it was written. Writes a new
+/// checkpoint once the encoded file is complete. Throws std::runtime_error on I/O errors.
+IncrementalEncodeResult encodeIncrementally(std::string_view input, const std::filesystem::path& encodedFilename,
+                                            size_t blockSize = BlockFileWriter::DEFAULT_BLOCK_SIZE);
+} // namespace RP::Encoder
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "encoder.h"
+
+namespace RP::Encoder
+{
+/// @brief Optional stage after the encoder that replaces repeated phrases with references to earlier occurrences.
+///
+/// A reference is written as '[^<distance>,<length>]' and stands for the <length> characters that started
+/// <distance> characters back. The copy may overlap what it produces, so 'abcabcabcabcabc' becomes 'abc[^3,12]'.
+/// References only cover whole special tokens, and a '[^' in the input that starts a special token is written as
+/// '[^^'. This keeps the notation apart from the input, so phraseDecode() gives back exactly what the stage got.
+///
+/// Matches are found with a hash chain over a sliding window of the last WINDOW_SIZE characters, so memory use is
+/// bounded. Like LZ4, the stage looks for matches less often the longer it doesn't find any, which keeps it fast on
+/// screenshot payloads and other data that doesn't repeat.
+class PhraseCompactionStage
+{
+  public:
+    static constexpr size_t WINDOW_SIZE = 64 * 1024;
+    static constexpr size_t MIN_MATCH_LENGTH = 12;
+    static constexpr size_t MAX_MATCH_LENGTH = 4096;
+    // Longer text after a '[^' is never a reference, the stage only writes references up to WINDOW_SIZE back
+    static constexpr size_t MAX_REFERENCE_LENGTH = 32;
+    static constexpr size_t DEFAULT_OUTPUT_BUFFER_SIZE = 64 * 1024;
+
+    explicit PhraseCompactionStage(RleStreamEncoder::Sink sink, size_t outputBufferSize = DEFAULT_OUTPUT_BUFFER_SIZE);
+
+    void feed(std::string_view chunk);
+
+    /// @brief Writes out the remaining input. No more input may be fed afterwards.
+    void finish();
+
+  private:
+    // Encodes the buffered input, leaving MAX_MATCH_LENGTH characters for the next call unless finishing
+    void compact(bool finishing);
+    size_t findMatch(size_t position, size_t limit, size_t& distance);
+    size_t trimMatch(size_t position, size_t length) const;
+    void appendLiterals(size_t position, size_t count);
+    void appendReference(size_t distance, size_t length);
+
+    void flushOutput();
+
+  private:
+    RleStreamEncoder::Sink sink;
+    size_t outputBufferSize;
+    std::string output;
+
+    // Input that is still needed, starting at input position bufferStart. Everything before position is encoded.
+    std::string buffer;
+    size_t bufferStart = 0;
+    size_t position = 0;
+
+    // Hash chains of positions plus one, 0 is the end of a chain
+    std::vector<size_t> head;
+    std::vector<size_t> chain;
+
+    // Number of positions in a row without a match, used to skip ahead over data that doesn't repeat
+    size_t misses = 0;
+
+    // Special token state of the input at position, used to keep references outside of special tokens
+    bool inToken = false;
+    char prevChar = '\0';
+    // Whether the last character written was a '[' that starts a special token
+    bool afterTokenStart = false;
+};
+
+/// @brief Expands the references written by PhraseCompactionStage.
+std::string phraseDecode(std::string_view encodedString);
+
+/// @brief Same as phraseDecode(), but hands the decoded string to the sink in pieces.
+void phraseDecode(std::string_view encodedString, const RleStreamEncoder::Sink& sink);
+
+/// @brief Incremental version of phraseDecode().
+///
+/// Encoded input is passed in arbitrarily sized chunks with feed(), and finish() must be called after the last one.
+/// A reference that may continue in the next chunk is held back until it is complete. The last WINDOW_SIZE decoded
+/// characters are kept for the references that follow, the rest is handed to the sink.
+class PhraseDecoder
+{
+  public:
+    explicit PhraseDecoder(RleStreamEncoder::Sink sink);
+
+    void feed(std::string_view chunk);
+
+    /// @brief Decodes the held back input and hands the remaining output to the sink. No more input may be fed
+    /// afterwards.
+    void finish();
+
+  private:
+    // Decodes encoded and returns the number of bytes decoded. Unless final, stops in front of a reference that may
+    // continue in the next chunk.
+    size_t decode(std::string_view encoded, bool final);
+
+    RleStreamEncoder::Sink sink;
+    // Decoded output, of which at least the last window is kept for the references that follow
+    std::string decoded;
+
+    // Input held back until the next chunk, and the last input character before it
+    std::string pending;
+    char prevChar = '\0';
+};
+} // namespace RP::Encoder
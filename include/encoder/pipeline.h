@@ -0,0 +1,97 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "encoder.h"
+#include "token_filter.h"
+#include "window_storm.h"
+
+// The encoder is a chain of streaming passes. Each pass gets its input in chunks and hands its output to the next
+// pass in pieces no larger than its output buffer, so adding a pass doesn't add another copy of the whole recording.
+namespace RP::Encoder
+{
+/// @brief A streaming pass of the pipeline. Passes are constructed with the sink their output goes to.
+class EncoderPass
+{
+  public:
+    virtual ~EncoderPass() = default;
+
+    virtual void feed(std::string_view chunk) = 0;
+
+    /// @brief Writes out everything the pass still holds back. No more input may be fed afterwards.
+    virtual void finish() = 0;
+};
+
+// Creates a pass that is fed the output of a pass and hands the decoded input of that pass to the sink in pieces
+using PassDecoderFactory = std::unique_ptr<EncoderPass> (*)(RleStreamEncoder::Sink sink);
+
+struct PassInfo
+{
+    std::string_view name;
+    std::string_view description;
+    // nullptr if the pass is lossy and its output can't be decoded back into its input
+    PassDecoderFactory createDecoder;
+};
+
+/// @brief Returns all passes that can be used in a pipeline.
+const std::vector<PassInfo>& getAvailablePasses();
+
+/// @brief Returns the pass with this name, or nullptr if there is none.
+const PassInfo* findPass(std::string_view name);
+
+/// @brief Settings of individual passes, passes ignore the ones that don't apply to them.
+struct PassOptions
+{
+    // Set on the 'rle' pass, see RleStreamEncoder::setPayloadSink()
+    RleStreamEncoder::PayloadSink payloadSink;
+    // Tokens the 'filter' pass removes
+    TokenSet removedTokens;
+    // Largest gap between window changes that the 'storms' pass collapses
+    int maxStormGapMinutes = WindowStormStage::DEFAULT_MAX_GAP_MINUTES;
+};
+
+/// @brief Creates the pass with this name. Throws std::runtime_error if there is no such pass.
+std::unique_ptr<EncoderPass> createPass(std::string_view name, RleStreamEncoder::Sink sink,
+                                        const PassOptions& options = {});
+
+struct PassStats
+{
+    std::string name;
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    // Time spent in the pass itself, not in the passes after it
+    std::chrono::steady_clock::duration time{};
+};
+
+/// @brief Runs the input through a list of passes in order, the output of the last pass goes to the sink.
+///
+/// Throws std::runtime_error if a pass name is unknown.
+class EncoderPipeline
+{
+  public:
+    EncoderPipeline(const std::vector<std::string>& passNames, RleStreamEncoder::Sink sink,
+                    const PassOptions& options = {});
+
+    // Passes hold a pointer to the pipeline
+    EncoderPipeline(const EncoderPipeline&) = delete;
+    EncoderPipeline& operator=(const EncoderPipeline&) = delete;
+
+    void feed(std::string_view chunk);
+
+    /// @brief Finishes the passes in order, so what each of them holds back runs through the ones after it.
+    void finish();
+
+    const std::vector<PassStats>& getStats() const;
+
+  private:
+    void feedPass(size_t index, std::string_view chunk);
+
+    RleStreamEncoder::Sink sink;
+    std::vector<std::unique_ptr<EncoderPass>> passes;
+    std::vector<PassStats> stats;
+};
+} // namespace RP::Encoder
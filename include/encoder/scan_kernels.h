@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+
+// Byte scanning primitives used by the encoder to skip over large stretches of plain text.
+//
+// Each kernel has a scalar implementation and, on x86-64, SSE2 and AVX2 implementations. The best one supported by
+// the CPU is picked once at startup, the overloads taking a SimdLevel run a specific implementation (for testing).
+namespace RP::Encoder::Kernels
+{
+enum class SimdLevel
+{
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+/// @brief Returns the best SIMD level supported by this CPU.
+SimdLevel detectSimdLevel();
+
+/// @brief Returns the SIMD level used by the kernels that don't take one.
+SimdLevel getActiveSimdLevel();
+
+/// @brief Returns the index of the first '[', ']' or '\' in data, or size if there is none.
+size_t findDelimiter(const char* data, size_t size);
+size_t findDelimiter(const char* data, size_t size, SimdLevel level);
+
+/// @brief Returns the number of bytes at the start of data that are equal to c.
+size_t countRun(const char* data, size_t size, char c);
+size_t countRun(const char* data, size_t size, char c, SimdLevel level);
+
+/// @brief Returns the index of the first byte that is followed by the same byte, or size if there is none.
+size_t findRepeat(const char* data, size_t size);
+size_t findRepeat(const char* data, size_t size, SimdLevel level);
+
+/// @brief Returns whether c is part of the base64 alphabet ('A'-'Z', 'a'-'z', '0'-'9', '+', '/' and '=').
+inline bool isBase64Character(char c)
+{
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '+' || c == '/' ||
+           c == '=';
+}
+
+/// @brief Returns the index of the first byte that isn't ASCII (has its high bit set), or size if there is none.
+size_t findNonAscii(const char* data, size_t size);
+size_t findNonAscii(const char* data, size_t size, SimdLevel level);
+
+/// @brief Returns whether c is a UTF-8 continuation byte (10xxxxxx).
+inline bool isUtf8Continuation(char c)
+{
+    return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+}
+
+/// @brief Returns the length of the UTF-8 sequence that starts with c, or 0 if c can't start one.
+inline size_t getUtf8SequenceLength(char c)
+{
+    const unsigned char byte = static_cast<unsigned char>(c);
+    if (byte < 0x80)
+    {
+        return 1;
+    }
+    if (byte >= 0xC2 && byte <= 0xDF)
+    {
+        return 2;
+    }
+    if (byte >= 0xE0 && byte <= 0xEF)
+    {
+        return 3;
+    }
+    return byte >= 0xF0 && byte <= 0xF4 ? 4 : 0;
+}
+
+/// @brief Returns the start of the character that ends right before end, looking no further back than begin. That is
+/// the lead byte of a valid UTF-8 sequence ending there, otherwise the byte before end is a character of its own.
+inline size_t findUtf8CharacterStart(const char* data, size_t begin, size_t end)
+{
+    size_t start = end - 1;
+    while (start > begin && end - start < 4 && isUtf8Continuation(data[start]))
+    {
+        start--;
+    }
+    return getUtf8SequenceLength(data[start]) == end - start ? start : end - 1;
+}
+
+/// @brief Returns the number of bytes at the start of data that are base64 characters.
+size_t countBase64(const char* data, size_t size);
+size_t countBase64(const char* data, size_t size, SimdLevel level);
+} // namespace RP::Encoder::Kernels
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include "encoder.h"
+#include "token_scanner.h"
+#include "utils/timestamp_utils.h"
+
+namespace RP::Encoder
+{
+/// @brief Optional stage in front of the encoder that shortens the timestamps of window change records.
+///
+/// A record looks like '[CHANGE_WINDOW]"<title>" TIMESTAMP: 2026 October seventeenth 14:03[/CHANGE_WINDOW]'. When
+/// the previous record has a timestamp of the same day, at most MAX_DELTA_MINUTES earlier, the timestamp is written
+/// as the minutes since that one instead, e.g. '+3m'. The first record of a day and the first one after a long gap
+/// keep their full timestamp, so a reader never has to go back far to find the time.
+///
+/// The same class undoes this when constructed with Direction::Decode, see timestampDeltaDecode(). A '+' that
+/// follows '" TIMESTAMP: ' in a record is written as '++', so the deltas can't be confused with the input. Only the
+/// text after the last '" TIMESTAMP: ' of a record is the timestamp, so a window title can contain it too.
+///
+/// Timestamps are parsed and formatted in place, the stage only allocates when it is constructed.
+class TimestampDeltaStage
+{
+  public:
+    enum class Direction
+    {
+        Encode,
+        Decode,
+    };
+
+    static constexpr int MAX_DELTA_MINUTES = 60;
+    // Text after '" TIMESTAMP: ' longer than this isn't a timestamp and is copied as is
+    static constexpr size_t MAX_TIMESTAMP_LENGTH = 64;
+
+    explicit TimestampDeltaStage(RleStreamEncoder::Sink sink, Direction direction = Direction::Encode,
+                                 size_t outputBufferSize = StageOutput::DEFAULT_BUFFER_SIZE);
+
+    void feed(std::string_view chunk);
+
+    /// @brief Writes out the remaining output. No more input may be fed afterwards.
+    void finish();
+
+    /// @brief Number of timestamps that were written as deltas, or expanded again when decoding.
+    size_t getDeltaCount() const;
+
+  private:
+    friend class TokenScanner;
+    void onText(const char* data, size_t size);
+    void onToken(std::string_view content);
+    void onUnclosedToken(std::string_view content);
+
+    void appendRecordText(const char* data, size_t size);
+    // Writes out the text collected after '" TIMESTAMP: ' unchanged, apart from the '+' escape
+    void flushTimestamp();
+    void endRecord();
+    bool writeDelta(const RP::Utils::LLMReadableTimestamp& timestamp);
+    bool expandDelta();
+
+  private:
+    Direction direction;
+    StageOutput output;
+
+    TokenScanner scanner;
+
+    bool inRecord = false;
+    // Number of characters of '" TIMESTAMP: ' that the record text ends with
+    size_t markerMatched = 0;
+    // Whether the record text after the last '" TIMESTAMP: ' is being collected in timestamp
+    bool collectingTimestamp = false;
+    // Text after the last '" TIMESTAMP: ', without the '+' escape
+    std::string timestamp;
+    // Whether the collected text was preceded by the '+' escape in the encoded recording
+    bool escaped = false;
+
+    // Timestamp of the previous record, if it had one
+    bool hasPreviousTimestamp = false;
+    RP::Utils::LLMReadableTimestamp previousTimestamp{};
+
+    size_t deltaCount = 0;
+};
+
+/// @brief Expands the timestamps written as deltas by TimestampDeltaStage.
+std::string timestampDeltaDecode(std::string_view encodedString);
+
+/// @brief Same as timestampDeltaDecode(), but hands the decoded string to the sink in pieces.
+void timestampDeltaDecode(std::string_view encodedString, const RleStreamEncoder::Sink& sink);
+} // namespace RP::Encoder
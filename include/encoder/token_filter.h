@@ -0,0 +1,53 @@
+#pragma once
+
+#include <bitset>
+#include <string>
+#include <string_view>
+#include "encoder.h"
+#include "token_scanner.h"
+#include "utils/special_tokens.h"
+
+namespace RP::Encoder
+{
+// Set of special tokens, indexed by RP::Tokens::TokenId
+using TokenSet = std::bitset<RP::Tokens::TOKEN_COUNT>;
+
+/// @brief Optional stage in front of the encoder that removes special tokens.
+///
+/// Tokens are identified with the special token dictionary, so checking one costs a single table lookup. Removing
+/// a token that starts a window change record or a screenshot removes the whole record up to its end token. Records
+/// that are kept are copied untouched, including their end token. Brackets that aren't in the dictionary are typed
+/// text and always kept.
+class TokenFilterStage
+{
+  public:
+    TokenFilterStage(RleStreamEncoder::Sink sink, const TokenSet& removedTokens,
+                     size_t outputBufferSize = StageOutput::DEFAULT_BUFFER_SIZE);
+
+    void feed(std::string_view chunk);
+
+    /// @brief Writes out the remaining output. No more input may be fed afterwards.
+    void finish();
+
+    /// @brief Number of tokens that were removed, a removed record counts as one.
+    size_t getRemovedTokenCount() const;
+
+  private:
+    friend class TokenScanner;
+    void onText(const char* data, size_t size);
+    void onToken(std::string_view content);
+    void onUnclosedToken(std::string_view content);
+
+  private:
+    TokenSet removedTokens;
+    StageOutput output;
+
+    TokenScanner scanner;
+
+    // End token of the record being copied or skipped, TokenId::Unknown outside of records
+    RP::Tokens::TokenId recordEndToken = RP::Tokens::TokenId::Unknown;
+    bool skippingRecord = false;
+
+    size_t removedTokenCount = 0;
+};
+} // namespace RP::Encoder
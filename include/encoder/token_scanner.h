@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include "encoder.h"
+
+namespace RP::Encoder
+{
+/// @brief Splits a recording that is fed in chunks into plain text and special tokens.
+///
+/// A '[' starts a special token and the next ']' closes it, unless it is preceded by a '\'. This is how the encoder
+/// reads special tokens, so passes in front of it see the same tokens it does. Tokens can span chunks, they are
+/// collected until they are closed.
+///
+/// The handler gets onText(const char* data, size_t size) for plain text, in as many pieces as it was fed in,
+/// onToken(std::string_view content) for every closed token and, from finish(), onUnclosedToken(std::string_view
+/// content) if the recording ends inside a token. Contents are passed without the brackets.
+class TokenScanner
+{
+  public:
+    template <typename Handler> void feed(std::string_view chunk, Handler& handler)
+    {
+        const char* data = chunk.data();
+        const size_t size = chunk.size();
+        size_t i = 0;
+
+        while (i < size)
+        {
+            if (inToken)
+            {
+                // Find the closing character for this token (']'), it must not be escaped
+                size_t j = findUnescaped(data, size, i, ']');
+                tokenContent.append(data + i, j - i);
+                if (j == size)
+                {
+                    break;
+                }
+
+                inToken = false;
+                handler.onToken(std::string_view(tokenContent));
+                i = j + 1;
+                continue;
+            }
+
+            // Everything up to the next unescaped '[' is plain text
+            size_t j = findUnescaped(data, size, i, '[');
+            if (j > i)
+            {
+                handler.onText(data + i, j - i);
+            }
+            if (j < size)
+            {
+                inToken = true;
+                tokenContent.clear();
+            }
+            i = j + 1;
+        }
+
+        if (size > 0)
+        {
+            prevInputChar = data[size - 1];
+        }
+    }
+
+    template <typename Handler> void finish(Handler& handler)
+    {
+        if (inToken)
+        {
+            inToken = false;
+            handler.onUnclosedToken(std::string_view(tokenContent));
+        }
+    }
+
+  private:
+    // Returns the index of the first occurrence of 'delimiter' at or after 'from' that is not preceded by a '\', or
+    // 'size' if there is none. The last character of the previous chunk is used to check the first one of this chunk.
+    size_t findUnescaped(const char* data, size_t size, size_t from, char delimiter) const
+    {
+        size_t i = from;
+        while (i < size)
+        {
+            const void* found = std::memchr(data + i, delimiter, size - i);
+            if (!found)
+            {
+                return size;
+            }
+            size_t j = static_cast<const char*>(found) - data;
+            char prev = j == 0 ? prevInputChar : data[j - 1];
+            if (prev != '\\')
+            {
+                return j;
+            }
+            i = j + 1;
+        }
+        return size;
+    }
+
+    char prevInputChar = '\0';
+    bool inToken = false;
+    std::string tokenContent;
+};
+
+/// @brief Output buffer of the stages that run on a TokenScanner.
+///
+/// Those stages get their input in arbitrarily sized chunks like RleStreamEncoder and write their output here. It is
+/// handed to the sink in pieces of the buffer size, so however much a stage writes at once, the buffer doesn't grow
+/// and the next stage never gets a piece larger than that.
+class StageOutput
+{
+  public:
+    static constexpr size_t DEFAULT_BUFFER_SIZE = 64 * 1024;
+
+    explicit StageOutput(RleStreamEncoder::Sink sink, size_t bufferSize = DEFAULT_BUFFER_SIZE)
+        : sink(std::move(sink)), bufferSize(std::max<size_t>(bufferSize, 1))
+    {
+        buffer.reserve(this->bufferSize);
+    }
+
+    void append(const char* data, size_t size)
+    {
+        while (size > 0)
+        {
+            const size_t count = std::min(size, bufferSize - buffer.size());
+            buffer.append(data, count);
+            data += count;
+            size -= count;
+            if (buffer.size() == bufferSize)
+            {
+                flush();
+            }
+        }
+    }
+
+    void append(std::string_view data)
+    {
+        append(data.data(), data.size());
+    }
+
+    /// @brief Hands whatever is buffered to the sink.
+    void flush()
+    {
+        if (!buffer.empty())
+        {
+            sink(buffer);
+            buffer.clear();
+        }
+    }
+
+  private:
+    RleStreamEncoder::Sink sink;
+    size_t bufferSize;
+    std::string buffer;
+};
+} // namespace RP::Encoder
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include "encoder.h"
+#include "token_scanner.h"
+#include "utils/special_tokens.h"
+#include "utils/timestamp_utils.h"
+
+namespace RP::Encoder
+{
+/// @brief Optional stage in front of the encoder that collapses bursts of window changes.
+///
+/// Alt-tabbing through windows writes a window change record for every window passed on the way. When window change
+/// records follow each other with nothing but line breaks and window switching keys ('[ALT]', '[TAB]',
+/// '[ALT+TAB]' and shift) in between, and each timestamp is at most maxGapMinutes after the one before it, only the
+/// last record is kept and the number of windows passed is written in front of its title:
+/// '[CHANGE_WINDOW]3 brief windows, then "Editor" TIMESTAMP: 2026 October seventeenth 14:03[/CHANGE_WINDOW]'.
+///
+/// Timestamps are only precise to the minute, so the default gap of 0 collapses the records of the same minute. The
+/// stage must run before the 'timestamps' pass, it needs the full timestamps. It only holds back the last record and
+/// what follows it, up to MAX_HELD_SIZE characters, so memory use doesn't depend on the recording.
+class WindowStormStage
+{
+  public:
+    static constexpr int DEFAULT_MAX_GAP_MINUTES = 0;
+    // A record or idle input after it longer than this is written out without collapsing it
+    static constexpr size_t MAX_HELD_SIZE = 4096;
+
+    explicit WindowStormStage(RleStreamEncoder::Sink sink, int maxGapMinutes = DEFAULT_MAX_GAP_MINUTES,
+                              size_t outputBufferSize = StageOutput::DEFAULT_BUFFER_SIZE);
+
+    void feed(std::string_view chunk);
+
+    /// @brief Writes out the remaining output. No more input may be fed afterwards.
+    void finish();
+
+    /// @brief Number of window change records that were dropped.
+    size_t getCollapsedRecordCount() const;
+
+  private:
+    friend class TokenScanner;
+    void onText(const char* data, size_t size);
+    void onToken(std::string_view content);
+    void onUnclosedToken(std::string_view content);
+
+    void appendRecord(const char* data, size_t size);
+    void appendIdle(const char* data, size_t size);
+    void endRecord();
+    // Writes out the held record, with the number of windows it replaces, and the idle input after it
+    void flushHeld();
+
+  private:
+    int maxGapMinutes;
+    StageOutput output;
+
+    TokenScanner scanner;
+
+    // The record being read, from '[CHANGE_WINDOW]' on
+    std::string record;
+    bool inRecord = false;
+    // Set when the record being read grew past MAX_HELD_SIZE and is copied as is
+    bool copyingRecord = false;
+
+    // Last complete record and the idle input after it, held back until it is clear whether the next record replaces
+    // it. heldTimestamp is only valid if heldHasTimestamp.
+    std::string heldRecord;
+    std::string idle;
+    size_t heldWindowCount = 0;
+    bool heldHasTimestamp = false;
+    RP::Utils::LLMReadableTimestamp heldTimestamp{};
+
+    size_t collapsedRecordCount = 0;
+};
+} // namespace RP::Encoder
@@ -1,45 +1,228 @@
 #pragma once
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
 
 #include <assert.h>
+#include <atomic>
 #include <cerrno>
-#include <codecvt>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
-#include <fstream>
+#include <initializer_list>
 #include <iostream>
-#include <locale>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 #include "event_source.h"
+#include "utils/binary_event_log.h"
+#include "utils/special_tokens.h"
 
-// Cause buffer recording buffer to flush & write to file upon reaching this
-// size
-constexpr size_t MAX_RECORDING_BUFFER_SIZE = 1500;
+// Default capacity of each recording buffer (in bytes)
+constexpr size_t DEFAULT_RECORDING_BUFFER_SIZE = 1500;
 
+// How far the writer pushes the recording towards the disk after writing buffers to the file
+enum class FlushDurability
+{
+    // Left to the C runtime, which hands it to the OS when its own buffer is full or the file is closed
+    None,
+    // Handed to the OS after every write, survives the recorder crashing
+    OsFlush,
+    // Handed to the OS after every write and synced to the disk within syncInterval, survives power loss
+    Sync,
+};
+
+// What EventSink writes to the file
+enum class RecordingFormat
+{
+    // The text the encoder and other tools read
+    Text,
+    // Records of the binary event log (see utils/binary_event_log.h), replay_render turns them into the text format
+    Binary,
+};
+
+// Decides when EventSink writes recorded events to the file
+struct FlushPolicy
+{
+    // Capacity of each recording buffer (in bytes), a full buffer is handed to the writer thread. Longer events are
+    // written on their own.
+    size_t maxBytes = DEFAULT_RECORDING_BUFFER_SIZE;
+    // Events are written at most this long after they were recorded, even if their buffer isn't full. Zero waits
+    // until the buffer is full.
+    std::chrono::milliseconds maxAge = std::chrono::seconds(2);
+    // How long the writer waits after a buffer is handed to it, so buffers filled meanwhile are written with the
+    // same flush
+    std::chrono::milliseconds groupCommitDelay = std::chrono::milliseconds(0);
+    FlushDurability durability = FlushDurability::OsFlush;
+    // Longest time written events stay unsynced with FlushDurability::Sync
+    std::chrono::milliseconds syncInterval = std::chrono::seconds(1);
+};
+
+// What the writer did so far, to tune the FlushPolicy with
+struct FlushStats
+{
+    // Times queued buffers were written to the file, each followed by one flush
+    uint64_t flushCount = 0;
+    // Buffers (and events too long for one) written
+    uint64_t bufferCount = 0;
+    // Buffers handed to the writer because their first event reached maxAge
+    uint64_t agedBufferCount = 0;
+    uint64_t bytesWritten = 0;
+    uint64_t syncCount = 0;
+    // Time spent writing, flushing and syncing
+    std::chrono::microseconds totalFlushLatency{0};
+    std::chrono::microseconds maxFlushLatency{0};
+};
+
+// Collects events from the event sources and writes them to the recording file.
+//
+// Every call to operator<< or write() is one event, and events are written whole: text of events written by other
+// threads never ends up in the middle of an event. Producers reserve space for their event in the active recording
+// buffer with a compare-and-swap and copy it in, so they never wait for each other or for the disk. The producer
+// whose event doesn't fit anymore seals the buffer, queues it for the writer thread and activates a recycled one.
+// The writer thread writes sealed buffers to the file, then puts them back on the free list. Events longer than a
+// buffer are queued on their own, right after the buffer that was active. The FlushPolicy decides how big buffers
+// are, how long events may wait in one and how durable the file is.
+//
+// In the binary format, every event becomes one record stamped with the milliseconds since the previous one. The
+// writer merges text events in quick succession within a buffer into one record, so typing costs about a byte per
+// typed byte.
+//
+// Text is kept as UTF-8 from start to end. UTF-8 input is copied as is, wide input is converted straight into the
+// buffer. Appending an event that fits in a buffer doesn't allocate.
 class EventSink : public std::enable_shared_from_this<EventSink>
 {
   public:
-    EventSink(const std::string& name);
+    EventSink(const std::string& name, const FlushPolicy& policy = FlushPolicy(),
+              RecordingFormat format = RecordingFormat::Text);
     ~EventSink();
 
-    EventSink& operator<<(const char* data);
+    EventSink& operator<<(std::string_view data);
+    EventSink& operator<<(std::u16string_view data);
+    // UTF-16 on Windows, UTF-32 elsewhere
     EventSink& operator<<(const wchar_t* data);
 
+    // Writes the pieces (UTF-8) as a single event
+    EventSink& write(std::initializer_list<std::string_view> pieces);
+
+    // Events the recorder knows the meaning of. The text format renders them, the binary format keeps only their
+    // data and time.
+    EventSink& writeToken(RP::Tokens::TokenId token);
+    // The window change is stamped with the current time
+    EventSink& writeWindowChange(std::string_view windowTitle);
+    EventSink& writeScreenshotPath(std::string_view path);
+    EventSink& writeScreenshotBase64(std::string_view base64Data);
+
+    // Hands the events written so far to the writer and waits until they are in the file
+    void flush();
+
+    // Flushes and stops the writer thread, e.g. at shutdown. Afterwards a producer that fills a buffer writes it
+    // to the file itself, and whatever is left is written by the destructor.
+    void drain();
+
+    FlushStats getFlushStats() const;
+
   private:
-    // Checks buffer size and calls flushData() it if its too big
-    inline void flushIfMaxSizeExceeded();
+    struct RecordingBuffer
+    {
+        explicit RecordingBuffer(size_t capacity) : data(std::make_unique<char[]>(capacity))
+        {
+        }
+
+        std::unique_ptr<char[]> data;
+        // Bytes reserved by producers. SEALED_FLAG is set while the buffer isn't active.
+        std::atomic<uint64_t> reserved{SEALED_FLAG};
+        // Bytes that producers finished copying in
+        std::atomic<size_t> committed{0};
+        // steady_clock time of the first event since the buffer was activated, zero until it's stamped
+        std::atomic<int64_t> firstEventTime{0};
+    };
+
+    // A sealed buffer, or an event that is too big for one
+    struct SealedBuffer
+    {
+        RecordingBuffer* buffer = nullptr;
+        size_t size = 0;
+        std::string oversizedEvent;
+    };
+
+    static constexpr uint64_t SEALED_FLAG = uint64_t(1) << 63;
+
+    // Reserves length bytes in the active buffer and has writeText(char* destination) write the event there, may be
+    // called from any thread
+    template <typename WriteText>
+    void append(size_t length, const WriteText& writeText);
+
+    // Appends a record of the binary format, writePayload(char* destination) writes payloadLength bytes
+    template <typename WritePayload>
+    void appendRecord(RP::EventLog::RecordType type, size_t payloadLength, const WritePayload& writePayload);
+
+    // Milliseconds since the previous record, may be called from any thread
+    uint64_t takeElapsedMilliseconds();
+
+    // Seals the buffer and queues it for writing, followed by the oversized event if there is one. Returns false
+    // if another thread sealed it first, the next buffer is active either way.
+    bool sealBuffer(RecordingBuffer* buffer, std::string* oversizedEvent);
 
-    // Flush all buffered data to file/output stream
-    inline void flushData();
+    // Writes the sealed buffers to the file, in the order they were queued. Returns false if none is queued.
+    bool writeQueuedBuffers();
 
-    // Vector of buffered data
-    std::vector<wchar_t> recordingBuffer;
+    // Flushes and syncs the file after writing as the policy asks, while holding fileMutex
+    void commitFile(bool flushRequested);
+    void syncFile();
+
+    // When the buffer holds events for maxAge, or when to look again if it's empty
+    std::chrono::steady_clock::time_point getAgeDeadline(RecordingBuffer* buffer) const;
+
+    // Body of the writer thread
+    void runWriter();
+
+    const FlushPolicy policy;
+    const RecordingFormat format;
+
+    // steady_clock time of the previous record, in milliseconds
+    std::atomic<int64_t> lastRecordTime{0};
+
+    std::atomic<RecordingBuffer*> activeBuffer;
+
+    // Protects everything below, up to the file
+    std::mutex writerMutex;
+    // Signalled when a buffer is queued or the writer should stop
+    std::condition_variable bufferQueued;
+    // Signalled when a buffer was written
+    std::condition_variable bufferWritten;
+    std::vector<std::unique_ptr<RecordingBuffer>> buffers;
+    std::vector<RecordingBuffer*> freeBuffers;
+    std::vector<SealedBuffer> writeQueue;
+    uint64_t sealedCount = 0;
+    uint64_t writtenCount = 0;
+    // flush() waits until writtenCount reaches it, the buffers up to it are flushed right away
+    uint64_t flushTarget = 0;
+    // The buffers up to it were flushed, and synced with FlushDurability::Sync, after they were written
+    uint64_t flushedCount = 0;
+    bool writerRunning = false;
+
+    // Held while writing to the file, so buffers are written one at a time and in order. Protects everything
+    // below, up to the file.
+    mutable std::mutex fileMutex;
+    // Buffers being written
+    std::vector<SealedBuffer> writingQueue;
+    // Records of the buffer being written with their text merged, in the binary format
+    std::string mergedRecords;
+    // When the written events have to be synced by, max() if they are
+    std::chrono::steady_clock::time_point syncDeadline = std::chrono::steady_clock::time_point::max();
+    FlushStats stats;
 
     // File that we're serializing user activity related events to
-    std::ofstream file;
+    std::FILE* file = nullptr;
+
+    std::thread writer;
 };
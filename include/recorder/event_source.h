@@ -4,6 +4,8 @@
 #include <memory>
 #include "utils/error_messages.h"
 
+class EventSink;
+
 class EventSource
 {
     friend class EventSink;
@@ -8,15 +8,11 @@
 
 #include "event_sink.h"
 #include "utils/logging.h"
+#include "utils/special_tokens.h"
 
 // Forward declarations
 class ScreenshotEventSource;
 
-// Tokens to identify screenshot data in the event stream
-constexpr const wchar_t* SCREENSHOT_PATH_TOKEN = L"[SCREENSHOT_PATH]";
-constexpr const wchar_t* SCREENSHOT_BASE64_TOKEN = L"[SCREENSHOT_BASE64]";
-constexpr const wchar_t* SCREENSHOT_END_TOKEN = L"[/SCREENSHOT]";
-
 // Specifies the strategy for serializing screenshots
 // FilePath: Save the screenshot to a file and send the file path to the event sink.
 // Base64: Encode the screenshot as base64 and send it to the event sink.
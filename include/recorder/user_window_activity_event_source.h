@@ -5,12 +5,9 @@
 #include <string>
 
 #include "event_source.h"
+#include "utils/special_tokens.h"
 #include "windows_hook_manager.h"
 
-// Tokens to identify window change events in the event stream
-constexpr const char* WINDOW_CHANGE_TOKEN = "[CHANGE_WINDOW]";
-constexpr const char* WINDOW_CHANGE_END_TOKEN = "[/CHANGE_WINDOW]";
-
 class UserWindowActivityEventSource : public EventSource,
                                       public Replay::Windows::FocusObserver,
                                       public std::enable_shared_from_this<UserWindowActivityEventSource>
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "special_tokens.h"
+
+// Binary event log, the compact alternative to the text recording. The recorder writes one record per event instead
+// of rendered text, and replay_render renders the records as the text the recorder would have written.
+//
+// A record is a header byte, the milliseconds since the previous record as a varint, then the payload:
+//   - The low four bits of the header are the RecordType. The high four bits are the TokenId of a Token record, and
+//     the payload length of any other record, or LONG_PAYLOAD if the length follows the time as a varint.
+//   - Times come from a monotonic clock, so they never go backwards and are precise to the millisecond.
+//   - Text typed in quick succession is one Text record, stamped with the time of its last event.
+//   - Every recording session starts with a SessionStart record. Its payload is SESSION_MAGIC, the wall clock time
+//     (milliseconds since the Unix epoch) and the UTC offset (minutes, zigzag encoded) as varints.
+// Varints are little-endian base 128: seven bits per byte, the high bit is set on every byte but the last.
+namespace RP::EventLog
+{
+enum class RecordType : uint8_t
+{
+    SessionStart,
+    // Typed text, UTF-8
+    Text,
+    // A special token such as [ENTER], without payload
+    Token,
+    // Title of the window that got the focus, rendered with the time of the record
+    WindowChange,
+    ScreenshotPath,
+    ScreenshotBase64,
+
+    Count
+};
+
+constexpr std::string_view SESSION_MAGIC = "RPEL1";
+constexpr uint8_t LONG_PAYLOAD = 15;
+constexpr size_t MAX_VARINT_LENGTH = 10;
+// Header byte, time and payload length
+constexpr size_t MAX_RECORD_HEADER_LENGTH = 1 + 2 * MAX_VARINT_LENGTH;
+constexpr size_t MAX_SESSION_PAYLOAD_LENGTH = SESSION_MAGIC.size() + 2 * MAX_VARINT_LENGTH;
+// Text records at most this far apart are merged into one by the recorder
+constexpr uint64_t MAX_TEXT_MERGE_GAP_MILLISECONDS = 1000;
+
+/**
+ * Writes value as a varint
+ * @param output Receives the varint, must have room for MAX_VARINT_LENGTH bytes
+ * @return Number of bytes written
+ */
+size_t writeVarint(uint64_t value, char *output);
+
+/**
+ * Reads the varint at data[position] and advances position past it
+ * @return False if data ends in the middle of the varint, position is left alone then
+ * @throws std::runtime_error if the varint is longer than MAX_VARINT_LENGTH
+ */
+bool readVarint(std::string_view data, size_t &position, uint64_t &value);
+
+/**
+ * Writes the header of a record, the payload goes right after it
+ * @param elapsedMilliseconds Time since the previous record
+ * @param output Receives the header, must have room for MAX_RECORD_HEADER_LENGTH bytes
+ * @return Number of bytes written
+ */
+size_t writeRecordHeader(RecordType type, uint64_t elapsedMilliseconds, size_t payloadLength, char *output);
+
+/**
+ * Writes a whole Token record
+ * @param output Receives the record, must have room for MAX_RECORD_HEADER_LENGTH bytes
+ * @return Number of bytes written
+ */
+size_t writeTokenRecord(RP::Tokens::TokenId token, uint64_t elapsedMilliseconds, char *output);
+
+/**
+ * Writes the payload of a SessionStart record
+ * @param output Receives the payload, must have room for MAX_SESSION_PAYLOAD_LENGTH bytes
+ * @return Number of bytes written
+ */
+size_t writeSessionPayload(int64_t unixMilliseconds, int32_t utcOffsetMinutes, char *output);
+
+/**
+ * Reads the header of the record at the start of data, the payload doesn't have to be in data
+ * @return Length of the whole record, or zero if data ends in the middle of the header
+ * @throws std::runtime_error if the header is malformed
+ */
+uint64_t getRecordLength(std::string_view data);
+
+/**
+ * Copies the whole records at the start of records to output, merging each run of Text records that follow each
+ * other within maxGapMilliseconds into one record. The merged record has the time of the last text in it, so the
+ * records after it keep their times and the log renders the same.
+ * @return Number of bytes copied, the rest of records is the start of a record that continues after it
+ * @throws std::runtime_error if a record is malformed
+ */
+size_t mergeTextRecords(std::string_view records, uint64_t maxGapMilliseconds, std::string &output);
+
+/**
+ * Renders records as the text format of the recorder. The clock carries over from one call to the next, so a log can
+ * be rendered a chunk at a time.
+ */
+class TextRenderer
+{
+  public:
+    /**
+     * Renders the whole records at the start of data and appends the text to output
+     * @return Number of bytes rendered, the rest of data is the start of a record that continues after it
+     * @throws std::runtime_error if data isn't a binary event log or a record is malformed
+     */
+    size_t render(std::string_view data, std::string &output);
+
+    uint64_t getRecordCount() const
+    {
+        return recordCount;
+    }
+
+  private:
+    void renderRecord(RecordType type, uint8_t smallValue, std::string_view payload, std::string &output);
+
+    bool inSession = false;
+    // Wall clock time of the session start in its time zone, and the milliseconds since then
+    int64_t sessionStartMilliseconds = 0;
+    uint64_t sessionElapsedMilliseconds = 0;
+    uint64_t recordCount = 0;
+};
+} // namespace RP::EventLog
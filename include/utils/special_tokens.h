@@ -0,0 +1,164 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Special tokens shared by the recorder, which writes them into the event stream, and the encoder, which parses them.
+//
+// The vocabulary is fixed, so the encoder identifies tokens by a small id found with a perfect hash that is built at
+// compile time. Anything that is not in the vocabulary (typed brackets, malformed tokens) is TokenId::Unknown.
+namespace RP::Tokens
+{
+enum class TokenId : uint8_t
+{
+    Enter,
+    Backspace,
+    LeftCtrl,
+    LeftShift,
+    RightShift,
+    Space,
+    CapsLock,
+    Tab,
+    AltTab,
+    Alt,
+    ChangeWindow,
+    ChangeWindowEnd,
+    ScreenshotPath,
+    ScreenshotBase64,
+    ScreenshotEnd,
+
+    Count,
+    Unknown = Count
+};
+
+constexpr size_t TOKEN_COUNT = static_cast<size_t>(TokenId::Count);
+
+// Indexed by TokenId
+constexpr std::array<std::string_view, TOKEN_COUNT> TOKEN_STRINGS = {
+    "[ENTER]",
+    "[BACKSPACE]",
+    "[LCTRL]",
+    "[LSHIFT]",
+    "[RSHIFT]",
+    "[SPACE]",
+    "[CAPSLOCK]",
+    "[TAB]",
+    "[ALT+TAB]",
+    "[ALT]",
+    "[CHANGE_WINDOW]",
+    "[/CHANGE_WINDOW]",
+    "[SCREENSHOT_PATH]",
+    "[SCREENSHOT_BASE64]",
+    "[/SCREENSHOT]",
+};
+
+/// @brief Returns the token including its brackets, e.g. "[ENTER]". The string is null terminated.
+constexpr const char* getTokenString(TokenId id)
+{
+    return TOKEN_STRINGS[static_cast<size_t>(id)].data();
+}
+
+/// @brief Returns the content of the token without its brackets, e.g. "ENTER".
+constexpr std::string_view getTokenContent(TokenId id)
+{
+    const std::string_view token = TOKEN_STRINGS[static_cast<size_t>(id)];
+    return token.substr(1, token.size() - 2);
+}
+
+namespace Detail
+{
+constexpr uint32_t HASH_TABLE_BITS = 6;
+constexpr size_t HASH_TABLE_SIZE = size_t(1) << HASH_TABLE_BITS;
+
+// The length, first and last character tell all tokens apart, the multiplier spreads them over the table
+constexpr uint32_t hashContent(std::string_view content, uint32_t multiplier)
+{
+    if (content.empty())
+    {
+        return 0;
+    }
+    const uint32_t first = static_cast<unsigned char>(content.front());
+    const uint32_t last = static_cast<unsigned char>(content.back());
+    const uint32_t key = (static_cast<uint32_t>(content.size()) << 16) ^ (first << 8) ^ last;
+    return (key * multiplier) >> (32 - HASH_TABLE_BITS);
+}
+
+constexpr bool isPerfectHash(uint32_t multiplier)
+{
+    std::array<bool, HASH_TABLE_SIZE> used{};
+    for (size_t id = 0; id < TOKEN_COUNT; id++)
+    {
+        const uint32_t slot = hashContent(getTokenContent(static_cast<TokenId>(id)), multiplier);
+        if (used[slot])
+        {
+            return false;
+        }
+        used[slot] = true;
+    }
+    return true;
+}
+
+// Searches odd multipliers starting from the golden ratio one until no two tokens share a slot
+constexpr uint32_t findMultiplier()
+{
+    uint32_t multiplier = 0x9E3779B1u;
+    while (!isPerfectHash(multiplier))
+    {
+        multiplier += 2;
+    }
+    return multiplier;
+}
+
+constexpr uint32_t HASH_MULTIPLIER = findMultiplier();
+
+constexpr std::array<TokenId, HASH_TABLE_SIZE> buildHashTable()
+{
+    std::array<TokenId, HASH_TABLE_SIZE> table{};
+    for (TokenId& slot : table)
+    {
+        slot = TokenId::Unknown;
+    }
+    for (size_t id = 0; id < TOKEN_COUNT; id++)
+    {
+        table[hashContent(getTokenContent(static_cast<TokenId>(id)), HASH_MULTIPLIER)] = static_cast<TokenId>(id);
+    }
+    return table;
+}
+
+constexpr std::array<TokenId, HASH_TABLE_SIZE> HASH_TABLE = buildHashTable();
+} // namespace Detail
+
+/// @brief Returns the id of the token with this content (without brackets), or TokenId::Unknown.
+constexpr TokenId lookupToken(std::string_view content)
+{
+    const TokenId id = Detail::HASH_TABLE[Detail::hashContent(content, Detail::HASH_MULTIPLIER)];
+    return id != TokenId::Unknown && getTokenContent(id) == content ? id : TokenId::Unknown;
+}
+
+/// @brief Returns the token that ends the record (a window change or a screenshot) that tokenId starts, or
+/// TokenId::Unknown if it doesn't start one. Records are data written by the recorder rather than typed input.
+constexpr TokenId getRecordEndToken(TokenId tokenId)
+{
+    switch (tokenId)
+    {
+    case TokenId::ChangeWindow:
+        return TokenId::ChangeWindowEnd;
+    case TokenId::ScreenshotPath:
+    case TokenId::ScreenshotBase64:
+        return TokenId::ScreenshotEnd;
+    default:
+        return TokenId::Unknown;
+    }
+}
+} // namespace RP::Tokens
+
+// Tokens to identify window change events in the event stream
+constexpr const char* WINDOW_CHANGE_TOKEN = RP::Tokens::getTokenString(RP::Tokens::TokenId::ChangeWindow);
+constexpr const char* WINDOW_CHANGE_END_TOKEN = RP::Tokens::getTokenString(RP::Tokens::TokenId::ChangeWindowEnd);
+
+// Tokens to identify screenshot data in the event stream
+constexpr const char* SCREENSHOT_PATH_TOKEN = RP::Tokens::getTokenString(RP::Tokens::TokenId::ScreenshotPath);
+constexpr const char* SCREENSHOT_BASE64_TOKEN = RP::Tokens::getTokenString(RP::Tokens::TokenId::ScreenshotBase64);
+constexpr const char* SCREENSHOT_END_TOKEN = RP::Tokens::getTokenString(RP::Tokens::TokenId::ScreenshotEnd);
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <ctime>
 #include <string>
+#include <string_view>
 
 namespace RP::Utils
 {
@@ -19,4 +22,43 @@ std::string formatTimestampGetOrdinalDay(int day);
  * @return Formatted timestamp string
  */
 std::string formatTimestampToLLMReadable(std::tm *time);
+
+/**
+ * Fields of a timestamp in the format of formatTimestampToLLMReadable, which is precise to the minute
+ */
+struct LLMReadableTimestamp
+{
+    int year;
+    int month; // 1-12
+    int day;   // 1-31
+    int hour;
+    int minute;
+};
+
+/**
+ * Parses a timestamp written by formatTimestampToLLMReadable, without allocating
+ * @param text The timestamp, e.g. "2023 January twenty-first 14:30"
+ * @param timestamp Receives the fields of the timestamp
+ * @return Whether text is a timestamp that formatTimestampToLLMReadable writes exactly like this
+ */
+bool parseLLMReadableTimestamp(std::string_view text, LLMReadableTimestamp &timestamp);
+
+/**
+ * Formats a timestamp like formatTimestampToLLMReadable, without allocating
+ * @param timestamp The fields of the timestamp
+ * @param buffer Receives the formatted timestamp, it is not null terminated
+ * @param bufferSize Size of buffer, MAX_LLM_READABLE_TIMESTAMP_LENGTH is always enough
+ * @return Number of characters written, or 0 if a field is out of range or the buffer is too small
+ */
+size_t formatTimestampToLLMReadable(const LLMReadableTimestamp &timestamp, char *buffer, size_t bufferSize);
+
+/**
+ * Splits a time into the fields of formatTimestampToLLMReadable
+ * @param secondsSinceEpoch Seconds since 1970-01-01 00:00, counted in the time zone the timestamp is in
+ * @return The fields of the timestamp, the year may be out of the range formatTimestampToLLMReadable accepts
+ */
+LLMReadableTimestamp getLLMReadableTimestamp(int64_t secondsSinceEpoch);
+
+// Length of the longest timestamp formatTimestampToLLMReadable writes, "9999 September twenty-seventh 23:59"
+constexpr size_t MAX_LLM_READABLE_TIMESTAMP_LENGTH = 35;
 } // namespace RP::Utils
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace RP::Utils
+{
+/**
+ * Computes the length of UTF-16 text once converted to UTF-8, without converting it
+ * @param text UTF-16 text, unpaired surrogates count as U+FFFD
+ * @return Number of bytes convertUtf16ToUtf8 writes for text
+ */
+size_t getUtf8Length(std::u16string_view text);
+
+/**
+ * Converts UTF-16 text to UTF-8, without allocating. Runs of ASCII are converted eight characters at a time.
+ * @param text UTF-16 text, unpaired surrogates are replaced with U+FFFD
+ * @param output Receives the UTF-8 text, must have room for getUtf8Length(text) bytes
+ * @return Number of bytes written
+ */
+size_t convertUtf16ToUtf8(std::u16string_view text, char *output);
+
+/**
+ * Computes the length of UTF-32 text once converted to UTF-8, without converting it
+ * @param text UTF-32 text, surrogates and values above U+10FFFF count as U+FFFD
+ * @return Number of bytes convertUtf32ToUtf8 writes for text
+ */
+size_t getUtf8Length(std::u32string_view text);
+
+/**
+ * Converts UTF-32 text to UTF-8, without allocating
+ * @param text UTF-32 text, surrogates and values above U+10FFFF are replaced with U+FFFD
+ * @param output Receives the UTF-8 text, must have room for getUtf8Length(text) bytes
+ * @return Number of bytes written
+ */
+size_t convertUtf32ToUtf8(std::u32string_view text, char *output);
+} // namespace RP::Utils
@@ -0,0 +1,282 @@
+#include "binary_event_log.h"
+
+#include <stdexcept>
+#include "timestamp_utils.h"
+
+namespace
+{
+uint64_t zigzagEncode(int64_t value)
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t zigzagDecode(uint64_t value)
+{
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// Division that rounds towards negative infinity, for times before the epoch
+int64_t floorDivide(int64_t value, int64_t divisor)
+{
+    return value / divisor - (value % divisor < 0 ? 1 : 0);
+}
+
+struct Record
+{
+    RP::EventLog::RecordType type;
+    uint8_t smallValue;
+    uint64_t elapsedMilliseconds;
+    // Offset of the payload in the data the record was read from
+    size_t payloadOffset;
+    uint64_t payloadLength;
+};
+
+// Reads the header of the record at data[position], returns false if data ends in the middle of the header
+bool readRecordHeader(std::string_view data, size_t position, Record &record)
+{
+    using RP::EventLog::RecordType;
+    size_t cursor = position + 1;
+    const uint8_t header = static_cast<uint8_t>(data[position]);
+    const uint8_t typeValue = header & 0x0F;
+    record.smallValue = header >> 4;
+    if (typeValue >= static_cast<uint8_t>(RecordType::Count))
+    {
+        throw std::runtime_error("Unknown record type " + std::to_string(typeValue) +
+                                 " in binary event log at offset " + std::to_string(position));
+    }
+    record.type = static_cast<RecordType>(typeValue);
+
+    if (!RP::EventLog::readVarint(data, cursor, record.elapsedMilliseconds))
+    {
+        return false;
+    }
+    record.payloadLength = 0;
+    if (record.type != RecordType::Token)
+    {
+        record.payloadLength = record.smallValue;
+        if (record.smallValue == RP::EventLog::LONG_PAYLOAD &&
+            !RP::EventLog::readVarint(data, cursor, record.payloadLength))
+        {
+            return false;
+        }
+    }
+    record.payloadOffset = cursor;
+    return true;
+}
+
+// Reads the record at data[position], returns false if data ends before the record does
+bool readRecord(std::string_view data, size_t position, Record &record)
+{
+    return readRecordHeader(data, position, record) && data.size() - record.payloadOffset >= record.payloadLength;
+}
+
+std::string_view getPayload(std::string_view data, const Record &record)
+{
+    return data.substr(record.payloadOffset, record.payloadLength);
+}
+
+// Offset right after the record
+size_t getRecordEnd(const Record &record)
+{
+    return record.payloadOffset + record.payloadLength;
+}
+} // namespace
+
+namespace RP::EventLog
+{
+size_t writeVarint(uint64_t value, char *output)
+{
+    size_t length = 0;
+    while (value >= 0x80)
+    {
+        output[length++] = static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    output[length++] = static_cast<char>(value);
+    return length;
+}
+
+bool readVarint(std::string_view data, size_t &position, uint64_t &value)
+{
+    uint64_t result = 0;
+    for (size_t i = 0; i < MAX_VARINT_LENGTH; i++)
+    {
+        if (position + i >= data.size())
+        {
+            return false;
+        }
+        const uint8_t byte = static_cast<uint8_t>(data[position + i]);
+        result |= static_cast<uint64_t>(byte & 0x7F) << (7 * i);
+        if ((byte & 0x80) == 0)
+        {
+            position += i + 1;
+            value = result;
+            return true;
+        }
+    }
+    throw std::runtime_error("Malformed varint in binary event log at offset " + std::to_string(position));
+}
+
+size_t writeRecordHeader(RecordType type, uint64_t elapsedMilliseconds, size_t payloadLength, char *output)
+{
+    const bool longPayload = payloadLength >= LONG_PAYLOAD;
+    const uint8_t smallValue = longPayload ? LONG_PAYLOAD : static_cast<uint8_t>(payloadLength);
+    output[0] = static_cast<char>(static_cast<uint8_t>(type) | (smallValue << 4));
+    size_t length = 1 + writeVarint(elapsedMilliseconds, output + 1);
+    if (longPayload)
+    {
+        length += writeVarint(payloadLength, output + length);
+    }
+    return length;
+}
+
+size_t writeTokenRecord(RP::Tokens::TokenId token, uint64_t elapsedMilliseconds, char *output)
+{
+    static_assert(RP::Tokens::TOKEN_COUNT <= 16, "Token ids have to fit in the high four bits of the header");
+    output[0] = static_cast<char>(static_cast<uint8_t>(RecordType::Token) | (static_cast<uint8_t>(token) << 4));
+    return 1 + writeVarint(elapsedMilliseconds, output + 1);
+}
+
+size_t writeSessionPayload(int64_t unixMilliseconds, int32_t utcOffsetMinutes, char *output)
+{
+    size_t length = SESSION_MAGIC.copy(output, SESSION_MAGIC.size());
+    length += writeVarint(static_cast<uint64_t>(unixMilliseconds), output + length);
+    length += writeVarint(zigzagEncode(utcOffsetMinutes), output + length);
+    return length;
+}
+
+size_t mergeTextRecords(std::string_view records, uint64_t maxGapMilliseconds, std::string &output)
+{
+    size_t position = 0;
+    Record record;
+    while (position < records.size() && readRecord(records, position, record))
+    {
+        if (record.type != RecordType::Text)
+        {
+            output.append(records.substr(position, getRecordEnd(record) - position));
+            position = getRecordEnd(record);
+            continue;
+        }
+
+        // Find the end of the run first, its length goes in the header
+        const size_t runStart = position;
+        uint64_t elapsedMilliseconds = record.elapsedMilliseconds;
+        uint64_t payloadLength = record.payloadLength;
+        position = getRecordEnd(record);
+        Record next;
+        while (position < records.size() && readRecord(records, position, next) && next.type == RecordType::Text &&
+               next.elapsedMilliseconds <= maxGapMilliseconds)
+        {
+            elapsedMilliseconds += next.elapsedMilliseconds;
+            payloadLength += next.payloadLength;
+            position = getRecordEnd(next);
+        }
+
+        char header[MAX_RECORD_HEADER_LENGTH];
+        output.append(header, writeRecordHeader(RecordType::Text, elapsedMilliseconds, payloadLength, header));
+        for (size_t cursor = runStart; cursor < position; cursor = getRecordEnd(record))
+        {
+            readRecord(records, cursor, record);
+            output.append(getPayload(records, record));
+        }
+    }
+    return position;
+}
+
+uint64_t getRecordLength(std::string_view data)
+{
+    Record record;
+    if (data.empty() || !readRecordHeader(data, 0, record))
+    {
+        return 0;
+    }
+    if (record.payloadLength > UINT64_MAX - record.payloadOffset)
+    {
+        throw std::runtime_error("Malformed payload length in binary event log");
+    }
+    return record.payloadOffset + record.payloadLength;
+}
+
+size_t TextRenderer::render(std::string_view data, std::string &output)
+{
+    size_t position = 0;
+    Record record;
+    while (position < data.size() && readRecord(data, position, record))
+    {
+        sessionElapsedMilliseconds += record.elapsedMilliseconds;
+        renderRecord(record.type, record.smallValue, getPayload(data, record), output);
+        recordCount++;
+        position = getRecordEnd(record);
+    }
+    return position;
+}
+
+void TextRenderer::renderRecord(RecordType type, uint8_t smallValue, std::string_view payload, std::string &output)
+{
+    if (type == RecordType::SessionStart)
+    {
+        size_t cursor = SESSION_MAGIC.size();
+        uint64_t unixMilliseconds = 0;
+        uint64_t utcOffsetMinutes = 0;
+        if (payload.substr(0, SESSION_MAGIC.size()) != SESSION_MAGIC ||
+            !readVarint(payload, cursor, unixMilliseconds) || !readVarint(payload, cursor, utcOffsetMinutes))
+        {
+            throw std::runtime_error("Malformed session start in binary event log");
+        }
+        inSession = true;
+        sessionStartMilliseconds =
+            static_cast<int64_t>(unixMilliseconds) + zigzagDecode(utcOffsetMinutes) * 60 * 1000;
+        sessionElapsedMilliseconds = 0;
+        return;
+    }
+    if (!inSession)
+    {
+        throw std::runtime_error("Not a binary event log, it doesn't start with a session");
+    }
+
+    switch (type)
+    {
+    case RecordType::Text:
+        output.append(payload);
+        break;
+    case RecordType::Token:
+        if (smallValue >= RP::Tokens::TOKEN_COUNT)
+        {
+            throw std::runtime_error("Unknown token id " + std::to_string(smallValue) + " in binary event log");
+        }
+        output.append(RP::Tokens::TOKEN_STRINGS[smallValue]);
+        break;
+    case RecordType::WindowChange:
+    {
+        const int64_t milliseconds =
+            sessionStartMilliseconds + static_cast<int64_t>(sessionElapsedMilliseconds);
+        char timestamp[RP::Utils::MAX_LLM_READABLE_TIMESTAMP_LENGTH];
+        const size_t timestampLength = RP::Utils::formatTimestampToLLMReadable(
+            RP::Utils::getLLMReadableTimestamp(floorDivide(milliseconds, 1000)), timestamp, sizeof(timestamp));
+        output.append("\n");
+        output.append(WINDOW_CHANGE_TOKEN);
+        output.append("\"");
+        output.append(payload);
+        output.append("\" TIMESTAMP: ");
+        output.append(timestamp, timestampLength);
+        output.append(WINDOW_CHANGE_END_TOKEN);
+        output.append("\n");
+        break;
+    }
+    case RecordType::ScreenshotPath:
+        output.append(SCREENSHOT_PATH_TOKEN);
+        output.append("\"");
+        output.append(payload);
+        output.append("\"");
+        output.append(SCREENSHOT_END_TOKEN);
+        break;
+    case RecordType::ScreenshotBase64:
+        output.append(SCREENSHOT_BASE64_TOKEN);
+        output.append(payload);
+        output.append(SCREENSHOT_END_TOKEN);
+        break;
+    default:
+        break;
+    }
+}
+} // namespace RP::EventLog
@@ -1,57 +1,80 @@
 #include "timestamp_utils.h"
 
+#include <algorithm>
+#include <array>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
 #include <string>
-#include <vector>
+
+namespace
+{
+// Index 0 unused
+constexpr std::array<std::string_view, 32> ORDINAL_DAYS = {
+    "",              "first",        "second",       "third",          "fourth",        "fifth",
+    "sixth",         "seventh",      "eighth",       "ninth",          "tenth",         "eleventh",
+    "twelfth",       "thirteenth",   "fourteenth",   "fifteenth",      "sixteenth",     "seventeenth",
+    "eighteenth",    "nineteenth",   "twentieth",    "twenty-first",   "twenty-second", "twenty-third",
+    "twenty-fourth", "twenty-fifth", "twenty-sixth", "twenty-seventh", "twenty-eighth", "twenty-ninth",
+    "thirtieth",     "thirty-first"};
+
+// Month names written by std::put_time's %B in the "C" locale, index 0 unused
+constexpr std::array<std::string_view, 13> MONTH_NAMES = {
+    "",     "January", "February",  "March",   "April",    "May",     "June",
+    "July", "August",  "September", "October", "November", "December"};
+
+// Returns the index of name in names, or 0 if it isn't there
+template <size_t N> int findName(const std::array<std::string_view, N> &names, std::string_view name)
+{
+    for (size_t i = 1; i < N; i++)
+    {
+        if (names[i] == name)
+        {
+            return static_cast<int>(i);
+        }
+    }
+    return 0;
+}
+
+// Parses exactly 'digits' decimal digits, returns -1 if there aren't
+int parseDigits(std::string_view text, size_t digits)
+{
+    if (text.size() != digits)
+    {
+        return -1;
+    }
+    int value = 0;
+    for (char c : text)
+    {
+        if (c < '0' || c > '9')
+        {
+            return -1;
+        }
+        value = value * 10 + (c - '0');
+    }
+    return value;
+}
+
+// Splits off the text up to the next space, and the space
+std::string_view nextField(std::string_view &text)
+{
+    const size_t space = text.find(' ');
+    const std::string_view field = text.substr(0, space);
+    text.remove_prefix(space == std::string_view::npos ? text.size() : space + 1);
+    return field;
+}
+} // namespace
 
 namespace RP::Utils
 {
-// Replaced switch statement with a static vector lookup for conciseness
 std::string formatTimestampGetOrdinalDay(int day)
 {
     if (day < 1 || day > 31)
     {
         return ""; // Return empty string for invalid days
     }
-    // Static const vector for efficient lookup, initialized once
-    // TODO: Should we just use statically sized array or is vector same level perf wise?
-    // Maybe compiler optimizes it due to const idk
-    static const std::vector<std::string> ordinals = {"", // Index 0 unused
-                                                      "first",
-                                                      "second",
-                                                      "third",
-                                                      "fourth",
-                                                      "fifth",
-                                                      "sixth",
-                                                      "seventh",
-                                                      "eighth",
-                                                      "ninth",
-                                                      "tenth",
-                                                      "eleventh",
-                                                      "twelfth",
-                                                      "thirteenth",
-                                                      "fourteenth",
-                                                      "fifteenth",
-                                                      "sixteenth",
-                                                      "seventeenth",
-                                                      "eighteenth",
-                                                      "nineteenth",
-                                                      "twentieth",
-                                                      "twenty-first",
-                                                      "twenty-second",
-                                                      "twenty-third",
-                                                      "twenty-fourth",
-                                                      "twenty-fifth",
-                                                      "twenty-sixth",
-                                                      "twenty-seventh",
-                                                      "twenty-eighth",
-                                                      "twenty-ninth",
-                                                      "thirtieth",
-                                                      "thirty-first"};
-    return ordinals[day];
+    return std::string(ORDINAL_DAYS[day]);
 }
 
 std::string formatTimestampToLLMReadable(std::tm* time)
@@ -73,4 +96,85 @@ std::string formatTimestampToLLMReadable(std::tm* time)
     return ss.str();
 }
 
+bool parseLLMReadableTimestamp(std::string_view text, LLMReadableTimestamp &timestamp)
+{
+    // "<year> <month> <ordinal day> <HH>:<MM>", the ordinal day contains no spaces
+    timestamp.year = parseDigits(nextField(text), 4);
+    timestamp.month = findName(MONTH_NAMES, nextField(text));
+    timestamp.day = findName(ORDINAL_DAYS, nextField(text));
+    if (timestamp.year < 1000 || timestamp.month == 0 || timestamp.day == 0 || text.size() != 5 || text[2] != ':')
+    {
+        return false;
+    }
+    timestamp.hour = parseDigits(text.substr(0, 2), 2);
+    timestamp.minute = parseDigits(text.substr(3), 2);
+    return timestamp.hour >= 0 && timestamp.hour < 24 && timestamp.minute >= 0 && timestamp.minute < 60;
+}
+
+size_t formatTimestampToLLMReadable(const LLMReadableTimestamp &timestamp, char *buffer, size_t bufferSize)
+{
+    if (timestamp.year < 1000 || timestamp.year > 9999 || timestamp.month < 1 || timestamp.month > 12 ||
+        timestamp.day < 1 || timestamp.day > 31 || timestamp.hour < 0 || timestamp.hour > 23 ||
+        timestamp.minute < 0 || timestamp.minute > 59)
+    {
+        return 0;
+    }
+    const std::string_view month = MONTH_NAMES[timestamp.month];
+    const std::string_view day = ORDINAL_DAYS[timestamp.day];
+    const size_t length = 4 + 1 + month.size() + 1 + day.size() + 6;
+    if (length > bufferSize)
+    {
+        return 0;
+    }
+
+    char *out = buffer;
+    auto writeDigits = [&out](int value, int digits) {
+        for (int i = digits - 1; i >= 0; i--)
+        {
+            out[i] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+        out += digits;
+    };
+    writeDigits(timestamp.year, 4);
+    *out++ = ' ';
+    out = std::copy(month.begin(), month.end(), out);
+    *out++ = ' ';
+    out = std::copy(day.begin(), day.end(), out);
+    *out++ = ' ';
+    writeDigits(timestamp.hour, 2);
+    *out++ = ':';
+    writeDigits(timestamp.minute, 2);
+    return length;
+}
+
+LLMReadableTimestamp getLLMReadableTimestamp(int64_t secondsSinceEpoch)
+{
+    constexpr int64_t SECONDS_PER_DAY = 24 * 60 * 60;
+    int64_t days = secondsSinceEpoch / SECONDS_PER_DAY;
+    int64_t secondOfDay = secondsSinceEpoch % SECONDS_PER_DAY;
+    if (secondOfDay < 0)
+    {
+        days--;
+        secondOfDay += SECONDS_PER_DAY;
+    }
+
+    // Civil date from a day number, counted in 400 year eras of the proleptic Gregorian calendar that start on
+    // March 1st so the leap day is the last day of a year
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const int64_t dayOfEra = days - era * 146097;
+    const int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    const int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    const int64_t shiftedMonth = (5 * dayOfYear + 2) / 153;
+
+    LLMReadableTimestamp timestamp;
+    timestamp.day = static_cast<int>(dayOfYear - (153 * shiftedMonth + 2) / 5 + 1);
+    timestamp.month = static_cast<int>(shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9);
+    timestamp.year = static_cast<int>(yearOfEra + era * 400 + (timestamp.month <= 2 ? 1 : 0));
+    timestamp.hour = static_cast<int>(secondOfDay / 3600);
+    timestamp.minute = static_cast<int>(secondOfDay / 60 % 60);
+    return timestamp;
+}
+
 } // namespace RP::Utils
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include "utf8.h"
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define RP_X86_64_SIMD 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+constexpr char32_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+bool isHighSurrogate(char32_t c)
+{
+    return c >= 0xD800 && c <= 0xDBFF;
+}
+
+bool isLowSurrogate(char32_t c)
+{
+    return c >= 0xDC00 && c <= 0xDFFF;
+}
+
+char32_t toValidCodePoint(char32_t codePoint)
+{
+    return (codePoint >= 0xD800 && codePoint <= 0xDFFF) || codePoint > 0x10FFFF ? REPLACEMENT_CHARACTER : codePoint;
+}
+
+size_t getEncodedLength(char32_t codePoint)
+{
+    return codePoint < 0x80 ? 1 : codePoint < 0x800 ? 2 : codePoint < 0x10000 ? 3 : 4;
+}
+
+// codePoint must be valid
+size_t encode(char32_t codePoint, char *output)
+{
+    if (codePoint < 0x80)
+    {
+        output[0] = static_cast<char>(codePoint);
+        return 1;
+    }
+    if (codePoint < 0x800)
+    {
+        output[0] = static_cast<char>(0xC0 | (codePoint >> 6));
+        output[1] = static_cast<char>(0x80 | (codePoint & 0x3F));
+        return 2;
+    }
+    if (codePoint < 0x10000)
+    {
+        output[0] = static_cast<char>(0xE0 | (codePoint >> 12));
+        output[1] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        output[2] = static_cast<char>(0x80 | (codePoint & 0x3F));
+        return 3;
+    }
+    output[0] = static_cast<char>(0xF0 | (codePoint >> 18));
+    output[1] = static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+    output[2] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    output[3] = static_cast<char>(0x80 | (codePoint & 0x3F));
+    return 4;
+}
+
+// Reads the code point at text[i] and advances i past it
+char32_t readUtf16(std::u16string_view text, size_t &i)
+{
+    const char32_t c = text[i++];
+    if (isHighSurrogate(c) && i < text.size() && isLowSurrogate(text[i]))
+    {
+        return 0x10000 + ((c - 0xD800) << 10) + (text[i++] - 0xDC00);
+    }
+    return toValidCodePoint(c);
+}
+
+// Number of characters from i on that are ASCII, only looks at whole blocks of eight
+size_t countAsciiBlock(std::u16string_view text, size_t i)
+{
+#ifdef RP_X86_64_SIMD
+    const __m128i nonAsciiBits = _mm_set1_epi16(static_cast<short>(0xFF80));
+    const size_t start = i;
+    for (; i + 8 <= text.size(); i += 8)
+    {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text.data() + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(block, nonAsciiBits), _mm_setzero_si128())) != 0xFFFF)
+        {
+            break;
+        }
+    }
+    return i - start;
+#else
+    (void)text;
+    (void)i;
+    return 0;
+#endif
+}
+} // namespace
+
+namespace RP::Utils
+{
+size_t getUtf8Length(std::u16string_view text)
+{
+    size_t length = 0;
+    size_t i = 0;
+    while (i < text.size())
+    {
+        const size_t ascii = countAsciiBlock(text, i);
+        length += ascii;
+        i += ascii;
+        if (i < text.size())
+        {
+            length += getEncodedLength(readUtf16(text, i));
+        }
+    }
+    return length;
+}
+
+size_t convertUtf16ToUtf8(std::u16string_view text, char *output)
+{
+    char *start = output;
+    size_t i = 0;
+    while (i < text.size())
+    {
+#ifdef RP_X86_64_SIMD
+        // Narrows eight ASCII characters at once
+        const size_t ascii = countAsciiBlock(text, i);
+        for (size_t end = i + ascii; i < end; i += 8, output += 8)
+        {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text.data() + i));
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(output), _mm_packus_epi16(block, block));
+        }
+#endif
+        if (i < text.size())
+        {
+            output += encode(readUtf16(text, i), output);
+        }
+    }
+    return static_cast<size_t>(output - start);
+}
+
+size_t getUtf8Length(std::u32string_view text)
+{
+    size_t length = 0;
+    for (char32_t codePoint : text)
+    {
+        length += getEncodedLength(toValidCodePoint(codePoint));
+    }
+    return length;
+}
+
+size_t convertUtf32ToUtf8(std::u32string_view text, char *output)
+{
+    char *start = output;
+    for (char32_t codePoint : text)
+    {
+        output += encode(toValidCodePoint(codePoint), output);
+    }
+    return static_cast<size_t>(output - start);
+}
+} // namespace RP::Utils
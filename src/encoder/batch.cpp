@@ -0,0 +1,110 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <string>
+
+namespace RP::Encoder
+{
+bool matchesPattern(std::string_view name, std::string_view pattern)
+{
+    size_t n = 0;
+    size_t p = 0;
+    // Where to continue if the current attempt to match the last '*' fails
+    size_t starPattern = std::string_view::npos;
+    size_t starName = 0;
+    while (n < name.size())
+    {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n]))
+        {
+            n++;
+            p++;
+        }
+        else if (p < pattern.size() && pattern[p] == '*')
+        {
+            starPattern = p++;
+            starName = n;
+        }
+        else if (starPattern != std::string_view::npos)
+        {
+            p = starPattern + 1;
+            n = ++starName;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*')
+    {
+        p++;
+    }
+    return p == pattern.size();
+}
+
+std::filesystem::path getEncodedFilename(const std::filesystem::path& inputFilename)
+{
+    return inputFilename.parent_path() /
+           (inputFilename.stem().string() + "_encoded" + inputFilename.extension().string());
+}
+
+bool isEncodedFilename(const std::filesystem::path& filename)
+{
+    constexpr std::string_view suffix = "_encoded";
+    const std::string stem = filename.stem().string();
+    return stem.size() >= suffix.size() && stem.compare(stem.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool isUpToDate(const BatchFile& file)
+{
+    std::error_code error;
+    const auto outputTime = std::filesystem::last_write_time(file.outputFilename, error);
+    const uintmax_t outputSize = error ? 0 : std::filesystem::file_size(file.outputFilename, error);
+    if (error)
+    {
+        return false;
+    }
+    return outputTime >= std::filesystem::last_write_time(file.inputFilename) && (outputSize > 0 || file.size == 0);
+}
+
+std::vector<BatchFile> collectBatchFiles(const std::filesystem::path& input,
+                                         const std::filesystem::path& outputDirectory)
+{
+    std::filesystem::path directory = input;
+    std::string pattern = "*";
+    if (!std::filesystem::is_directory(directory))
+    {
+        directory = input.parent_path();
+        pattern = input.filename().string();
+        if (directory.empty())
+        {
+            directory = ".";
+        }
+    }
+
+    std::vector<BatchFile> files;
+    for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(directory))
+    {
+        const std::filesystem::path& path = entry.path();
+        if (!entry.is_regular_file() || !matchesPattern(path.filename().string(), pattern) || isEncodedFilename(path))
+        {
+            continue;
+        }
+
+        BatchFile file;
+        file.inputFilename = path;
+        file.outputFilename = getEncodedFilename(path);
+        if (!outputDirectory.empty())
+        {
+            file.outputFilename = outputDirectory / file.outputFilename.filename();
+        }
+        file.size = entry.file_size();
+        files.push_back(std::move(file));
+    }
+
+    // Ties are broken by name, so the order doesn't depend on the order of the directory listing
+    std::sort(files.begin(), files.end(), [](const BatchFile& a, const BatchFile& b) {
+        return a.size != b.size ? a.size > b.size : a.inputFilename < b.inputFilename;
+    });
+    return files;
+}
+} // namespace RP::Encoder
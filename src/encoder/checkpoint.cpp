@@ -0,0 +1,183 @@
+#include "checkpoint.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include "file_io.h"
+#include "utils/logging.h"
+
+namespace
+{
+// Identifies checkpoint files and their version
+constexpr std::string_view CHECKPOINT_MAGIC = "RPCHECKPOINT1";
+constexpr std::string_view JOURNAL_MAGIC = "RPJOURNAL1";
+
+// Number of bytes hashed at the start and at the end of the input
+constexpr uint64_t HASHED_BYTES = 4096;
+
+// 64-bit FNV-1a
+uint64_t hashBytes(uint64_t hash, std::string_view bytes)
+{
+    for (char c : bytes)
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+void writeInteger(std::string& data, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        data += static_cast<char>((value >> (i * 8)) & 0xFF);
+    }
+}
+
+bool readInteger(std::string_view& data, uint64_t& value)
+{
+    if (data.size() < 8)
+    {
+        return false;
+    }
+    value = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(data[i])) << (i * 8);
+    }
+    data.remove_prefix(8);
+    return true;
+}
+
+bool readString(std::string_view& data, std::string& value)
+{
+    uint64_t length = 0;
+    if (!readInteger(data, length) || length > data.size())
+    {
+        return false;
+    }
+    value.assign(data.data(), length);
+    data.remove_prefix(length);
+    return true;
+}
+} // namespace
+
+namespace RP::Encoder
+{
+std::filesystem::path getCheckpointPath(const std::filesystem::path& encodedFilename)
+{
+    std::filesystem::path path = encodedFilename;
+    path += ".checkpoint";
+    return path;
+}
+
+uint64_t hashInputPrefix(std::string_view input, uint64_t offset)
+{
+    const std::string_view prefix = input.substr(0, offset);
+    uint64_t hash = hashBytes(0xcbf29ce484222325ULL, prefix.substr(0, HASHED_BYTES));
+    if (prefix.size() > HASHED_BYTES)
+    {
+        hash = hashBytes(hash, prefix.substr(std::max(prefix.size() - HASHED_BYTES, HASHED_BYTES)));
+    }
+    return hashBytes(hash, std::string_view(reinterpret_cast<const char*>(&offset), sizeof(offset)));
+}
+
+bool loadCheckpoint(const std::filesystem::path& path, EncodeCheckpoint& checkpoint)
+{
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    const std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    std::string_view data = contents;
+    if (data.substr(0, CHECKPOINT_MAGIC.size()) != CHECKPOINT_MAGIC)
+    {
+        LOG_WARN("Ignoring checkpoint {} with unknown format", path.generic_string());
+        return false;
+    }
+    data.remove_prefix(CHECKPOINT_MAGIC.size());
+
+    uint64_t stateLength = 0;
+    if (!readInteger(data, checkpoint.inputOffset) || !readInteger(data, checkpoint.inputHash) ||
+        !readInteger(data, checkpoint.committedLength) || !readInteger(data, checkpoint.encodedLength) ||
+        !readInteger(data, stateLength) || stateLength != data.size())
+    {
+        LOG_WARN("Ignoring truncated checkpoint {}", path.generic_string());
+        return false;
+    }
+    checkpoint.encoderState.assign(data.data(), data.size());
+    return true;
+}
+
+void saveCheckpoint(const std::filesystem::path& path, const EncodeCheckpoint& checkpoint)
+{
+    std::string contents(CHECKPOINT_MAGIC);
+    writeInteger(contents, checkpoint.inputOffset);
+    writeInteger(contents, checkpoint.inputHash);
+    writeInteger(contents, checkpoint.committedLength);
+    writeInteger(contents, checkpoint.encodedLength);
+    writeInteger(contents, checkpoint.encoderState.size());
+    contents += checkpoint.encoderState;
+
+    // Write a temporary file and rename it, so an interrupted write never leaves a half written checkpoint
+    std::filesystem::path temporaryPath = path;
+    temporaryPath += ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+        file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+        if (!file)
+        {
+            throw std::runtime_error("Error writing checkpoint file: " + temporaryPath.string());
+        }
+    }
+    std::filesystem::rename(temporaryPath, path);
+}
+
+std::filesystem::path getJournalPath(const std::filesystem::path& filename)
+{
+    std::filesystem::path path = filename;
+    path += ".journal";
+    return path;
+}
+
+bool loadJournal(const std::filesystem::path& path, InPlaceJournal& journal)
+{
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    const std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    std::string_view data = contents;
+    if (data.substr(0, JOURNAL_MAGIC.size()) != JOURNAL_MAGIC)
+    {
+        throw std::runtime_error("Journal " + path.string() + " has an unknown format");
+    }
+    data.remove_prefix(JOURNAL_MAGIC.size());
+
+    if (!readInteger(data, journal.originalLength) || !readInteger(data, journal.readOffset) ||
+        !readInteger(data, journal.writeOffset) || !readString(data, journal.encoderState) ||
+        !readString(data, journal.pendingOutput) || !data.empty() || journal.readOffset > journal.originalLength)
+    {
+        throw std::runtime_error("Journal " + path.string() + " is malformed");
+    }
+    return true;
+}
+
+void saveJournal(const std::filesystem::path& path, const InPlaceJournal& journal)
+{
+    std::string contents(JOURNAL_MAGIC);
+    writeInteger(contents, journal.originalLength);
+    writeInteger(contents, journal.readOffset);
+    writeInteger(contents, journal.writeOffset);
+    writeInteger(contents, journal.encoderState.size());
+    contents += journal.encoderState;
+    writeInteger(contents, journal.pendingOutput.size());
+    contents += journal.pendingOutput;
+    writeFileDurably(path, contents);
+}
+} // namespace RP::Encoder
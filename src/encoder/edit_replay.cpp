@@ -0,0 +1,173 @@
+#include "edit_replay.h"
+#include <algorithm>
+
+namespace
+{
+using RP::Tokens::TokenId;
+
+bool isUtf8Continuation(char c)
+{
+    return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+}
+} // namespace
+
+namespace RP::Encoder
+{
+EditReplayStage::EditReplayStage(RleStreamEncoder::Sink sink, size_t outputBufferSize)
+    : output(std::move(sink), outputBufferSize)
+{
+}
+
+void EditReplayStage::feed(std::string_view chunk)
+{
+    scanner.feed(chunk, *this);
+}
+
+void EditReplayStage::finish()
+{
+    scanner.finish(*this);
+    commitText();
+    output.flush();
+}
+
+size_t EditReplayStage::getRemovedTokenCount() const
+{
+    return removedTokenCount;
+}
+
+void EditReplayStage::onText(const char* data, size_t size)
+{
+    if (recordEndToken != TokenId::Unknown)
+    {
+        output.append(data, size);
+        return;
+    }
+    // Typed text is passed on in pieces, so the editable text doesn't grow far past MAX_EDITABLE_TEXT_SIZE
+    for (size_t i = 0; i < size; i += MAX_EDITABLE_TEXT_SIZE)
+    {
+        appendText(data + i, std::min(MAX_EDITABLE_TEXT_SIZE, size - i));
+    }
+}
+
+void EditReplayStage::onToken(std::string_view content)
+{
+    const TokenId tokenId = RP::Tokens::lookupToken(content);
+
+    if (recordEndToken == TokenId::Unknown)
+    {
+        switch (tokenId)
+        {
+        case TokenId::Backspace:
+            if (eraseLastTypedUnit())
+            {
+                removedTokenCount++;
+                return;
+            }
+            break;
+        case TokenId::LeftShift:
+        case TokenId::RightShift:
+            removedTokenCount++;
+            return;
+        case TokenId::Space:
+        case TokenId::Enter:
+        case TokenId::Tab:
+            appendEditableToken(tokenId);
+            return;
+        default:
+            recordEndToken = RP::Tokens::getRecordEndToken(tokenId);
+            break;
+        }
+        commitText();
+    }
+    else if (tokenId == recordEndToken)
+    {
+        recordEndToken = TokenId::Unknown;
+    }
+
+    output.append("[", 1);
+    output.append(content.data(), content.size());
+    output.append("]", 1);
+}
+
+// The rest of the input is copied as is
+void EditReplayStage::onUnclosedToken(std::string_view content)
+{
+    commitText();
+    output.append("[", 1);
+    output.append(content.data(), content.size());
+}
+
+void EditReplayStage::appendText(const char* data, size_t size)
+{
+    // Text before the last line break can't be edited anymore
+    const size_t lineEnd = std::string_view(data, size).rfind('\n');
+    if (lineEnd != std::string_view::npos)
+    {
+        commitText();
+        output.append(data, lineEnd + 1);
+        data += lineEnd + 1;
+        size -= lineEnd + 1;
+    }
+
+    editableText.append(data, size);
+    if (editableText.size() > MAX_EDITABLE_TEXT_SIZE)
+    {
+        const bool endsInBackslash = editableText.back() == '\\';
+        commitText();
+        outputEndsInBackslash = endsInBackslash;
+    }
+}
+
+void EditReplayStage::appendEditableToken(TokenId tokenId)
+{
+    const std::string_view token = RP::Tokens::TOKEN_STRINGS[static_cast<size_t>(tokenId)];
+    editableText.append(token.data(), token.size());
+    tokenEnds.push_back(editableText.size());
+}
+
+// Removes the last character or token from the editable text, returns false if there is nothing to remove or
+// removing it would leave a '\' in front of the next token, which would escape it
+bool EditReplayStage::eraseLastTypedUnit()
+{
+    if (editableText.empty())
+    {
+        return false;
+    }
+
+    const bool isToken = !tokenEnds.empty() && tokenEnds.back() == editableText.size();
+    size_t end = editableText.size() - 1;
+    if (isToken)
+    {
+        // Tokens don't contain a '[', so the last one starts at the last '['
+        end = editableText.rfind('[');
+    }
+    else
+    {
+        // Remove a whole UTF-8 sequence, stopping at the start of the text in case it is malformed
+        while (end > 0 && isUtf8Continuation(editableText[end]))
+        {
+            end--;
+        }
+    }
+    if (end > 0 ? editableText[end - 1] == '\\' : outputEndsInBackslash)
+    {
+        return false;
+    }
+
+    editableText.resize(end);
+    if (isToken)
+    {
+        tokenEnds.pop_back();
+    }
+    return true;
+}
+
+// Writes out the editable text, backspaces after this are written as they are
+void EditReplayStage::commitText()
+{
+    output.append(editableText.data(), editableText.size());
+    editableText.clear();
+    tokenEnds.clear();
+    outputEndsInBackslash = false;
+}
+} // namespace RP::Encoder
@@ -0,0 +1,559 @@
+#include "file_io.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "utils/logging.h"
+
+namespace RP::Encoder
+{
+#ifdef _WIN32
+
+size_t getPageSize()
+{
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    return systemInfo.dwPageSize;
+}
+
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+    fileHandle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+                             FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+    {
+        fileHandle = nullptr;
+        throw std::runtime_error("Failed to open file for mapping - " + path.string() + ", error " +
+                                 std::to_string(GetLastError()));
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize))
+    {
+        CloseHandle(fileHandle);
+        throw std::runtime_error("Failed to get size of file - " + path.string() + ", error " +
+                                 std::to_string(GetLastError()));
+    }
+    size = static_cast<size_t>(fileSize.QuadPart);
+
+    // Empty files can't be mapped, they're just represented by an empty view
+    if (size == 0)
+    {
+        return;
+    }
+
+    mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mappingHandle)
+    {
+        CloseHandle(fileHandle);
+        throw std::runtime_error("Failed to create file mapping - " + path.string() + ", error " +
+                                 std::to_string(GetLastError()));
+    }
+
+    data = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (!data)
+    {
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        throw std::runtime_error("Failed to map view of file - " + path.string() + ", error " +
+                                 std::to_string(GetLastError()));
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (data)
+    {
+        UnmapViewOfFile(data);
+    }
+    if (mappingHandle)
+    {
+        CloseHandle(mappingHandle);
+    }
+    if (fileHandle)
+    {
+        CloseHandle(fileHandle);
+    }
+}
+
+BlockFileWriter::BlockFileWriter(const std::filesystem::path& path, size_t blockSize, uint64_t keepLength)
+    : block(std::make_unique<char[]>(blockSize)), blockSize(blockSize)
+{
+    fileHandle = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+                             FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+    {
+        fileHandle = nullptr;
+        throw std::runtime_error("Failed to open output file - " + path.string() + ", error " +
+                                 std::to_string(GetLastError()));
+    }
+
+    LARGE_INTEGER position;
+    position.QuadPart = static_cast<LONGLONG>(keepLength);
+    if (!SetFilePointerEx(fileHandle, position, nullptr, FILE_BEGIN) || !SetEndOfFile(fileHandle))
+    {
+        const DWORD error = GetLastError();
+        CloseHandle(fileHandle);
+        fileHandle = nullptr;
+        throw std::runtime_error("Failed to truncate output file - " + path.string() + ", error " +
+                                 std::to_string(error));
+    }
+}
+
+void BlockFileWriter::writeToFile(const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        DWORD toWrite = static_cast<DWORD>(std::min<size_t>(size, 1u << 30));
+        DWORD written = 0;
+        if (!WriteFile(fileHandle, data, toWrite, &written, nullptr))
+        {
+            throw std::runtime_error("Failed to write output file, error " + std::to_string(GetLastError()));
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+void BlockFileWriter::close()
+{
+    if (!fileHandle)
+    {
+        return;
+    }
+    writeToFile(block.get(), blockUsed);
+    blockUsed = 0;
+    HANDLE handle = fileHandle;
+    fileHandle = nullptr;
+    if (!CloseHandle(handle))
+    {
+        throw std::runtime_error("Failed to close output file, error " + std::to_string(GetLastError()));
+    }
+}
+
+InPlaceFile::InPlaceFile(const std::filesystem::path& path) : path(path)
+{
+    fileHandle = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+    {
+        fileHandle = nullptr;
+        throw std::runtime_error("Failed to open file - " + path.string() + ", error " +
+                                 std::to_string(GetLastError()));
+    }
+}
+
+InPlaceFile::~InPlaceFile()
+{
+    if (fileHandle)
+    {
+        CloseHandle(fileHandle);
+    }
+}
+
+uint64_t InPlaceFile::size() const
+{
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize))
+    {
+        throw std::runtime_error("Failed to get size of file - " + path.string() + ", error " +
+                                 std::to_string(GetLastError()));
+    }
+    return static_cast<uint64_t>(fileSize.QuadPart);
+}
+
+size_t InPlaceFile::read(uint64_t offset, char* data, size_t size)
+{
+    size_t total = 0;
+    while (total < size)
+    {
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset + total);
+        overlapped.OffsetHigh = static_cast<DWORD>((offset + total) >> 32);
+        DWORD bytesRead = 0;
+        if (!ReadFile(fileHandle, data + total, static_cast<DWORD>(std::min<size_t>(size - total, 1u << 30)),
+                      &bytesRead, &overlapped))
+        {
+            if (GetLastError() == ERROR_HANDLE_EOF)
+            {
+                break;
+            }
+            throw std::runtime_error("Failed to read file - " + path.string() + ", error " +
+                                     std::to_string(GetLastError()));
+        }
+        if (bytesRead == 0)
+        {
+            break;
+        }
+        total += bytesRead;
+    }
+    return total;
+}
+
+void InPlaceFile::write(uint64_t offset, std::string_view data)
+{
+    size_t total = 0;
+    while (total < data.size())
+    {
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset + total);
+        overlapped.OffsetHigh = static_cast<DWORD>((offset + total) >> 32);
+        DWORD written = 0;
+        if (!WriteFile(fileHandle, data.data() + total,
+                       static_cast<DWORD>(std::min<size_t>(data.size() - total, 1u << 30)), &written, &overlapped))
+        {
+            throw std::runtime_error("Failed to write file - " + path.string() + ", error " +
+                                     std::to_string(GetLastError()));
+        }
+        total += written;
+    }
+}
+
+void InPlaceFile::sync()
+{
+    if (!FlushFileBuffers(fileHandle))
+    {
+        throw std::runtime_error("Failed to flush file - " + path.string() + ", error " +
+                                 std::to_string(GetLastError()));
+    }
+}
+
+void InPlaceFile::truncate(uint64_t length)
+{
+    LARGE_INTEGER position;
+    position.QuadPart = static_cast<LONGLONG>(length);
+    if (!SetFilePointerEx(fileHandle, position, nullptr, FILE_BEGIN) || !SetEndOfFile(fileHandle))
+    {
+        throw std::runtime_error("Failed to truncate file - " + path.string() + ", error " +
+                                 std::to_string(GetLastError()));
+    }
+}
+
+void writeFileDurably(const std::filesystem::path& path, std::string_view contents)
+{
+    std::filesystem::path temporaryPath = path;
+    temporaryPath += ".tmp";
+    HANDLE handle = CreateFileW(temporaryPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                                FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        throw std::runtime_error("Failed to open file - " + temporaryPath.string() + ", error " +
+                                 std::to_string(GetLastError()));
+    }
+    DWORD written = 0;
+    const bool success = WriteFile(handle, contents.data(), static_cast<DWORD>(contents.size()), &written, nullptr) &&
+                         written == contents.size() && FlushFileBuffers(handle);
+    const DWORD error = GetLastError();
+    CloseHandle(handle);
+    if (!success)
+    {
+        throw std::runtime_error("Failed to write file - " + temporaryPath.string() + ", error " +
+                                 std::to_string(error));
+    }
+    if (!MoveFileExW(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        throw std::runtime_error("Failed to replace file - " + path.string() + ", error " +
+                                 std::to_string(GetLastError()));
+    }
+}
+
+#else
+
+size_t getPageSize()
+{
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Failed to open file for mapping - " + path.string() + ", " + std::strerror(errno));
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0)
+    {
+        int error = errno;
+        ::close(fd);
+        throw std::runtime_error("Failed to get size of file - " + path.string() + ", " + std::strerror(error));
+    }
+    size = static_cast<size_t>(fileStat.st_size);
+
+    // Empty files can't be mapped, they're just represented by an empty view
+    if (size == 0)
+    {
+        return;
+    }
+
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED)
+    {
+        int error = errno;
+        ::close(fd);
+        throw std::runtime_error("Failed to map file - " + path.string() + ", " + std::strerror(error));
+    }
+    data = static_cast<const char*>(mapping);
+
+    // The encoder reads the recording front to back exactly once
+    if (madvise(mapping, size, MADV_SEQUENTIAL) != 0)
+    {
+        LOG_CLASS_WARN("MappedFile", "madvise failed: {}", std::strerror(errno));
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (data)
+    {
+        munmap(const_cast<char*>(data), size);
+    }
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+}
+
+BlockFileWriter::BlockFileWriter(const std::filesystem::path& path, size_t blockSize, uint64_t keepLength)
+    : block(std::make_unique<char[]>(blockSize)), blockSize(blockSize)
+{
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | (keepLength == 0 ? O_TRUNC : 0), 0644);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Failed to open output file - " + path.string() + ", " + std::strerror(errno));
+    }
+
+    if (keepLength > 0 && (ftruncate(fd, static_cast<off_t>(keepLength)) != 0 ||
+                           lseek(fd, static_cast<off_t>(keepLength), SEEK_SET) < 0))
+    {
+        int error = errno;
+        ::close(fd);
+        fd = -1;
+        throw std::runtime_error("Failed to truncate output file - " + path.string() + ", " + std::strerror(error));
+    }
+}
+
+void BlockFileWriter::writeToFile(const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::runtime_error(std::string("Failed to write output file, ") + std::strerror(errno));
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+void BlockFileWriter::close()
+{
+    if (fd < 0)
+    {
+        return;
+    }
+    writeToFile(block.get(), blockUsed);
+    blockUsed = 0;
+    int handle = fd;
+    fd = -1;
+    if (::close(handle) != 0)
+    {
+        throw std::runtime_error(std::string("Failed to close output file, ") + std::strerror(errno));
+    }
+}
+
+// Writes all of data to fd at offset, or at the current position if offset is negative
+static void writeAll(int fd, const char* data, size_t size, off_t offset, const std::filesystem::path& path)
+{
+    while (size > 0)
+    {
+        const ssize_t written = offset < 0 ? ::write(fd, data, size) : pwrite(fd, data, size, offset);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::runtime_error("Failed to write file - " + path.string() + ", " + std::strerror(errno));
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+        offset = offset < 0 ? offset : offset + written;
+    }
+}
+
+InPlaceFile::InPlaceFile(const std::filesystem::path& path) : path(path)
+{
+    fd = open(path.c_str(), O_RDWR);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Failed to open file - " + path.string() + ", " + std::strerror(errno));
+    }
+}
+
+InPlaceFile::~InPlaceFile()
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+}
+
+uint64_t InPlaceFile::size() const
+{
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0)
+    {
+        throw std::runtime_error("Failed to get size of file - " + path.string() + ", " + std::strerror(errno));
+    }
+    return static_cast<uint64_t>(fileStat.st_size);
+}
+
+size_t InPlaceFile::read(uint64_t offset, char* data, size_t size)
+{
+    size_t total = 0;
+    while (total < size)
+    {
+        const ssize_t bytesRead = pread(fd, data + total, size - total, static_cast<off_t>(offset + total));
+        if (bytesRead < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::runtime_error("Failed to read file - " + path.string() + ", " + std::strerror(errno));
+        }
+        if (bytesRead == 0)
+        {
+            break;
+        }
+        total += static_cast<size_t>(bytesRead);
+    }
+    return total;
+}
+
+void InPlaceFile::write(uint64_t offset, std::string_view data)
+{
+    writeAll(fd, data.data(), data.size(), static_cast<off_t>(offset), path);
+}
+
+void InPlaceFile::sync()
+{
+    if (fsync(fd) != 0)
+    {
+        throw std::runtime_error("Failed to flush file - " + path.string() + ", " + std::strerror(errno));
+    }
+}
+
+void InPlaceFile::truncate(uint64_t length)
+{
+    if (ftruncate(fd, static_cast<off_t>(length)) != 0)
+    {
+        throw std::runtime_error("Failed to truncate file - " + path.string() + ", " + std::strerror(errno));
+    }
+}
+
+void writeFileDurably(const std::filesystem::path& path, std::string_view contents)
+{
+    std::filesystem::path temporaryPath = path;
+    temporaryPath += ".tmp";
+    const int fd = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Failed to open file - " + temporaryPath.string() + ", " + std::strerror(errno));
+    }
+    try
+    {
+        writeAll(fd, contents.data(), contents.size(), -1, temporaryPath);
+    }
+    catch (...)
+    {
+        ::close(fd);
+        throw;
+    }
+    const bool synced = fsync(fd) == 0;
+    const int error = errno;
+    ::close(fd);
+    if (!synced)
+    {
+        throw std::runtime_error("Failed to flush file - " + temporaryPath.string() + ", " + std::strerror(error));
+    }
+    if (rename(temporaryPath.c_str(), path.c_str()) != 0)
+    {
+        throw std::runtime_error("Failed to replace file - " + path.string() + ", " + std::strerror(errno));
+    }
+
+    // The rename is only on disk once the directory is
+    const std::filesystem::path directory = path.has_parent_path() ? path.parent_path() : ".";
+    const int directoryFd = open(directory.c_str(), O_RDONLY);
+    if (directoryFd < 0 || fsync(directoryFd) != 0)
+    {
+        LOG_WARN("Failed to flush directory {}: {}", directory.generic_string(), std::strerror(errno));
+    }
+    if (directoryFd >= 0)
+    {
+        ::close(directoryFd);
+    }
+}
+
+#endif
+
+std::string_view MappedFile::view() const
+{
+    return std::string_view(data, size);
+}
+
+BlockFileWriter::~BlockFileWriter()
+{
+    try
+    {
+        close();
+    }
+    catch (const std::runtime_error& e)
+    {
+        LOG_CLASS_ERROR("BlockFileWriter", "{}", e.what());
+    }
+}
+
+void BlockFileWriter::write(std::string_view data)
+{
+    // Top up the current block first
+    size_t toCopy = std::min(data.size(), blockSize - blockUsed);
+    std::memcpy(block.get() + blockUsed, data.data(), toCopy);
+    blockUsed += toCopy;
+    data.remove_prefix(toCopy);
+    if (blockUsed < blockSize)
+    {
+        return;
+    }
+
+    writeToFile(block.get(), blockUsed);
+    blockUsed = 0;
+
+    // Whole blocks are written straight from the caller's buffer, the rest is kept for the next block
+    size_t wholeBlocks = data.size() - data.size() % blockSize;
+    writeToFile(data.data(), wholeBlocks);
+    data.remove_prefix(wholeBlocks);
+
+    std::memcpy(block.get(), data.data(), data.size());
+    blockUsed = data.size();
+}
+} // namespace RP::Encoder
@@ -0,0 +1,132 @@
+#include "in_place.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include "utils/logging.h"
+
+namespace RP::Encoder
+{
+InPlaceEncoder::InPlaceEncoder(const std::filesystem::path& path, size_t windowSize)
+    : file(path), journalPath(getJournalPath(path)), windowSize(std::max<size_t>(windowSize, 1)),
+      window(std::make_unique<char[]>(this->windowSize)),
+      encoder([this](std::string_view encoded) { pending.append(encoded); })
+{
+    InPlaceJournal journal;
+    if (!loadJournal(journalPath, journal))
+    {
+        originalLength = file.size();
+        return;
+    }
+
+    // Until the whole input was read, the file keeps its original length and the output stays behind the input
+    const bool finished = journal.readOffset == journal.originalLength;
+    if (!finished && (file.size() != journal.originalLength || journal.writeOffset > journal.readOffset))
+    {
+        throw std::runtime_error("Journal " + journalPath.string() + " doesn't match " + path.string());
+    }
+    if (!finished)
+    {
+        encoder.restoreState(journal.encoderState);
+    }
+    originalLength = journal.originalLength;
+    readOffset = journal.readOffset;
+    writeOffset = journal.writeOffset;
+    journaledReadOffset = journal.readOffset;
+    resumedFrom = journal.readOffset;
+    pending = std::move(journal.pendingOutput);
+    LOG_INFO("Continuing to encode {} in place from input offset {}", path.generic_string(), readOffset);
+}
+
+bool InPlaceEncoder::encodeWindow()
+{
+    if (readOffset == originalLength)
+    {
+        return false;
+    }
+
+    const size_t size =
+        file.read(readOffset, window.get(), std::min<uint64_t>(windowSize, originalLength - readOffset));
+    if (size == 0)
+    {
+        throw std::runtime_error("File got shorter while encoding it in place");
+    }
+    encoder.feed(std::string_view(window.get(), size));
+    readOffset += size;
+    if (readOffset == originalLength)
+    {
+        encoder.finish();
+    }
+    commit();
+    return readOffset < originalLength;
+}
+
+void InPlaceEncoder::finish()
+{
+    while (encodeWindow())
+    {
+    }
+    // A journal written after the last window may still hold output
+    if (!pending.empty())
+    {
+        commit();
+    }
+
+    file.truncate(writeOffset);
+    file.sync();
+    std::filesystem::remove(journalPath);
+}
+
+uint64_t InPlaceEncoder::getOriginalLength() const
+{
+    return originalLength;
+}
+
+uint64_t InPlaceEncoder::getEncodedLength() const
+{
+    return writeOffset + pending.size();
+}
+
+uint64_t InPlaceEncoder::getResumedFrom() const
+{
+    return resumedFrom;
+}
+
+void InPlaceEncoder::commit()
+{
+    InPlaceJournal journal;
+    journal.originalLength = originalLength;
+    journal.readOffset = readOffset;
+    // Saving the state hands the buffered output to pending
+    const bool finished = readOffset == originalLength;
+    if (!finished)
+    {
+        journal.encoderState = encoder.saveState();
+    }
+
+    if (writeOffset + pending.size() <= journaledReadOffset)
+    {
+        // Only input the journal on disk counts as read is overwritten, so the output goes first
+        file.write(writeOffset, pending);
+        file.sync();
+        writeOffset += pending.size();
+        pending.clear();
+        journal.writeOffset = writeOffset;
+        saveJournal(journalPath, journal);
+    }
+    else
+    {
+        // The output overwrites input that the journal on disk still needs, so a journal holding the output goes
+        // first. The output never gets ahead of the unread input, unless all of it was read.
+        journal.writeOffset = writeOffset;
+        journal.pendingOutput = pending;
+        saveJournal(journalPath, journal);
+        const size_t writable =
+            finished ? pending.size() : std::min<uint64_t>(pending.size(), readOffset - writeOffset);
+        file.write(writeOffset, std::string_view(pending).substr(0, writable));
+        file.sync();
+        writeOffset += writable;
+        pending.erase(0, writable);
+    }
+    journaledReadOffset = readOffset;
+}
+} // namespace RP::Encoder
@@ -0,0 +1,79 @@
+#include "incremental.h"
+
+#include <stdexcept>
+#include <system_error>
+#include "checkpoint.h"
+#include "encoder.h"
+#include "utils/logging.h"
+
+namespace
+{
+// Returns whether the checkpoint left by the last incremental run still describes the input and the encoded file
+bool canResume(std::string_view input, const std::filesystem::path& encodedFilename,
+               const RP::Encoder::EncodeCheckpoint& checkpoint)
+{
+    std::error_code error;
+    const uintmax_t encodedLength = std::filesystem::file_size(encodedFilename, error);
+    if (error || encodedLength != checkpoint.encodedLength || checkpoint.committedLength > encodedLength)
+    {
+        LOG_INFO("Encoded file changed since the last incremental run, encoding from the start");
+        return false;
+    }
+    if (checkpoint.inputOffset > input.size() ||
+        RP::Encoder::hashInputPrefix(input, checkpoint.inputOffset) != checkpoint.inputHash)
+    {
+        LOG_INFO("Input was replaced since the last incremental run, encoding from the start");
+        return false;
+    }
+
+    try
+    {
+        RP::Encoder::RleStreamEncoder encoder(nullptr);
+        encoder.restoreState(checkpoint.encoderState);
+    }
+    catch (const std::runtime_error& e)
+    {
+        LOG_WARN("Ignoring checkpoint: {}", e.what());
+        return false;
+    }
+    return true;
+}
+} // namespace
+
+namespace RP::Encoder
+{
+IncrementalEncodeResult encodeIncrementally(std::string_view input, const std::filesystem::path& encodedFilename,
+                                            size_t blockSize)
+{
+    IncrementalEncodeResult result;
+    const std::filesystem::path checkpointPath = getCheckpointPath(encodedFilename);
+    EncodeCheckpoint checkpoint;
+    const bool resume = loadCheckpoint(checkpointPath, checkpoint) && canResume(input, encodedFilename, checkpoint);
+    const uint64_t keepLength = resume ? checkpoint.committedLength : 0;
+
+    BlockFileWriter outputFile(encodedFilename, blockSize, keepLength);
+    RleStreamEncoder encoder([&](std::string_view encoded) {
+        outputFile.write(encoded);
+        result.encodedLength += encoded.size();
+    });
+    if (resume)
+    {
+        encoder.restoreState(checkpoint.encoderState);
+        result.resumedFrom = checkpoint.inputOffset;
+    }
+    encoder.feed(input.substr(result.resumedFrom));
+
+    // Everything written so far is final, what finish() writes is replaced by the next run
+    EncodeCheckpoint nextCheckpoint;
+    nextCheckpoint.encoderState = encoder.saveState();
+    nextCheckpoint.committedLength = keepLength + result.encodedLength;
+    encoder.finish();
+
+    outputFile.close();
+    nextCheckpoint.inputOffset = input.size();
+    nextCheckpoint.inputHash = hashInputPrefix(input, input.size());
+    nextCheckpoint.encodedLength = keepLength + result.encodedLength;
+    saveCheckpoint(checkpointPath, nextCheckpoint);
+    return result;
+}
+} // namespace RP::Encoder
@@ -1,79 +1,876 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
 #include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <vector>
 
+#include "encoder/batch.h"
+#include "encoder/pipeline.h"
 #include "encoder/encoder.h"
+#include "encoder/file_io.h"
+#include "encoder/in_place.h"
+#include "encoder/incremental.h"
 #include "utils/logging.h"
+#include "utils/special_tokens.h"
 
-int main(int argc, char *argv[])
+// Size of the chunks the input file is read and encoded in
+constexpr size_t INPUT_CHUNK_SIZE = 1024 * 1024;
+
+using Clock = std::chrono::steady_clock;
+
+struct EncoderOptions
 {
-    // Initialize logging
-    RP::Logging::initLogging(spdlog::level::info);
+    std::filesystem::path inputFilename;
+    std::filesystem::path outputFilename;
 
-    // Validate command-line arguments.
-    if (argc < 2 || argc > 3)
+    // Map the input file into memory instead of reading it in chunks
+    bool useMmap = false;
+
+    // Number of threads to encode with, more than one implies useMmap
+    unsigned threadCount = 1;
+
+    // Directory base64 screenshots are written to, empty to keep them in the encoded output
+    std::filesystem::path screenshotDirectory;
+
+    // Decode the encoded file afterwards and check that it matches the input
+    bool verify = false;
+
+    // Encoder passes the input runs through in order, see RP::Encoder::getAvailablePasses()
+    std::vector<std::string> passes = {"rle"};
+
+    // Special tokens to remove, implies the filter pass
+    RP::Encoder::TokenSet removedTokens;
+
+    // Largest gap between window changes that are collapsed, negative to leave them alone. Implies the storms pass.
+    int maxStormGapMinutes = -1;
+
+    // Only encode what was appended to the input since the last incremental run, see EncodeCheckpoint
+    bool incremental = false;
+
+    // Encode the input file over itself, see RP::Encoder::InPlaceEncoder. outputFilename is the input file.
+    bool inPlace = false;
+
+    // Encode every file in a directory or matching a pattern, inputFilename is the directory or pattern. Files are
+    // encoded on threadCount threads, one file per thread.
+    bool batchMode = false;
+    // Directory the encoded files are written to in batch mode, empty to write them next to the inputs
+    std::filesystem::path batchOutputDirectory;
+};
+
+// Collected while encoding a file, used for the summary
+struct EncodeStats
+{
+    size_t originalLength = 0;
+    size_t encodedLength = 0;
+    size_t extractedScreenshots = 0;
+    // Bytes and time of each encoder pass, empty if the input wasn't encoded by a pipeline
+    std::vector<RP::Encoder::PassStats> passStats;
+    // Input offset an incremental or interrupted in-place encode continued from
+    size_t resumedFrom = 0;
+
+    // Time spent reading the input and writing the output
+    Clock::duration ioTime{};
+    // Time spent encoding. With --mmap this includes the page faults that read the input.
+    Clock::duration encodeTime{};
+    // Time spent decoding and comparing with --verify
+    Clock::duration verifyTime{};
+};
+
+static void printUsage(const char *programPath)
+{
+    std::filesystem::path encPath(programPath);
+
+    std::cerr << "Usage: \n"
+              << encPath.stem().generic_string() << " <input_file> [output_file] [option]...\n"
+              << encPath.stem().generic_string()
+              << " --batch <input_directory|pattern> [output_directory] [option]...\n\n"
+              << "Options:\n"
+              << "\t--batch\t\t Encode all files in a directory or matching a pattern like 'logs/*.txt', skipping\n"
+              << "\t\t\t files whose encoded output is up to date. --threads sets the number of files encoded\n"
+              << "\t\t\t at once (default: one per core).\n"
+              << "\t--mmap\t\t Map the input file into memory instead of reading it in chunks.\n"
+              << "\t--threads <n>\t Encode on n threads (implies --mmap).\n"
+              << "\t--extract-screenshots <dir>\t Write base64 screenshots to files in dir and reference them by\n"
+              << "\t\t\t\t path in the encoded output (disables --threads).\n"
+              << "\t--verify\t Decode the encoded file and check that it matches the input.\n"
+              << "\t--passes <list>\t Comma separated encoder passes to run in order (default: rle). Anything\n"
+              << "\t\t\t other than the default disables --threads and --incremental. Passes:\n";
+    for (const RP::Encoder::PassInfo &pass : RP::Encoder::getAvailablePasses())
     {
-        std::filesystem::path encPath(argv[0]);
+        std::cerr << "\t\t\t   " << pass.name << " - " << pass.description << (pass.createDecoder ? "" : " (lossy)")
+                  << "\n";
+    }
+    std::cerr << "\t--replay-edits\t Same as putting 'edits' first in --passes.\n"
+              << "\t--remove-special\t Remove all special tokens. Removing a '[CHANGE_WINDOW]' or '[SCREENSHOT_*]'\n"
+              << "\t\t\t token removes its whole record.\n"
+              << "\t--remove-tokens <list>\t Remove the special tokens in a comma separated list of names\n"
+              << "\t\t\t\t like 'LSHIFT,SCREENSHOT_BASE64'.\n"
+              << "\t--keep-tokens <list>\t Remove all special tokens except the ones in the list.\n"
+              << "\t--collapse-storms <minutes>\t Keep only the last of a burst of window changes that are at most\n"
+              << "\t\t\t\t this many minutes apart, with nothing but window switching keys in between.\n"
+              << "\t--incremental\t Only encode what was appended to the input since the last --incremental run\n"
+              << "\t\t\t and append it to the encoded file (implies --mmap, disables --threads).\n"
+              << "\t--in-place\t Replace the input file with its encoded output, without needing space for a copy\n"
+              << "\t\t\t (disables --threads). An interrupted run continues from the journal kept next to the\n"
+              << "\t\t\t file when run again.\n";
+}
 
-        std::cerr << "Usage: \n"
-                  << encPath.stem().generic_string() << " <input_file> [output_file] [option]...\n\n"
-                  << "Options:\n"
-                  << "\t--remove-special\t Removes special tokens.\n";
-        return 1;
+// Splits a comma separated list of pass names, returns false if one of them is unknown
+static bool parsePassList(std::string_view list, std::vector<std::string> &passes)
+{
+    passes.clear();
+    while (!list.empty())
+    {
+        const size_t comma = std::min(list.find(','), list.size());
+        const std::string_view name = list.substr(0, comma);
+        if (!RP::Encoder::findPass(name))
+        {
+            std::cerr << "Unknown encoder pass: " << name << "\n";
+            return false;
+        }
+        passes.emplace_back(name);
+        list.remove_prefix(std::min(comma + 1, list.size()));
     }
-    const std::string inputFilename = argv[1];
-    std::filesystem::path outputFilename;
-    if (argc >= 3)
+    return !passes.empty();
+}
+
+// Parses a comma separated list of special token names without brackets, returns false if one of them is unknown
+static bool parseTokenList(std::string_view list, RP::Encoder::TokenSet &tokens)
+{
+    tokens.reset();
+    while (!list.empty())
+    {
+        const size_t comma = std::min(list.find(','), list.size());
+        const std::string_view name = list.substr(0, comma);
+        const RP::Tokens::TokenId tokenId = RP::Tokens::lookupToken(name);
+        if (tokenId == RP::Tokens::TokenId::Unknown)
+        {
+            std::cerr << "Unknown special token: " << name << "\n";
+            return false;
+        }
+        tokens.set(static_cast<size_t>(tokenId));
+        list.remove_prefix(std::min(comma + 1, list.size()));
+    }
+    return tokens.any();
+}
+
+static bool usesDefaultPasses(const EncoderOptions &options)
+{
+    return options.passes.size() == 1 && options.passes[0] == "rle";
+}
+
+// Returns false if the arguments are invalid
+static bool parseArguments(int argc, char *argv[], EncoderOptions &options)
+{
+    std::vector<std::string_view> positional;
+    bool threadCountGiven = false;
+    bool replayEdits = false;
+    int tokenFilterOptions = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string_view arg = argv[i];
+        if (arg == "--mmap")
+        {
+            options.useMmap = true;
+        }
+        else if (arg == "--threads")
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Missing value for --threads\n";
+                return false;
+            }
+            const int threadCount = std::atoi(argv[++i]);
+            if (threadCount < 1)
+            {
+                std::cerr << "Invalid value for --threads: " << argv[i] << "\n";
+                return false;
+            }
+            options.threadCount = static_cast<unsigned>(threadCount);
+            options.useMmap = true;
+            threadCountGiven = true;
+        }
+        else if (arg == "--batch")
+        {
+            options.batchMode = true;
+        }
+        else if (arg == "--verify")
+        {
+            options.verify = true;
+        }
+        else if (arg == "--passes")
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Missing value for --passes\n";
+                return false;
+            }
+            if (!parsePassList(argv[++i], options.passes))
+            {
+                std::cerr << "Invalid value for --passes: " << argv[i] << "\n";
+                return false;
+            }
+        }
+        else if (arg == "--replay-edits")
+        {
+            replayEdits = true;
+        }
+        else if (arg == "--remove-special")
+        {
+            options.removedTokens.set();
+            tokenFilterOptions++;
+        }
+        else if (arg == "--remove-tokens" || arg == "--keep-tokens")
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Missing value for " << arg << "\n";
+                return false;
+            }
+            if (!parseTokenList(argv[++i], options.removedTokens))
+            {
+                std::cerr << "Invalid value for " << arg << ": " << argv[i] << "\n";
+                return false;
+            }
+            if (arg == "--keep-tokens")
+            {
+                options.removedTokens.flip();
+            }
+            tokenFilterOptions++;
+        }
+        else if (arg == "--collapse-storms")
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Missing value for --collapse-storms\n";
+                return false;
+            }
+            const std::string_view value = argv[++i];
+            int minutes = -1;
+            const auto result = std::from_chars(value.data(), value.data() + value.size(), minutes);
+            if (result.ec != std::errc() || result.ptr != value.data() + value.size() || minutes < 0)
+            {
+                std::cerr << "Invalid value for --collapse-storms: " << value << "\n";
+                return false;
+            }
+            options.maxStormGapMinutes = minutes;
+        }
+        else if (arg == "--incremental")
+        {
+            options.incremental = true;
+            options.useMmap = true;
+        }
+        else if (arg == "--in-place")
+        {
+            options.inPlace = true;
+        }
+        else if (arg == "--extract-screenshots")
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Missing value for --extract-screenshots\n";
+                return false;
+            }
+            options.screenshotDirectory = argv[++i];
+        }
+        else if (arg.substr(0, 2) == "--")
+        {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return false;
+        }
+        else
+        {
+            positional.push_back(arg);
+        }
+    }
+
+    if (positional.empty() || positional.size() > 2)
+    {
+        return false;
+    }
+    if (options.verify && !options.screenshotDirectory.empty())
+    {
+        std::cerr << "--verify can't be combined with --extract-screenshots\n";
+        return false;
+    }
+    if (options.incremental && !options.screenshotDirectory.empty())
+    {
+        std::cerr << "--incremental can't be combined with --extract-screenshots\n";
+        return false;
+    }
+
+    if (options.inPlace && (options.batchMode || options.incremental || options.verify ||
+                            !options.screenshotDirectory.empty() || positional.size() > 1))
+    {
+        // The input is gone once it was encoded, and the journal only holds the state of the encoder
+        std::cerr << "--in-place takes no output file and can't be combined with --batch, --incremental, --verify "
+                     "or --extract-screenshots\n";
+        return false;
+    }
+
+    if (tokenFilterOptions > 1)
     {
-        outputFilename = argv[2];
+        std::cerr << "Only one of --remove-special, --remove-tokens and --keep-tokens can be given\n";
+        return false;
+    }
+    if (replayEdits && std::find(options.passes.begin(), options.passes.end(), "edits") == options.passes.end())
+    {
+        options.passes.insert(options.passes.begin(), "edits");
+    }
+    if (options.maxStormGapMinutes >= 0 &&
+        std::find(options.passes.begin(), options.passes.end(), "storms") == options.passes.end())
+    {
+        // The storms pass needs the full timestamps, so it goes in front of the timestamps pass
+        options.passes.insert(options.passes.begin(), "storms");
+    }
+    if (options.removedTokens.any() &&
+        std::find(options.passes.begin(), options.passes.end(), "filter") == options.passes.end())
+    {
+        // The filter sees tokens before the rle pass adds counts to them
+        options.passes.insert(std::find(options.passes.begin(), options.passes.end(), "rle"), "filter");
+    }
+    if (options.verify && std::any_of(options.passes.begin(), options.passes.end(), [](const std::string &name) {
+            return !RP::Encoder::findPass(name)->createDecoder;
+        }))
+    {
+        std::cerr << "--verify can't be combined with lossy encoder passes\n";
+        return false;
+    }
+    if (options.incremental && !usesDefaultPasses(options))
+    {
+        // The checkpoint holds the state of a single encoder
+        std::cerr << "--incremental only supports the default encoder passes\n";
+        return false;
+    }
+    if (options.inPlace && !usesDefaultPasses(options))
+    {
+        // Only the rle pass never makes its output longer than its input
+        std::cerr << "--in-place only supports the default encoder passes\n";
+        return false;
+    }
+    if (!options.screenshotDirectory.empty() &&
+        std::find(options.passes.begin(), options.passes.end(), "rle") == options.passes.end())
+    {
+        std::cerr << "--extract-screenshots needs the rle pass\n";
+        return false;
+    }
+
+    options.inputFilename = positional[0];
+    if (options.batchMode)
+    {
+        if (positional.size() == 2)
+        {
+            options.batchOutputDirectory = positional[1];
+        }
+        if (!threadCountGiven)
+        {
+            options.threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+    }
+    else if (positional.size() == 2)
+    {
+        options.outputFilename = positional[1];
+    }
+    else if (options.inPlace)
+    {
+        options.outputFilename = options.inputFilename;
     }
     else
     {
         // Derive output file path if one not provided
-        std::filesystem::path inPath(inputFilename);
-        outputFilename = inPath.parent_path() / (inPath.stem().string() + "_encoded" + inPath.extension().string());
+        options.outputFilename = RP::Encoder::getEncodedFilename(options.inputFilename);
     }
+    return true;
+}
+
+// Returns a payload sink that writes every screenshot payload to its own file in the screenshot directory. The
+// payload is replaced by the quoted path of that file.
+static RP::Encoder::RleStreamEncoder::PayloadSink makeScreenshotExtractor(const EncoderOptions &options,
+                                                                          EncodeStats &stats)
+{
+    std::filesystem::create_directories(options.screenshotDirectory);
+    auto screenshotFile = std::make_shared<std::ofstream>();
+
+    return [&options, &stats, screenshotFile](std::string_view piece, bool endOfPayload) -> std::string {
+        const std::filesystem::path screenshotPath =
+            options.screenshotDirectory / ("screenshot_" + std::to_string(stats.extractedScreenshots) + ".b64");
+        if (!screenshotFile->is_open())
+        {
+            screenshotFile->open(screenshotPath, std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!screenshotFile->is_open())
+            {
+                throw std::runtime_error("Error opening screenshot file: " + screenshotPath.string());
+            }
+        }
+        screenshotFile->write(piece.data(), static_cast<std::streamsize>(piece.size()));
+        if (!*screenshotFile)
+        {
+            throw std::runtime_error("Error writing screenshot file: " + screenshotPath.string());
+        }
+        if (!endOfPayload)
+        {
+            return {};
+        }
 
-    // Load input file as a string.
-    std::ifstream inputFile(inputFilename);
+        screenshotFile->close();
+        stats.extractedScreenshots++;
+        return "\"" + screenshotPath.generic_string() + "\"";
+    };
+}
+
+// Reads the input in fixed size chunks, so memory use doesn't depend on the size of the recording
+static void encodeChunked(const EncoderOptions &options, RP::Encoder::EncoderPipeline &pipeline, EncodeStats &stats)
+{
+    std::ifstream inputFile(options.inputFilename, std::ios::in | std::ios::binary);
     if (!inputFile.is_open())
     {
-        LOG_ERROR("Error opening input file: {}", inputFilename);
+        throw std::runtime_error("Error opening input file: " + options.inputFilename.string());
+    }
+
+    std::vector<char> chunk(INPUT_CHUNK_SIZE);
+    while (inputFile)
+    {
+        const Clock::time_point readStart = Clock::now();
+        inputFile.read(chunk.data(), chunk.size());
+        const size_t bytesRead = static_cast<size_t>(inputFile.gcount());
+        stats.ioTime += Clock::now() - readStart;
+
+        const Clock::time_point encodeStart = Clock::now();
+        pipeline.feed(std::string_view(chunk.data(), bytesRead));
+        stats.encodeTime += Clock::now() - encodeStart;
+        stats.originalLength += bytesRead;
+    }
+    if (inputFile.bad())
+    {
+        throw std::runtime_error("Error reading input file: " + options.inputFilename.string());
+    }
+}
+
+// Encodes the recording straight from a memory mapping, without copying it
+static void encodeMapped(const EncoderOptions &options, RP::Encoder::EncoderPipeline &pipeline, EncodeStats &stats)
+{
+    const Clock::time_point mapStart = Clock::now();
+    RP::Encoder::MappedFile inputFile(options.inputFilename);
+    stats.ioTime += Clock::now() - mapStart;
+
+    const Clock::time_point encodeStart = Clock::now();
+    pipeline.feed(inputFile.view());
+    stats.encodeTime += Clock::now() - encodeStart;
+    stats.originalLength += inputFile.view().size();
+}
+
+// Encodes the memory mapped recording on multiple threads, output is written in order on this thread
+static void encodeParallel(const EncoderOptions &options, const RP::Encoder::RleStreamEncoder::Sink &sink,
+                           EncodeStats &stats)
+{
+    const Clock::time_point mapStart = Clock::now();
+    RP::Encoder::MappedFile inputFile(options.inputFilename);
+    stats.ioTime += Clock::now() - mapStart;
+
+    const Clock::time_point encodeStart = Clock::now();
+    RP::Encoder::rleParallel(inputFile.view(), options.threadCount, sink);
+    stats.encodeTime += Clock::now() - encodeStart;
+    stats.originalLength += inputFile.view().size();
+}
+
+// Thrown out of a decoder by the sink that compares its output with the input
+struct DecodedOutputDiffers
+{
+    size_t offset;
+};
+
+// Decodes the encoded file and compares it with the input as it is decoded. Returns the offset of the first byte
+// that differs, or std::string_view::npos if the decoded file is identical to the input.
+static size_t verifyEncoding(const EncoderOptions &options)
+{
+    RP::Encoder::MappedFile inputFile(options.inputFilename);
+    RP::Encoder::MappedFile encodedFile(options.outputFilename);
+    const std::string_view original = inputFile.view();
+
+    // Decoding stops at the first difference, so corrupt output that decodes to far more than the input doesn't
+    // have to be decoded in full
+    size_t offset = 0;
+    const RP::Encoder::RleStreamEncoder::Sink compare = [&](std::string_view decoded) {
+        const std::string_view expected = original.substr(offset, decoded.size());
+        if (expected != decoded)
+        {
+            const auto difference = std::mismatch(expected.begin(), expected.end(), decoded.begin());
+            throw DecodedOutputDiffers{offset + static_cast<size_t>(difference.first - expected.begin())};
+        }
+        offset += decoded.size();
+    };
+
+    // Undo the passes in reverse order. Each decoder feeds the one of the pass before it and the first one feeds the
+    // comparison, so no pass is decoded into memory as a whole.
+    std::vector<std::unique_ptr<RP::Encoder::EncoderPass>> decoders(options.passes.size());
+    for (size_t i = 0; i < options.passes.size(); i++)
+    {
+        RP::Encoder::RleStreamEncoder::Sink sink = compare;
+        if (i > 0)
+        {
+            sink = [&decoders, i](std::string_view decoded) { decoders[i - 1]->feed(decoded); };
+        }
+        decoders[i] = RP::Encoder::findPass(options.passes[i])->createDecoder(std::move(sink));
+    }
+
+    try
+    {
+        const std::string_view encoded = encodedFile.view();
+        for (size_t i = 0; i < encoded.size(); i += INPUT_CHUNK_SIZE)
+        {
+            decoders.back()->feed(encoded.substr(i, INPUT_CHUNK_SIZE));
+        }
+        for (size_t i = decoders.size(); i-- > 0;)
+        {
+            decoders[i]->finish();
+        }
+    }
+    catch (const DecodedOutputDiffers &difference)
+    {
+        return difference.offset;
+    }
+
+    return offset == original.size() ? std::string_view::npos : offset;
+}
+
+static void verifyIfRequested(const EncoderOptions &options, EncodeStats &stats)
+{
+    if (!options.verify)
+    {
+        return;
+    }
+
+    const Clock::time_point verifyStart = Clock::now();
+    const size_t mismatch = verifyEncoding(options);
+    stats.verifyTime = Clock::now() - verifyStart;
+    if (mismatch != std::string_view::npos)
+    {
+        throw std::runtime_error("Verification failed: decoded output of " + options.inputFilename.string() +
+                                 " differs from the input at byte " + std::to_string(mismatch));
+    }
+}
+
+// Encodes the input after the offset stored in the checkpoint of the last run and appends it to the encoded file.
+// Writing the output and the checkpoint happens in the encoder, so it counts as encode time.
+static void encodeIncremental(const EncoderOptions &options, size_t blockSize, EncodeStats &stats)
+{
+    const Clock::time_point mapStart = Clock::now();
+    RP::Encoder::MappedFile inputFile(options.inputFilename);
+    const std::string_view input = inputFile.view();
+    stats.ioTime += Clock::now() - mapStart;
+
+    const Clock::time_point encodeStart = Clock::now();
+    const RP::Encoder::IncrementalEncodeResult result =
+        RP::Encoder::encodeIncrementally(input, options.outputFilename, blockSize);
+    stats.encodeTime += Clock::now() - encodeStart;
+
+    stats.resumedFrom = result.resumedFrom;
+    stats.originalLength += input.size() - result.resumedFrom;
+    stats.encodedLength += result.encodedLength;
+}
+
+// Encodes the input file over itself a window at a time. Reading and writing the file happens in the encoder, so it
+// counts as encode time.
+static void encodeInPlace(const EncoderOptions &options, EncodeStats &stats)
+{
+    const Clock::time_point encodeStart = Clock::now();
+    RP::Encoder::InPlaceEncoder encoder(options.inputFilename);
+    encoder.finish();
+    stats.encodeTime += Clock::now() - encodeStart;
+
+    stats.resumedFrom = encoder.getResumedFrom();
+    stats.originalLength = encoder.getOriginalLength();
+    stats.encodedLength = encoder.getEncodedLength();
+}
+
+// Encodes options.inputFilename into options.outputFilename, throws std::runtime_error on failure
+static EncodeStats encodeFile(const EncoderOptions &options)
+{
+    EncodeStats stats;
+
+    // Output is written in blocks that are a multiple of the page size
+    const size_t pageSize = RP::Encoder::getPageSize();
+    const size_t blockSize = std::max(pageSize, RP::Encoder::BlockFileWriter::DEFAULT_BLOCK_SIZE / pageSize * pageSize);
+    // The output is truncated when it's opened, before the input is read
+    if (!options.inPlace && std::filesystem::exists(options.outputFilename) &&
+        std::filesystem::equivalent(options.inputFilename, options.outputFilename))
+    {
+        throw std::runtime_error("The output file would overwrite the input file, use --in-place to encode a file "
+                                 "over itself");
+    }
+    if (options.incremental)
+    {
+        encodeIncremental(options, blockSize, stats);
+        verifyIfRequested(options, stats);
+        return stats;
+    }
+    if (options.inPlace)
+    {
+        encodeInPlace(options, stats);
+        return stats;
+    }
+    RP::Encoder::BlockFileWriter outputFile(options.outputFilename, blockSize);
+
+    // Encode using the rle method. Time spent in the sink is spent writing the output, not encoding.
+    const RP::Encoder::RleStreamEncoder::Sink sink = [&](std::string_view encoded) {
+        const Clock::time_point writeStart = Clock::now();
+        outputFile.write(encoded);
+        const Clock::duration writeTime = Clock::now() - writeStart;
+        stats.ioTime += writeTime;
+        stats.encodeTime -= writeTime;
+        stats.encodedLength += encoded.size();
+    };
+
+    if (options.threadCount > 1)
+    {
+        encodeParallel(options, sink, stats);
+    }
+    else
+    {
+        RP::Encoder::PassOptions passOptions;
+        if (!options.screenshotDirectory.empty())
+        {
+            passOptions.payloadSink = makeScreenshotExtractor(options, stats);
+        }
+        passOptions.removedTokens = options.removedTokens;
+        if (options.maxStormGapMinutes >= 0)
+        {
+            passOptions.maxStormGapMinutes = options.maxStormGapMinutes;
+        }
+        RP::Encoder::EncoderPipeline pipeline(options.passes, sink, passOptions);
+
+        if (options.useMmap)
+        {
+            encodeMapped(options, pipeline, stats);
+        }
+        else
+        {
+            encodeChunked(options, pipeline, stats);
+        }
+
+        const Clock::time_point finishStart = Clock::now();
+        pipeline.finish();
+        stats.encodeTime += Clock::now() - finishStart;
+        stats.passStats = pipeline.getStats();
+    }
+
+    const Clock::time_point closeStart = Clock::now();
+    outputFile.close();
+    stats.ioTime += Clock::now() - closeStart;
+
+    verifyIfRequested(options, stats);
+    return stats;
+}
+
+// Encodes all files of the batch that aren't up to date, in the order collectBatchFiles() lists them
+static int runBatch(const EncoderOptions &options)
+{
+    std::vector<RP::Encoder::BatchFile> files;
+    size_t upToDateFiles = 0;
+    try
+    {
+        if (!options.batchOutputDirectory.empty())
+        {
+            std::filesystem::create_directories(options.batchOutputDirectory);
+        }
+        for (RP::Encoder::BatchFile &file :
+             RP::Encoder::collectBatchFiles(options.inputFilename, options.batchOutputDirectory))
+        {
+            if (RP::Encoder::isUpToDate(file))
+            {
+                upToDateFiles++;
+            }
+            else
+            {
+                files.push_back(std::move(file));
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        LOG_ERROR("{}", e.what());
+        return 1;
+    }
+
+    std::atomic<size_t> nextFile{0};
+    std::mutex totalsMutex;
+    EncodeStats totals;
+    size_t failedFiles = 0;
+
+    const auto workerThreadFunction = [&]() {
+        for (size_t i = nextFile++; i < files.size(); i = nextFile++)
+        {
+            // Each file is encoded on a single thread, the batch is parallel across files
+            EncoderOptions fileOptions = options;
+            fileOptions.inputFilename = files[i].inputFilename;
+            fileOptions.outputFilename = files[i].outputFilename;
+            fileOptions.threadCount = 1;
+            if (!options.screenshotDirectory.empty())
+            {
+                fileOptions.screenshotDirectory = options.screenshotDirectory / files[i].inputFilename.stem();
+            }
+
+            try
+            {
+                const EncodeStats stats = encodeFile(fileOptions);
+                LOG_INFO("Encoded {} ({} -> {} bytes)", files[i].inputFilename.generic_string(), stats.originalLength,
+                         stats.encodedLength);
+
+                std::lock_guard<std::mutex> lock(totalsMutex);
+                totals.originalLength += stats.originalLength;
+                totals.encodedLength += stats.encodedLength;
+                totals.extractedScreenshots += stats.extractedScreenshots;
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR("{}", e.what());
+                std::lock_guard<std::mutex> lock(totalsMutex);
+                failedFiles++;
+            }
+        }
+    };
+
+    const Clock::time_point batchStart = Clock::now();
+    std::vector<std::thread> workers;
+    const size_t workerCount = std::min<size_t>(options.threadCount, files.size());
+    for (size_t i = 0; i < workerCount; i++)
+    {
+        workers.emplace_back(workerThreadFunction);
+    }
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+    const double batchSeconds = std::chrono::duration<double>(Clock::now() - batchStart).count();
+
+    LOG_INFO("Encoded {} files on {} threads, {} up to date, {} failed", files.size() - failedFiles, workerCount,
+             upToDateFiles, failedFiles);
+    LOG_INFO("Original length: {}", totals.originalLength);
+    LOG_INFO("Encoded length: {}", totals.encodedLength);
+    if (totals.originalLength > 0 && batchSeconds > 0)
+    {
+        LOG_INFO("Compression ratio: {:.3f}",
+                 static_cast<double>(totals.encodedLength) / static_cast<double>(totals.originalLength));
+        LOG_INFO("Throughput: {:.1f} MB/s in {:.3f}s", totals.originalLength / batchSeconds / (1024.0 * 1024.0),
+                 batchSeconds);
+    }
+    return failedFiles > 0 ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    // Initialize logging
+    RP::Logging::initLogging(spdlog::level::info);
+
+    // Validate command-line arguments.
+    EncoderOptions options;
+    if (!parseArguments(argc, argv, options))
+    {
+        printUsage(argv[0]);
         return 1;
     }
-    std::stringstream buffer;
-    buffer << inputFile.rdbuf();
-    const std::string inputContent = buffer.str();
+    if (options.batchMode)
+    {
+        return runBatch(options);
+    }
+    if (!options.screenshotDirectory.empty() && options.threadCount > 1)
+    {
+        // Screenshots are numbered in the order they appear, which needs a single encoder
+        LOG_WARN("--extract-screenshots encodes on a single thread, ignoring --threads {}", options.threadCount);
+        options.threadCount = 1;
+    }
+    if (!usesDefaultPasses(options) && options.threadCount > 1)
+    {
+        // Only the rle pass knows where the input can be split
+        LOG_WARN("--passes other than the default encode on a single thread, ignoring --threads {}",
+                 options.threadCount);
+        options.threadCount = 1;
+    }
+    if (options.incremental && options.threadCount > 1)
+    {
+        // The checkpoint holds the state of a single encoder
+        LOG_WARN("--incremental encodes on a single thread, ignoring --threads {}", options.threadCount);
+        options.threadCount = 1;
+    }
+    if (options.inPlace && (options.threadCount > 1 || options.useMmap))
+    {
+        // The file is read a window at a time, right before that part of it is overwritten
+        LOG_WARN("--in-place reads the file in windows on a single thread, ignoring --threads and --mmap");
+        options.threadCount = 1;
+        options.useMmap = false;
+    }
 
-    // Encode using the rle method.
-    const std::string encodedContent = RP::Encoder::rle(inputContent);
+    EncodeStats stats;
+    try
+    {
+        stats = encodeFile(options);
+    }
+    catch (const std::exception &e)
+    {
+        LOG_ERROR("{}", e.what());
+        return 1;
+    }
 
     // Compare lengths and compute percent change.
-    const size_t originalLength = inputContent.size();
-    const size_t encodedLength = encodedContent.size();
+    const size_t originalLength = stats.originalLength;
+    const size_t encodedLength = stats.encodedLength;
     const double percentChange =
         (originalLength == 0)
             ? 0.0
-            : (static_cast<int>(encodedLength - originalLength) / static_cast<double>(originalLength)) * 100.0;
+            : ((static_cast<double>(encodedLength) - static_cast<double>(originalLength)) /
+               static_cast<double>(originalLength)) *
+                  100.0;
 
+    const double ioSeconds = std::chrono::duration<double>(stats.ioTime).count();
+    const double encodeSeconds = std::chrono::duration<double>(stats.encodeTime).count();
+    const double totalSeconds = ioSeconds + encodeSeconds;
+
+    if (options.incremental || options.inPlace)
+    {
+        LOG_INFO("Resumed from input offset {}", stats.resumedFrom);
+    }
     LOG_INFO("Original length: {}", originalLength);
     LOG_INFO("Encoded length: {}", encodedLength);
     LOG_INFO("Percent change: {:.2f}%", percentChange);
+    LOG_INFO("I/O time: {:.3f}s ({:.1f}%), encode time: {:.3f}s ({:.1f}%), input: {}, threads: {}", ioSeconds,
+             totalSeconds > 0 ? ioSeconds / totalSeconds * 100.0 : 0.0, encodeSeconds,
+             totalSeconds > 0 ? encodeSeconds / totalSeconds * 100.0 : 0.0, options.useMmap ? "mmap" : "chunked",
+             options.threadCount);
+    if (encodeSeconds > 0)
+    {
+        LOG_INFO("Encode throughput: {:.1f} MB/s", originalLength / encodeSeconds / (1024.0 * 1024.0));
+    }
+    for (const RP::Encoder::PassStats &pass : stats.passStats)
+    {
+        const double passSeconds = std::chrono::duration<double>(pass.time).count();
+        LOG_INFO("Pass {}: {} -> {} bytes in {:.3f}s ({:.1f} MB/s)", pass.name, pass.bytesIn, pass.bytesOut,
+                 passSeconds, passSeconds > 0 ? pass.bytesIn / passSeconds / (1024.0 * 1024.0) : 0.0);
+    }
 
-    // Write encoded content to output file
-    std::ofstream outputFile(outputFilename);
-    if (!outputFile.is_open())
+    if (options.verify)
     {
-        LOG_ERROR("Error opening output file: {}", outputFilename.stem().generic_string());
-        return 1;
+        LOG_INFO("Verification passed in {:.3f}s: decoded output matches the input",
+                 std::chrono::duration<double>(stats.verifyTime).count());
+    }
+    if (!options.screenshotDirectory.empty())
+    {
+        LOG_INFO("Extracted {} screenshots to: {}", stats.extractedScreenshots,
+                 options.screenshotDirectory.generic_string());
     }
-    outputFile << encodedContent;
-    outputFile.close();
 
-    LOG_INFO("Encoded content written to: {}", outputFilename.stem().generic_string());
+    LOG_INFO("Encoded content written to: {}", options.outputFilename.stem().generic_string());
 
     return 0;
-}
\ No newline at end of file
+}
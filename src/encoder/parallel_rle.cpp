@@ -0,0 +1,332 @@
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "encoder.h"
+#include "scan_kernels.h"
+#include "utils/logging.h"
+#include "utils/special_tokens.h"
+
+// Parallel RLE splits the recording into chunks that are encoded independently and written out in order.
+//
+// A chunk may only start at a position where the serial encoder would be in a "clean" state, otherwise the chunk
+// encoded on its own would differ from the serial output. That is the case right after a plain character that is not
+// part of a special token: the pending special token was flushed by that character, and the only state left is the
+// run of that character. Splitting there means runs of special tokens never cross a split. A run of characters that
+// does cross a split is stitched by moving the split to the end of the run, so the earlier chunk encodes all of it.
+// Characters are whole UTF-8 sequences, so a split never lands inside of one either.
+// Splits right before an empty special token ('[]') are avoided too, since it is dropped and the run continues.
+// Screenshot payloads are never split, a chunk starting in the middle of one would run-length encode the rest of it.
+namespace
+{
+enum class ScanMode
+{
+    Text,
+    Token,
+    Payload
+};
+
+// '[SCREENSHOT_BASE64' as it appears in the input right before the ']' that starts a payload
+constexpr std::string_view PAYLOAD_TOKEN_PREFIX =
+    std::string_view(SCREENSHOT_BASE64_TOKEN).substr(0, std::string_view(SCREENSHOT_BASE64_TOKEN).size() - 1);
+
+bool isPlainCharacter(char c)
+{
+    return c != '[' && c != ']' && c != '\\';
+}
+
+bool isUnescaped(std::string_view input, size_t i)
+{
+    return i == 0 || input[i - 1] != '\\';
+}
+
+// Returns whether the character that ends right before i continues at i, either because it is repeated or because i is
+// in the middle of its UTF-8 sequence
+bool continuesCharacter(std::string_view input, size_t knownTextPosition, size_t i)
+{
+    if (RP::Encoder::Kernels::isUtf8Continuation(input[i]))
+    {
+        return true;
+    }
+    const size_t start = RP::Encoder::Kernels::findUtf8CharacterStart(input.data(), knownTextPosition, i);
+    const size_t length = i - start;
+    return i + length <= input.size() && input.compare(i, length, input, start, length) == 0;
+}
+
+// Empty special tokens ('[]') don't produce any output, so a character run continues across them
+bool startsEmptyToken(std::string_view input, size_t i)
+{
+    return input[i] == '[' && i + 1 < input.size() && input[i + 1] == ']';
+}
+
+// Follows the mode of the special token stage while scanning forward from a position outside of special tokens and
+// screenshot payloads, such as the start of a chunk
+class ModeTracker
+{
+  public:
+    ScanMode getMode() const
+    {
+        return mode;
+    }
+
+    // Updates the mode for the unescaped bracket at i. A '[' opens a token (or is part of the token that is already
+    // open), a ']' closes the open token (or is plain text). If the ']' closed '[SCREENSHOT_BASE64]', the base64
+    // characters after it are its payload.
+    void onBracket(std::string_view input, size_t i)
+    {
+        if (input[i] == '[')
+        {
+            if (mode == ScanMode::Text)
+            {
+                mode = ScanMode::Token;
+                tokenStart = i;
+            }
+        }
+        else if (mode == ScanMode::Token)
+        {
+            const bool closesPayloadToken =
+                i == tokenStart + PAYLOAD_TOKEN_PREFIX.size() &&
+                input.substr(tokenStart, PAYLOAD_TOKEN_PREFIX.size()) == PAYLOAD_TOKEN_PREFIX;
+            mode = closesPayloadToken ? ScanMode::Payload : ScanMode::Text;
+        }
+    }
+
+    // Called once the payload ended
+    void endPayload()
+    {
+        mode = ScanMode::Text;
+    }
+
+    // Advances to the mode right before 'end', skipping text between brackets with the scan kernels
+    void advance(std::string_view input, size_t position, size_t end)
+    {
+        while (position < end)
+        {
+            if (mode == ScanMode::Payload)
+            {
+                position += RP::Encoder::Kernels::countBase64(input.data() + position, end - position);
+                if (position < end)
+                {
+                    mode = ScanMode::Text;
+                }
+                continue;
+            }
+
+            position += RP::Encoder::Kernels::findDelimiter(input.data() + position, end - position);
+            if (position < end && input[position] != '\\' && isUnescaped(input, position))
+            {
+                onBracket(input, position);
+            }
+            position++;
+        }
+    }
+
+  private:
+    ScanMode mode = ScanMode::Text;
+    // The '[' that opened the current token
+    size_t tokenStart = 0;
+};
+
+// Returns the first safe split position at or after 'from', or input.size() if there is none. 'begin' is the
+// previous split, the scan for the mode at 'from' starts there.
+size_t findSafeSplit(std::string_view input, size_t begin, size_t from)
+{
+    const size_t size = input.size();
+    size_t i = std::min(std::max<size_t>(from, 1), size);
+    ModeTracker tracker;
+    tracker.advance(input, begin, i);
+
+    while (i < size)
+    {
+        const char c = input[i];
+        if (tracker.getMode() == ScanMode::Payload)
+        {
+            i += RP::Encoder::Kernels::countBase64(input.data() + i, size - i);
+            tracker.endPayload();
+            continue;
+        }
+
+        if (tracker.getMode() == ScanMode::Token)
+        {
+            if (c == ']' && isUnescaped(input, i))
+            {
+                tracker.onBracket(input, i);
+            }
+        }
+        else if (isPlainCharacter(input[i - 1]) && !continuesCharacter(input, begin, i) && !startsEmptyToken(input, i))
+        {
+            return i;
+        }
+        else if (c == '[' && isUnescaped(input, i))
+        {
+            tracker.onBracket(input, i);
+        }
+        i++;
+    }
+    return size;
+}
+
+// Returns where the chunks start, followed by input.size(), which must not be empty. The splits are found in one pass
+// before the chunks are encoded, so the worker threads only have to claim the next chunk.
+std::vector<size_t> findChunkSplits(std::string_view input, size_t chunkSize)
+{
+    std::vector<size_t> splits = {0};
+    while (splits.back() < input.size())
+    {
+        splits.push_back(findSafeSplit(input, splits.back(), splits.back() + chunkSize));
+    }
+    return splits;
+}
+
+// Encodes chunks on a fixed set of worker threads and hands their output to the sink in input order. At most
+// 'slots.size()' chunks are in flight, which bounds the memory used for encoded output.
+class ParallelRleEncoder
+{
+  public:
+    ParallelRleEncoder(std::string_view input, unsigned threadCount, size_t chunkSize)
+        : input(input), splits(findChunkSplits(input, std::max<size_t>(chunkSize, 1))), slots(threadCount * 2)
+    {
+        workers.reserve(threadCount);
+        for (unsigned i = 0; i < threadCount; i++)
+        {
+            workers.emplace_back(&ParallelRleEncoder::workerThreadFunction, this);
+        }
+    }
+
+    ~ParallelRleEncoder()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        workAvailable.notify_all();
+        for (std::thread& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    void writeChunksInOrder(const RP::Encoder::RleStreamEncoder::Sink& sink)
+    {
+        for (size_t chunk = 0;; chunk++)
+        {
+            Slot& slot = slots[chunk % slots.size()];
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                chunkDone.wait(lock, [&] { return error || slot.done || (allClaimed && chunk == claimedChunks); });
+                if (error)
+                {
+                    std::rethrow_exception(error);
+                }
+                if (!slot.done)
+                {
+                    return;
+                }
+            }
+
+            sink(slot.output);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                slot.output.clear();
+                slot.done = false;
+                writtenChunks++;
+            }
+            workAvailable.notify_all();
+        }
+    }
+
+  private:
+    struct Slot
+    {
+        std::string output;
+        bool done = false;
+    };
+
+    void workerThreadFunction()
+    {
+        while (true)
+        {
+            size_t chunk;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                workAvailable.wait(lock, [&] {
+                    return stopping || allClaimed || claimedChunks - writtenChunks < slots.size();
+                });
+                if (stopping || allClaimed)
+                {
+                    return;
+                }
+
+                chunk = claimedChunks++;
+                allClaimed = claimedChunks + 1 == splits.size();
+            }
+            // Wake up the writer in case it's waiting for the chunk after the last one
+            chunkDone.notify_all();
+
+            Slot& slot = slots[chunk % slots.size()];
+            try
+            {
+                RP::Encoder::RleStreamEncoder encoder(
+                    [&slot](std::string_view encoded) { slot.output.append(encoded); });
+                encoder.feed(input.substr(splits[chunk], splits[chunk + 1] - splits[chunk]));
+                encoder.finish();
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                error = std::current_exception();
+                stopping = true;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                slot.done = true;
+            }
+            chunkDone.notify_all();
+            workAvailable.notify_all();
+        }
+    }
+
+  private:
+    std::string_view input;
+    // Start of each chunk, followed by the end of the input
+    const std::vector<size_t> splits;
+
+    std::vector<Slot> slots;
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable chunkDone;
+
+    // Guarded by mutex
+    size_t claimedChunks = 0;
+    size_t writtenChunks = 0;
+    bool allClaimed = false;
+    bool stopping = false;
+    std::exception_ptr error;
+};
+} // namespace
+
+namespace RP::Encoder
+{
+void rleParallel(std::string_view userActivityString, unsigned threadCount, const RleStreamEncoder::Sink& sink,
+                 size_t chunkSize)
+{
+    if (threadCount <= 1 || userActivityString.size() <= chunkSize)
+    {
+        RleStreamEncoder encoder(sink);
+        encoder.feed(userActivityString);
+        encoder.finish();
+        return;
+    }
+
+    LOG_DEBUG("Encoding {} bytes on {} threads in chunks of {} bytes", userActivityString.size(), threadCount,
+              chunkSize);
+    ParallelRleEncoder encoder(userActivityString, threadCount, chunkSize);
+    encoder.writeChunksInOrder(sink);
+}
+} // namespace RP::Encoder
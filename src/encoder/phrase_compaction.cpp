@@ -0,0 +1,349 @@
+#include "phrase_compaction.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+constexpr uint32_t HASH_BITS = 15;
+// Matches are found through the hash of their first HASH_LENGTH characters
+constexpr size_t HASH_LENGTH = 4;
+// Number of earlier positions with the same hash that are compared at most
+constexpr size_t MAX_CHAIN_LENGTH = 16;
+// Every this many positions in a row without a match, the stage skips one more position between searches
+constexpr size_t SKIP_TRIGGER_SHIFT = 6;
+
+uint32_t hashAt(const char* data)
+{
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+} // namespace
+
+namespace RP::Encoder
+{
+PhraseCompactionStage::PhraseCompactionStage(RleStreamEncoder::Sink sink, size_t outputBufferSize)
+    : sink(std::move(sink)), outputBufferSize(outputBufferSize), head(size_t(1) << HASH_BITS), chain(WINDOW_SIZE)
+{
+    // Leave some room for the reference that pushes the buffer over the limit
+    output.reserve(outputBufferSize + 64);
+}
+
+void PhraseCompactionStage::feed(std::string_view chunk)
+{
+    // Take the input a window at a time, so the buffer never holds more than a few windows
+    for (size_t i = 0; i < chunk.size(); i += WINDOW_SIZE)
+    {
+        buffer.append(chunk.data() + i, std::min(WINDOW_SIZE, chunk.size() - i));
+        compact(false);
+    }
+}
+
+void PhraseCompactionStage::finish()
+{
+    compact(true);
+    flushOutput();
+}
+
+void PhraseCompactionStage::compact(bool finishing)
+{
+    const size_t end = bufferStart + buffer.size();
+    const size_t stop = finishing ? end : std::max(end, MAX_MATCH_LENGTH) - MAX_MATCH_LENGTH;
+
+    while (position < stop)
+    {
+        size_t distance = 0;
+        const size_t length =
+            position + HASH_LENGTH <= end ? findMatch(position, std::min(end - position, MAX_MATCH_LENGTH), distance)
+                                          : 0;
+        if (length >= MIN_MATCH_LENGTH)
+        {
+            appendReference(distance, length);
+            position += length;
+            misses = 0;
+            continue;
+        }
+
+        const size_t count = std::min(size_t(1) + (misses >> SKIP_TRIGGER_SHIFT), stop - position);
+        appendLiterals(position, count);
+        position += count;
+        misses++;
+    }
+
+    // Drop input that is no longer in the window
+    if (position - bufferStart > 2 * WINDOW_SIZE)
+    {
+        const size_t dropped = position - WINDOW_SIZE - bufferStart;
+        buffer.erase(0, dropped);
+        bufferStart += dropped;
+    }
+}
+
+// Returns the length of the longest match for the input at position, or 0 if no match may start there
+size_t PhraseCompactionStage::findMatch(size_t position, size_t limit, size_t& distance)
+{
+    const char* data = buffer.data() + (position - bufferStart);
+    const uint32_t hash = hashAt(data);
+    size_t candidate = head[hash];
+    chain[position % WINDOW_SIZE] = candidate;
+    head[hash] = position + 1;
+
+    // References would change the meaning of an escape character in front of them or end up in a special token
+    if (inToken || prevChar == '\\')
+    {
+        return 0;
+    }
+
+    size_t bestLength = 0;
+    for (size_t steps = 0; candidate != 0 && steps < MAX_CHAIN_LENGTH; steps++)
+    {
+        const size_t matchPosition = candidate - 1;
+        if (position - matchPosition >= WINDOW_SIZE)
+        {
+            break;
+        }
+
+        const char* match = buffer.data() + (matchPosition - bufferStart);
+        if (match[bestLength] == data[bestLength])
+        {
+            size_t length = 0;
+            while (length < limit && match[length] == data[length])
+            {
+                length++;
+            }
+            if (length > bestLength)
+            {
+                bestLength = length;
+                distance = position - matchPosition;
+                if (length == limit)
+                {
+                    break;
+                }
+            }
+        }
+
+        // Chains only point back, anything else is a slot that was reused for a newer position
+        const size_t next = chain[matchPosition % WINDOW_SIZE];
+        if (next >= candidate)
+        {
+            break;
+        }
+        candidate = next;
+    }
+
+    return bestLength >= MIN_MATCH_LENGTH ? trimMatch(position, bestLength) : 0;
+}
+
+// Shortens a match so it doesn't end inside a special token or with an escape character
+size_t PhraseCompactionStage::trimMatch(size_t position, size_t length) const
+{
+    const char* data = buffer.data() + (position - bufferStart);
+    bool token = false;
+    char prev = prevChar;
+    size_t trimmedLength = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        const char c = data[i];
+        if (prev != '\\')
+        {
+            token = token ? c != ']' : c == '[';
+        }
+        prev = c;
+        if (!token && c != '\\')
+        {
+            trimmedLength = i + 1;
+        }
+    }
+    return trimmedLength;
+}
+
+void PhraseCompactionStage::appendLiterals(size_t position, size_t count)
+{
+    const char* data = buffer.data() + (position - bufferStart);
+    for (size_t i = 0; i < count; i++)
+    {
+        const char c = data[i];
+        if (c == '^' && afterTokenStart)
+        {
+            // '[^' is written as '[^^' so it can't be mistaken for a reference
+            output += '^';
+        }
+        output += c;
+
+        afterTokenStart = c == '[' && prevChar != '\\';
+        if (prevChar != '\\')
+        {
+            inToken = inToken ? c != ']' : c == '[';
+        }
+        prevChar = c;
+    }
+
+    if (output.size() >= outputBufferSize)
+    {
+        flushOutput();
+    }
+}
+
+void PhraseCompactionStage::appendReference(size_t distance, size_t length)
+{
+    char digits[24];
+    output += "[^";
+    output.append(digits, std::to_chars(digits, digits + sizeof(digits), distance).ptr);
+    output += ',';
+    output.append(digits, std::to_chars(digits, digits + sizeof(digits), length).ptr);
+    output += ']';
+
+    // The match covers whole special tokens, so it leaves us outside of one
+    prevChar = buffer[position + length - 1 - bufferStart];
+    afterTokenStart = false;
+
+    if (output.size() >= outputBufferSize)
+    {
+        flushOutput();
+    }
+}
+
+void PhraseCompactionStage::flushOutput()
+{
+    if (!output.empty())
+    {
+        sink(output);
+        output.clear();
+    }
+}
+
+PhraseDecoder::PhraseDecoder(RleStreamEncoder::Sink sink) : sink(std::move(sink))
+{
+}
+
+void PhraseDecoder::feed(std::string_view chunk)
+{
+    if (pending.empty())
+    {
+        // Decode straight from the chunk, only a reference split from the next chunk is copied
+        pending.assign(chunk.substr(decode(chunk, false)));
+        return;
+    }
+    pending.append(chunk);
+    pending.erase(0, decode(pending, false));
+}
+
+void PhraseDecoder::finish()
+{
+    decode(pending, true);
+    pending.clear();
+    if (!decoded.empty())
+    {
+        sink(decoded);
+        decoded.clear();
+    }
+}
+
+size_t PhraseDecoder::decode(std::string_view encoded, bool final)
+{
+    const char* data = encoded.data();
+    const size_t size = encoded.size();
+
+    size_t i = 0;
+    while (i < size)
+    {
+        if (decoded.size() >= 2 * PhraseCompactionStage::WINDOW_SIZE)
+        {
+            const size_t flushed = decoded.size() - PhraseCompactionStage::WINDOW_SIZE;
+            sink(std::string_view(decoded.data(), flushed));
+            decoded.erase(0, flushed);
+        }
+
+        // Copy text up to the next '[', a window at a time so the decoded output is flushed in between
+        const size_t searchEnd = std::min(size, i + PhraseCompactionStage::WINDOW_SIZE);
+        const void* found = std::memchr(data + i, '[', searchEnd - i);
+        const size_t open = found ? static_cast<size_t>(static_cast<const char*>(found) - data) : searchEnd;
+        decoded.append(data + i, open - i);
+        i = open;
+        if (!found)
+        {
+            continue;
+        }
+
+        // Whether this is a reference may depend on the next chunk
+        const size_t referenceEnd = std::min(size, open + PhraseCompactionStage::MAX_REFERENCE_LENGTH);
+        const bool mayContinue = !final && referenceEnd == size;
+        if (mayContinue && (open + 1 == size || (data[open + 1] == '^' && open + 2 == size)))
+        {
+            break;
+        }
+
+        if (open + 1 == size || data[open + 1] != '^' || (open > 0 ? data[open - 1] : prevChar) == '\\')
+        {
+            decoded += '[';
+            i = open + 1;
+            continue;
+        }
+        if (open + 2 < size && data[open + 2] == '^')
+        {
+            decoded += "[^";
+            i = open + 3;
+            continue;
+        }
+
+        // '[^<distance>,<length>]', anything else is copied as is
+        size_t distance = 0;
+        size_t length = 0;
+        const char* end = data + referenceEnd;
+        const auto distanceResult = std::from_chars(data + open + 2, end, distance);
+        const auto lengthResult = distanceResult.ptr != end && *distanceResult.ptr == ','
+                                      ? std::from_chars(distanceResult.ptr + 1, end, length)
+                                      : std::from_chars_result{distanceResult.ptr, std::errc::invalid_argument};
+        if (mayContinue && (distanceResult.ptr == end || lengthResult.ptr == end))
+        {
+            break;
+        }
+        if (lengthResult.ec != std::errc() || lengthResult.ptr == end || *lengthResult.ptr != ']' || distance == 0 ||
+            distance > decoded.size() || length == 0 || length > PhraseCompactionStage::MAX_MATCH_LENGTH)
+        {
+            decoded += '[';
+            i = open + 1;
+            continue;
+        }
+
+        const size_t from = decoded.size() - distance;
+        decoded.resize(decoded.size() + length);
+        char* copy = decoded.data();
+        if (distance >= length)
+        {
+            std::memcpy(copy + from + distance, copy + from, length);
+        }
+        else
+        {
+            // The copy repeats what it just produced
+            for (size_t k = 0; k < length; k++)
+            {
+                copy[from + distance + k] = copy[from + k];
+            }
+        }
+        i = static_cast<size_t>(lengthResult.ptr - data) + 1;
+    }
+
+    if (i > 0)
+    {
+        prevChar = data[i - 1];
+    }
+    return i;
+}
+
+void phraseDecode(std::string_view encodedString, const RleStreamEncoder::Sink& sink)
+{
+    PhraseDecoder decoder(sink);
+    decoder.feed(encodedString);
+    decoder.finish();
+}
+
+std::string phraseDecode(std::string_view encodedString)
+{
+    std::string decoded;
+    phraseDecode(encodedString, [&decoded](std::string_view piece) { decoded.append(piece); });
+    return decoded;
+}
+} // namespace RP::Encoder
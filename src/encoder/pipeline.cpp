@@ -0,0 +1,163 @@
+#include "pipeline.h"
+#include <stdexcept>
+#include <utility>
+#include "edit_replay.h"
+#include "phrase_compaction.h"
+#include "timestamp_delta.h"
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+// Adapts a stage with feed() and finish() that writes to a sink given to its constructor
+template <typename Stage> class StagePass : public RP::Encoder::EncoderPass
+{
+  public:
+    template <typename... Args> explicit StagePass(Args&&... args) : stage(std::forward<Args>(args)...)
+    {
+    }
+
+    void feed(std::string_view chunk) override
+    {
+        stage.feed(chunk);
+    }
+
+    void finish() override
+    {
+        stage.finish();
+    }
+
+    Stage stage;
+};
+} // namespace
+
+namespace RP::Encoder
+{
+const std::vector<PassInfo>& getAvailablePasses()
+{
+    static const std::vector<PassInfo> passes = {
+        {"edits", "Apply backspaces to the typed text and drop shift keys", nullptr},
+        {"filter", "Remove special tokens, along with whole window change and screenshot records", nullptr},
+        {"storms", "Collapse window changes in quick succession into the last one, run before timestamps", nullptr},
+        {"timestamps", "Write window change timestamps as the minutes since the previous one, like '+3m'",
+         [](RleStreamEncoder::Sink sink) -> std::unique_ptr<EncoderPass> {
+             return std::make_unique<StagePass<TimestampDeltaStage>>(std::move(sink),
+                                                                     TimestampDeltaStage::Direction::Decode);
+         }},
+        {"rle", "Collapse repeated special tokens and characters",
+         [](RleStreamEncoder::Sink sink) -> std::unique_ptr<EncoderPass> {
+             return std::make_unique<StagePass<RleStreamDecoder>>(std::move(sink));
+         }},
+        {"phrases", "Replace repeated phrases with references like '[^<distance>,<length>]', run after rle",
+         [](RleStreamEncoder::Sink sink) -> std::unique_ptr<EncoderPass> {
+             return std::make_unique<StagePass<PhraseDecoder>>(std::move(sink));
+         }},
+    };
+    return passes;
+}
+
+const PassInfo* findPass(std::string_view name)
+{
+    for (const PassInfo& pass : getAvailablePasses())
+    {
+        if (pass.name == name)
+        {
+            return &pass;
+        }
+    }
+    return nullptr;
+}
+
+std::unique_ptr<EncoderPass> createPass(std::string_view name, RleStreamEncoder::Sink sink, const PassOptions& options)
+{
+    if (name == "edits")
+    {
+        return std::make_unique<StagePass<EditReplayStage>>(std::move(sink));
+    }
+    if (name == "filter")
+    {
+        return std::make_unique<StagePass<TokenFilterStage>>(std::move(sink), options.removedTokens);
+    }
+    if (name == "storms")
+    {
+        return std::make_unique<StagePass<WindowStormStage>>(std::move(sink), options.maxStormGapMinutes);
+    }
+    if (name == "timestamps")
+    {
+        return std::make_unique<StagePass<TimestampDeltaStage>>(std::move(sink));
+    }
+    if (name == "phrases")
+    {
+        return std::make_unique<StagePass<PhraseCompactionStage>>(std::move(sink));
+    }
+    if (name == "rle")
+    {
+        auto pass = std::make_unique<StagePass<RleStreamEncoder>>(std::move(sink));
+        if (options.payloadSink)
+        {
+            pass->stage.setPayloadSink(options.payloadSink);
+        }
+        return pass;
+    }
+    throw std::runtime_error("Unknown encoder pass: " + std::string(name));
+}
+
+EncoderPipeline::EncoderPipeline(const std::vector<std::string>& passNames, RleStreamEncoder::Sink sink,
+                                 const PassOptions& options)
+    : sink(std::move(sink)), passes(passNames.size()), stats(passNames.size())
+{
+    for (size_t i = 0; i < passNames.size(); i++)
+    {
+        stats[i].name = passNames[i];
+
+        // Output goes to the next pass. Time spent there is not spent in this pass.
+        RleStreamEncoder::Sink passSink = [this, i](std::string_view output) {
+            stats[i].bytesOut += output.size();
+            const Clock::time_point start = Clock::now();
+            if (i + 1 < passes.size())
+            {
+                feedPass(i + 1, output);
+            }
+            else
+            {
+                this->sink(output);
+            }
+            stats[i].time -= Clock::now() - start;
+        };
+        passes[i] = createPass(passNames[i], std::move(passSink), options);
+    }
+}
+
+void EncoderPipeline::feed(std::string_view chunk)
+{
+    if (passes.empty())
+    {
+        sink(chunk);
+        return;
+    }
+    feedPass(0, chunk);
+}
+
+void EncoderPipeline::finish()
+{
+    for (size_t i = 0; i < passes.size(); i++)
+    {
+        const Clock::time_point start = Clock::now();
+        passes[i]->finish();
+        stats[i].time += Clock::now() - start;
+    }
+}
+
+const std::vector<PassStats>& EncoderPipeline::getStats() const
+{
+    return stats;
+}
+
+void EncoderPipeline::feedPass(size_t index, std::string_view chunk)
+{
+    stats[index].bytesIn += chunk.size();
+    const Clock::time_point start = Clock::now();
+    passes[index]->feed(chunk);
+    stats[index].time += Clock::now() - start;
+}
+} // namespace RP::Encoder
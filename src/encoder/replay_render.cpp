@@ -0,0 +1,102 @@
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "encoder/file_io.h"
+#include "utils/binary_event_log.h"
+#include "utils/logging.h"
+
+// Renders a binary event log, recorded with replay_recorder --binary, as the text format the rest of the tools read.
+
+// Size of the chunks the log is rendered in, a record longer than that is rendered on its own
+constexpr size_t INPUT_CHUNK_SIZE = 1024 * 1024;
+
+static void printUsage(const char *programPath)
+{
+    std::filesystem::path renderPath(programPath);
+
+    std::cerr << "Usage: \n"
+              << renderPath.stem().generic_string() << " <input_file> [output_file]\n\n"
+              << "Renders a binary event log as the text format of the recorder. The output file defaults to the\n"
+              << "input file with the .txt extension.\n";
+}
+
+int main(int argc, char *argv[])
+{
+    RP::Logging::initLogging(spdlog::level::info);
+
+    if (argc < 2 || argc > 3)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+    const std::filesystem::path inputFilename = argv[1];
+    const std::filesystem::path outputFilename =
+        argc == 3 ? std::filesystem::path(argv[2]) : std::filesystem::path(inputFilename).replace_extension(".txt");
+    if (std::filesystem::exists(outputFilename) && std::filesystem::equivalent(inputFilename, outputFilename))
+    {
+        LOG_ERROR("The output file would overwrite the input file");
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    RP::EventLog::TextRenderer renderer;
+    size_t renderedLength = 0;
+    size_t textLength = 0;
+    try
+    {
+        RP::Encoder::MappedFile inputFile(inputFilename);
+        RP::Encoder::BlockFileWriter outputFile(outputFilename);
+        const std::string_view log = inputFile.view();
+
+        // Tokens render to several times their size
+        std::string text;
+        text.reserve(4 * INPUT_CHUNK_SIZE);
+        while (renderedLength < log.size())
+        {
+            const std::string_view chunk = log.substr(renderedLength, INPUT_CHUNK_SIZE);
+            size_t consumed = renderer.render(chunk, text);
+            if (consumed == 0 && chunk.size() < log.size() - renderedLength)
+            {
+                // A record that doesn't fit in a chunk, e.g. a base64 screenshot, is rendered on its own
+                const uint64_t recordLength = RP::EventLog::getRecordLength(log.substr(renderedLength));
+                if (recordLength > 0 && recordLength <= log.size() - renderedLength)
+                {
+                    consumed = renderer.render(log.substr(renderedLength, recordLength), text);
+                }
+            }
+            if (consumed == 0)
+            {
+                break;
+            }
+            renderedLength += consumed;
+            textLength += text.size();
+            outputFile.write(text);
+            text.clear();
+        }
+        outputFile.close();
+
+        if (renderedLength < log.size())
+        {
+            // The recorder stopped in the middle of writing a record
+            LOG_WARN("The log ends with an incomplete record, ignoring its last {} bytes", log.size() - renderedLength);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        LOG_ERROR("{}", e.what());
+        return 1;
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("Rendered {} records ({} bytes) into {} bytes of text in {:.3f}s", renderer.getRecordCount(),
+             renderedLength, textLength, seconds);
+    if (seconds > 0)
+    {
+        LOG_INFO("Render throughput: {:.1f} MB/s", renderedLength / seconds / (1024.0 * 1024.0));
+    }
+    return 0;
+}
@@ -1,149 +1,728 @@
-
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
 #include "encoder.h"
+#include "scan_kernels.h"
 #include "utils/logging.h"
+#include "utils/special_tokens.h"
+
+// The encoder used to run two passes over the whole document: the first collapsed repeated special tokens
+// ('[SPACE][SPACE]' -> '[SPACEx2]') and produced an intermediate string, the second collapsed repeated characters
+// ('AAAA' -> 'A{4}') while copying special tokens verbatim.
+//
+// RleStreamEncoder runs both passes in one traversal. The special token stage consumes the input and hands the text
+// it would have produced directly to the character stage, which writes into the output buffer. Since the character
+// stage only ever looks at the bytes the special token stage emits, the result is byte-identical to running the two
+// passes one after the other.
+//
+// The one exception are base64 screenshot payloads. Running them through the character stage turned 'AAAA' into
+// 'A{4}', which corrupted the screenshot and cost a lot of time for megabytes of data that never compress. Once the
+// special token stage closes a '[SCREENSHOT_BASE64]' token it skips over the base64 characters that follow and
+// copies them to the output as they are.
+//
+// The character stage collapses runs of characters rather than bytes, so 'ééééé' becomes 'é{5}' and a run never
+// ends in the middle of a UTF-8 sequence. Plain ASCII is found with a SIMD kernel and copied as before, UTF-8 sequences
+// are only decoded where bytes with the high bit set show up. Bytes that aren't part of a valid sequence are
+// characters of their own.
+//
+// Closed tokens are looked up in the special token dictionary, so the pending token is usually kept as a small id and
+// compared without touching its text. Only tokens that aren't in the dictionary are kept and compared as strings.
+namespace
+{
+using RP::Tokens::TokenId;
+
+// Bumped whenever the layout of saved encoder states changes
+constexpr char STATE_VERSION = 2;
+
+void writeInteger(std::string& state, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        state += static_cast<char>((value >> (i * 8)) & 0xFF);
+    }
+}
+
+void writeString(std::string& state, std::string_view value)
+{
+    writeInteger(state, value.size());
+    state += value;
+}
+
+// Reads the fields of a saved state in the order they were written
+class StateReader
+{
+  public:
+    explicit StateReader(std::string_view state) : state(state)
+    {
+    }
+
+    char readChar()
+    {
+        return take(1)[0];
+    }
+
+    bool readBool()
+    {
+        return readChar() != 0;
+    }
+
+    uint64_t readInteger()
+    {
+        const std::string_view bytes = take(8);
+        uint64_t value = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            value |= static_cast<uint64_t>(static_cast<unsigned char>(bytes[i])) << (i * 8);
+        }
+        return value;
+    }
+
+    void readString(std::string& value)
+    {
+        const uint64_t size = readInteger();
+        const std::string_view bytes = take(size);
+        value.assign(bytes.data(), bytes.size());
+    }
+
+    bool atEnd() const
+    {
+        return state.empty();
+    }
+
+  private:
+    std::string_view take(uint64_t size)
+    {
+        if (size > state.size())
+        {
+            throw std::runtime_error("Malformed encoder state");
+        }
+        const std::string_view bytes = state.substr(0, size);
+        state.remove_prefix(size);
+        return bytes;
+    }
+
+    std::string_view state;
+};
+} // namespace
 
-inline std::string _rle_special_tokens(const std::string &userActivityString);
-inline std::string _rle_character_tokens(const std::string &userActivityString);
 namespace RP::Encoder
 {
-std::string rle(const std::string &userActivityString)
+std::string rle(const std::string& userActivityString)
 {
-    std::string encodedString = _rle_special_tokens(userActivityString);
-    encodedString = _rle_character_tokens(encodedString);
+    std::string encodedString;
+    // The encoded string is never more than a couple of bytes longer than the input
+    encodedString.reserve(userActivityString.size() + 16);
+    rle(userActivityString, encodedString);
+
+    LOG_DEBUG("Encoded {} bytes into {} bytes", userActivityString.size(), encodedString.size());
     return encodedString;
 }
 
-} // namespace RP::Encoder
+void rle(std::string_view userActivityString, std::string& encodedString)
+{
+    // Kept between calls so its token buffers are only allocated once per thread
+    thread_local RleStreamEncoder encoder(nullptr);
+    encoder.encode(userActivityString, encodedString);
+}
+
+RleStreamEncoder::RleStreamEncoder(Sink sink, size_t outputBufferSize)
+    : sink(std::move(sink)), outputBufferSize(outputBufferSize)
+{
+    // Leave some room for the run or token that pushes the buffer over the limit
+    output.reserve(outputBufferSize + 64);
+}
+
+void RleStreamEncoder::reset()
+{
+    output.clear();
+    prevInputChar = '\0';
+    inToken = false;
+    tokenContent.clear();
+    pendingToken.clear();
+    pendingTokenId = TokenId::Unknown;
+    repeatCount = 0;
+    inPayload = false;
+    payloadLength = 0;
+    inCopy = false;
+    prevChar = '\0';
+    runUnitSize = 0;
+    runLength = 0;
+    partialUnitSize = 0;
+}
+
+void RleStreamEncoder::encode(std::string_view userActivityString, std::string& encodedString)
+{
+    reset();
+
+    // Encode straight into the caller's string by swapping it in as the output buffer. Without a sink the output
+    // buffer is never flushed, so everything ends up appended to it.
+    Sink savedSink = std::move(sink);
+    sink = nullptr;
+    std::swap(output, encodedString);
+    try
+    {
+        feed(userActivityString);
+        finish();
+    }
+    catch (...)
+    {
+        std::swap(output, encodedString);
+        sink = std::move(savedSink);
+        throw;
+    }
+    std::swap(output, encodedString);
+    sink = std::move(savedSink);
+}
+
+std::string RleStreamEncoder::saveState()
+{
+    flushOutput();
+
+    std::string state;
+    state += STATE_VERSION;
+    state += prevInputChar;
+    state += static_cast<char>(inToken);
+    writeString(state, tokenContent);
+    writeString(state, getPendingToken());
+    writeInteger(state, repeatCount);
+    state += static_cast<char>(inPayload);
+    writeInteger(state, payloadLength);
+    state += static_cast<char>(inCopy);
+    state += prevChar;
+    writeString(state, std::string_view(runUnit, runUnitSize));
+    writeInteger(state, runLength);
+    writeString(state, std::string_view(partialUnit, partialUnitSize));
+    return state;
+}
+
+void RleStreamEncoder::restoreState(std::string_view state)
+{
+    StateReader reader(state);
+    if (reader.readChar() != STATE_VERSION)
+    {
+        throw std::runtime_error("Unsupported encoder state version");
+    }
+
+    reset();
+    prevInputChar = reader.readChar();
+    inToken = reader.readBool();
+    reader.readString(tokenContent);
+    reader.readString(pendingToken);
+    pendingTokenId = RP::Tokens::lookupToken(pendingToken);
+    if (pendingTokenId != TokenId::Unknown)
+    {
+        pendingToken.clear();
+    }
+    repeatCount = reader.readInteger();
+    inPayload = reader.readBool();
+    payloadLength = reader.readInteger();
+    inCopy = reader.readBool();
+    prevChar = reader.readChar();
+    std::string unit;
+    reader.readString(unit);
+    if (unit.size() > sizeof(runUnit))
+    {
+        throw std::runtime_error("Malformed encoder state");
+    }
+    std::memcpy(runUnit, unit.data(), unit.size());
+    runUnitSize = unit.size();
+    runLength = reader.readInteger();
+    reader.readString(unit);
+    if (unit.size() >= sizeof(partialUnit))
+    {
+        throw std::runtime_error("Malformed encoder state");
+    }
+    std::memcpy(partialUnit, unit.data(), unit.size());
+    partialUnitSize = unit.size();
+    if (!reader.atEnd())
+    {
+        throw std::runtime_error("Malformed encoder state");
+    }
+}
+
+void RleStreamEncoder::setPayloadSink(PayloadSink payloadSink)
+{
+    this->payloadSink = std::move(payloadSink);
+}
 
-inline std::string _rle_special_tokens(const std::string &userActivityString)
+void RleStreamEncoder::feed(std::string_view chunk)
 {
-    std::string output;
-    std::string prevToken;
-    int repeatCount = 0;
+    const char* data = chunk.data();
+    const size_t size = chunk.size();
     size_t i = 0;
-    while (i < userActivityString.size())
+
+    while (i < size)
     {
-        // Check for special tokens: If start token ('[') is found and it's not escaped
-        if (userActivityString[i] == '[' && (i == 0 || userActivityString[i - 1] != '\\'))
+        if (inPayload)
         {
-            // Parse the token
-            size_t j = i + 1;
-            bool found = false;
-            while (j < userActivityString.size())
+            // The payload ends at the first character that isn't base64, normally the '[' of '[/SCREENSHOT]'
+            const size_t count = Kernels::countBase64(data + i, size - i);
+            for (size_t k = i; k < i + count; k += outputBufferSize)
             {
-                if (userActivityString[j] == ']' && (j == 0 || userActivityString[j - 1] != '\\'))
-                {
-                    found = true;
-                    break;
-                }
-                j++;
+                appendPayload(data + k, std::min(outputBufferSize, i + count - k));
             }
-            // If we didn't find a closing character for this token (']'), this string
-            // is malformed we're now at the end of the string, so we just append
-            // everything and break out.
-            if (!found)
+            i += count;
+            if (i == size)
             {
-                if (!prevToken.empty())
-                {
-                    output += "[" + prevToken + "x" + std::to_string(repeatCount + 1) + "]";
-                }
-                output += userActivityString.substr(i);
-                prevToken.clear();
                 break;
             }
-            std::string tokenContent = userActivityString.substr(i + 1, j - (i + 1));
+            endPayload();
+            continue;
+        }
 
-            LOG_DEBUG("tokenContent: {}", tokenContent);
-            if (tokenContent == prevToken)
-            {
-                repeatCount++;
-            }
-            else
+        if (inToken)
+        {
+            // Find the closing character for this token (']'), it must not be escaped
+            size_t j = findUnescaped(data, size, i, ']');
+            tokenContent.append(data + i, j - i);
+            if (j == size)
             {
-                if (!prevToken.empty())
-                {
-                    output += "[" + prevToken;
-                    if (repeatCount > 0)
-                    {
-                        output += "x" + std::to_string(repeatCount + 1);
-                    }
-                    output += "]";
-                }
-                prevToken = tokenContent;
-                repeatCount = 0;
+                break;
             }
+
+            closeToken();
             i = j + 1;
+            continue;
         }
-        else
+
+        // Everything up to the next unescaped '[' is plain text
+        size_t j = findUnescaped(data, size, i, '[');
+        if (j > i)
         {
-            // Flush any pending token
-            if (!prevToken.empty())
+            flushPendingToken();
+            // Hand long stretches of text to the sink in pieces so the output buffer stays bounded
+            for (size_t k = i; k < j; k += outputBufferSize)
             {
-                output += "[" + prevToken;
-                if (repeatCount > 0)
+                appendCharacters(data + k, std::min(outputBufferSize, j - k));
+                if (output.size() >= outputBufferSize)
                 {
-                    output += "x" + std::to_string(repeatCount + 1);
+                    flushOutput();
                 }
-                output += "]";
-                prevToken.clear();
-                repeatCount = 0;
             }
-            // Add current character to output
-            output += userActivityString[i];
-            i++;
         }
+        if (j < size)
+        {
+            inToken = true;
+            tokenContent.clear();
+        }
+        i = j + 1;
+    }
+
+    if (size > 0)
+    {
+        prevInputChar = data[size - 1];
+    }
+    if (output.size() >= outputBufferSize)
+    {
+        flushOutput();
+    }
+}
+
+void RleStreamEncoder::finish()
+{
+    if (inPayload)
+    {
+        endPayload();
     }
 
-    // Flush any remaining token after processing all characters
-    if (!prevToken.empty())
+    if (inToken)
     {
-        output += "[" + prevToken;
-        if (repeatCount > 0)
+        // We didn't find a closing character for the last token (']'), so the string is malformed. The pending token
+        // is always written with its count, and the rest of the input is copied as is.
+        if (hasPendingToken())
         {
-            output += "x" + std::to_string(repeatCount + 1);
+            appendToken(getPendingToken(), repeatCount + 1, true);
         }
-        output += "]";
+        pendingToken.clear();
+        pendingTokenId = TokenId::Unknown;
+        appendUnclosedToken(tokenContent);
+        inToken = false;
     }
+    else
+    {
+        flushPendingToken();
+    }
+    flushRun();
+    flushOutput();
+}
 
-    return output;
+// Returns the index of the first occurrence of 'delimiter' at or after 'from' that is not preceded by a '\', or
+// 'size' if there is none. The last character of the previous chunk is used to check the first one of this chunk.
+size_t RleStreamEncoder::findUnescaped(const char* data, size_t size, size_t from, char delimiter) const
+{
+    size_t i = from;
+    while (i < size)
+    {
+        const void* found = std::memchr(data + i, delimiter, size - i);
+        if (!found)
+        {
+            return size;
+        }
+        size_t j = static_cast<const char*>(found) - data;
+        char prev = j == 0 ? prevInputChar : data[j - 1];
+        if (prev != '\\')
+        {
+            return j;
+        }
+        i = j + 1;
+    }
+    return size;
 }
 
-inline std::string _rle_character_tokens(const std::string &userActivityString)
+void RleStreamEncoder::closeToken()
 {
-    std::string output;
-    size_t i = 0;
+    inToken = false;
+    const TokenId tokenId = RP::Tokens::lookupToken(tokenContent);
+    inPayload = tokenId == TokenId::ScreenshotBase64;
+    if (tokenId == pendingTokenId && (tokenId != TokenId::Unknown || tokenContent == pendingToken))
+    {
+        repeatCount++;
+        return;
+    }
 
-    while (i < userActivityString.length())
+    flushPendingToken();
+    pendingTokenId = tokenId;
+    if (tokenId == TokenId::Unknown)
     {
-        char tmp = userActivityString[i];
-        size_t k = 0;
+        // Copy rather than swap, so each buffer keeps the capacity it grew to and doesn't allocate for later tokens
+        pendingToken.assign(tokenContent);
+    }
+    repeatCount = 0;
+}
 
-        // Ignore special tokens
-        if (userActivityString[i] == '[' && (i == 0 || userActivityString[i - 1] != '\\'))
+void RleStreamEncoder::flushPendingToken()
+{
+    if (hasPendingToken())
+    {
+        appendToken(getPendingToken(), repeatCount + 1, repeatCount > 0);
+        pendingToken.clear();
+        pendingTokenId = TokenId::Unknown;
+        repeatCount = 0;
+    }
+}
+
+bool RleStreamEncoder::hasPendingToken() const
+{
+    return pendingTokenId != TokenId::Unknown || !pendingToken.empty();
+}
+
+std::string_view RleStreamEncoder::getPendingToken() const
+{
+    return pendingTokenId != TokenId::Unknown ? RP::Tokens::getTokenContent(pendingTokenId)
+                                              : std::string_view(pendingToken);
+}
+
+void RleStreamEncoder::appendPayload(const char* data, size_t size)
+{
+    if (payloadLength == 0)
+    {
+        flushPendingToken();
+    }
+    payloadLength += size;
+
+    if (payloadSink)
+    {
+        payloadSink(std::string_view(data, size), false);
+        return;
+    }
+    appendVerbatim(data, size);
+    if (output.size() >= outputBufferSize)
+    {
+        flushOutput();
+    }
+}
+
+void RleStreamEncoder::endPayload()
+{
+    if (payloadSink && payloadLength > 0)
+    {
+        const std::string replacement = payloadSink({}, true);
+        appendVerbatim(replacement.data(), replacement.size());
+    }
+    inPayload = false;
+    payloadLength = 0;
+}
+
+// Writes '[<content>x<count>]' (or '[<content>]' when the count is omitted) to the character stage
+void RleStreamEncoder::appendToken(std::string_view content, size_t count, bool withCount)
+{
+    char digits[24];
+    char* digitsEnd = digits;
+    if (withCount)
+    {
+        digitsEnd = std::to_chars(digits, digits + sizeof(digits), count).ptr;
+    }
+
+    // The character stage copies special tokens verbatim, so unless the token continues a run of '[' or follows
+    // an escape character we can write it straight to the output.
+    if (canAppendTokenDirectly())
+    {
+        flushRun();
+        output += '[';
+        output += content;
+        if (withCount)
+        {
+            output += 'x';
+            output.append(digits, digitsEnd);
+        }
+        output += ']';
+        prevChar = ']';
+        return;
+    }
+
+    appendCharacters("[", 1);
+    appendCharacters(content.data(), content.size());
+    if (withCount)
+    {
+        appendCharacters("x", 1);
+        appendCharacters(digits, digitsEnd - digits);
+    }
+    appendCharacters("]", 1);
+}
+
+// Writes '[<content>' without a closing character to the character stage
+void RleStreamEncoder::appendUnclosedToken(const std::string& content)
+{
+    if (canAppendTokenDirectly())
+    {
+        flushRun();
+        output += '[';
+        output += content;
+        inCopy = true;
+        prevChar = content.empty() ? '[' : content.back();
+        return;
+    }
+
+    appendCharacters("[", 1);
+    appendCharacters(content.data(), content.size());
+}
+
+bool RleStreamEncoder::canAppendTokenDirectly() const
+{
+    return !inCopy && !(runLength > 0 && runUnitSize == 1 && (runUnit[0] == '[' || runUnit[0] == '\\'));
+}
+
+void RleStreamEncoder::appendCharacters(const char* data, size_t size)
+{
+    size_t i = partialUnitSize > 0 ? completePartialUnit(data, size) : 0;
+    while (i < size)
+    {
+        if (inCopy)
         {
-            // Find closing special token (']')
-            while (i + k < userActivityString.length() &&
-                   !(userActivityString[i + k] == ']' && userActivityString[i + k - 1] != '\\'))
+            // Copy the contents of the special token into the output until its closing character (']')
+            size_t end = size;
+            for (size_t from = i; from < size;)
             {
-                k++;
+                const void* found = std::memchr(data + from, ']', size - from);
+                if (!found)
+                {
+                    break;
+                }
+                const size_t j = static_cast<const char*>(found) - data;
+                const char prev = j == i ? prevChar : data[j - 1];
+                from = j + 1;
+                if (prev != '\\')
+                {
+                    end = j + 1;
+                    inCopy = false;
+                    break;
+                }
             }
-
-            // copy the contents of special token into output str
-            output += userActivityString.substr(i, k + 1);
-            // update i to first char after closing token
-            i = i + k + 1;
+            output.append(data + i, end - i);
+            prevChar = data[end - 1];
+            i = end;
             continue;
         }
-        else
-            while (i + k < userActivityString.length() && userActivityString[i + k] == tmp)
+
+        if (runLength > 0)
+        {
+            const size_t count = countUnitRepeats(data + i, size - i);
+            runLength += count / runUnitSize;
+            i += count;
+            const char lastRunChar = runUnit[runUnitSize - 1];
+            if (i == size)
+            {
+                prevChar = lastRunChar;
+                break;
+            }
+            if (size - i < runUnitSize && std::memcmp(data + i, runUnit, size - i) == 0)
             {
-                k++;
+                // The input ends in the middle of what might be the next repetition
+                std::memcpy(partialUnit, data + i, size - i);
+                partialUnitSize = size - i;
+                prevChar = data[size - 1];
+                break;
             }
+            flushRun();
+            prevChar = lastRunChar;
+        }
+
+        // Characters that are neither repeated nor delimiters form runs of length one, so they can be copied as they
+        // are. The last character of the input is kept back since the next input might continue its run. ASCII is
+        // copied in bulk, other characters go through appendUnit() one at a time.
+        size_t end = i + Kernels::findRepeat(data + i, size - i);
+        end = i + Kernels::findDelimiter(data + i, end - i);
+        end = i + Kernels::findNonAscii(data + i, end - i);
+        if (end == size)
+        {
+            end--;
+        }
+        if (end > i)
+        {
+            output.append(data + i, end - i);
+            prevChar = data[end - 1];
+            i = end;
+        }
+
+        const char c = data[i];
+        // Ignore special tokens
+        if (c == '[' && prevChar != '\\')
+        {
+            output += c;
+            inCopy = true;
+            prevChar = c;
+            i++;
+            continue;
+        }
+
+        // Find the UTF-8 sequence starting here. A byte that doesn't start a valid one is a character of its own.
+        const size_t sequenceLength = Kernels::getUtf8SequenceLength(c);
+        size_t unitSize = 1;
+        while (unitSize < sequenceLength && i + unitSize < size && Kernels::isUtf8Continuation(data[i + unitSize]))
+        {
+            unitSize++;
+        }
+        if (unitSize < sequenceLength && i + unitSize == size)
+        {
+            // The rest of the sequence is in the next input
+            std::memcpy(partialUnit, data + i, unitSize);
+            partialUnitSize = unitSize;
+            prevChar = data[size - 1];
+            break;
+        }
+        appendUnit(data + i, unitSize == sequenceLength ? unitSize : 1);
+        i += unitSize == sequenceLength ? unitSize : 1;
+    }
+}
+
+// Completes the UTF-8 sequence the previous input ended with, returns the number of bytes of data that were used
+size_t RleStreamEncoder::completePartialUnit(const char* data, size_t size)
+{
+    const size_t sequenceLength = Kernels::getUtf8SequenceLength(partialUnit[0]);
+    size_t i = 0;
+    while (partialUnitSize < sequenceLength && i < size && Kernels::isUtf8Continuation(data[i]))
+    {
+        partialUnit[partialUnitSize++] = data[i++];
+    }
+    if (partialUnitSize < sequenceLength && i == size)
+    {
+        prevChar = partialUnit[partialUnitSize - 1];
+        return i;
+    }
+
+    char unit[sizeof(partialUnit)];
+    const size_t unitSize = partialUnitSize;
+    std::memcpy(unit, partialUnit, unitSize);
+    partialUnitSize = 0;
+    if (unitSize == sequenceLength)
+    {
+        appendUnit(unit, unitSize);
+    }
+    else
+    {
+        // Not a valid sequence after all, so each of its bytes is a character
+        for (size_t k = 0; k < unitSize; k++)
+        {
+            appendUnit(unit + k, 1);
+        }
+    }
+    return i;
+}
+
+// Continues the current run with the unit, or starts a new one
+void RleStreamEncoder::appendUnit(const char* unit, size_t unitSize)
+{
+    if (runLength > 0 && unitSize == runUnitSize && std::memcmp(unit, runUnit, unitSize) == 0)
+    {
+        runLength++;
+    }
+    else
+    {
+        flushRun();
+        std::memcpy(runUnit, unit, unitSize);
+        runUnitSize = unitSize;
+        runLength = 1;
+    }
+    prevChar = unit[unitSize - 1];
+}
+
+// Returns the number of bytes at the start of data that are repetitions of the run unit
+size_t RleStreamEncoder::countUnitRepeats(const char* data, size_t size) const
+{
+    if (runUnitSize == 1)
+    {
+        return Kernels::countRun(data, size, runUnit[0]);
+    }
+    size_t count = 0;
+    while (count + runUnitSize <= size && std::memcmp(data + count, runUnit, runUnitSize) == 0)
+    {
+        count += runUnitSize;
+    }
+    return count;
+}
+
+// Writes data to the output without run-length encoding it
+void RleStreamEncoder::appendVerbatim(const char* data, size_t size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+    flushRun();
+    output.append(data, size);
+    prevChar = data[size - 1];
+}
 
-        // Only encode when char occurs at least 4 times, since the min length of enc is 4
-        output += k >= 4 ? std::string(1, tmp) + "{" + std::to_string(k) + "}" : std::string(k, tmp);
-        i = i + k;
+void RleStreamEncoder::flushRun()
+{
+    // Only encode when char occurs at least 4 times, since the min length of enc is 4. Runs of a stray UTF-8
+    // continuation byte are left as they are, the decoder would take the byte as the end of the sequence before it.
+    if (runLength >= 4 && !(runUnitSize == 1 && Kernels::isUtf8Continuation(runUnit[0])))
+    {
+        char digits[24];
+        char* digitsEnd = std::to_chars(digits, digits + sizeof(digits), runLength).ptr;
+        output.append(runUnit, runUnitSize);
+        output += '{';
+        output.append(digits, digitsEnd);
+        output += '}';
+    }
+    else if (runUnitSize == 1)
+    {
+        output.append(runLength, runUnit[0]);
+    }
+    else
+    {
+        for (size_t i = 0; i < runLength; i++)
+        {
+            output.append(runUnit, runUnitSize);
+        }
     }
+    runLength = 0;
 
-    return output;
-}
\ No newline at end of file
+    // Whatever follows ends the UTF-8 sequence the input stopped in, so its bytes are characters of their own
+    output.append(partialUnit, partialUnitSize);
+    partialUnitSize = 0;
+}
+
+void RleStreamEncoder::flushOutput()
+{
+    if (sink && !output.empty())
+    {
+        sink(output);
+        output.clear();
+    }
+}
+
+} // namespace RP::Encoder
@@ -0,0 +1,388 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "encoder.h"
+#include "scan_kernels.h"
+#include "utils/logging.h"
+
+// Decoding mirrors the character stage of the encoder: outside of special tokens 'c{n}' is a run of n (at least 4)
+// copies of c, a '[' that doesn't follow a '\' starts a special token which is copied up to its closing ']', and a
+// token whose content ends in 'x<count>' is repeated count times. The c in front of a '{' is a whole UTF-8 sequence
+// if the bytes there form one, otherwise it is the single byte.
+//
+// The parser is written against an output policy, so the same code counts the decoded size (used to size the output
+// string up front), writes into that string and writes into a bounded buffer for the streaming version. The streaming
+// version decodes what it can of each chunk and holds back the rest.
+namespace
+{
+// Runs shorter than this are never encoded, so 'a{2}' in the encoded string is literal text
+constexpr size_t MIN_RUN_LENGTH = 4;
+
+// Counts longer than this can't come from the encoder and are treated as literal text
+constexpr size_t MAX_COUNT_DIGITS = 18;
+
+// Far larger than any recording. Runs and repeated tokens can claim up to 10^18 bytes each, so corrupt input is
+// rejected before it is decoded instead of wrapping the size or streaming for ages.
+constexpr size_t MAX_DECODED_SIZE = static_cast<size_t>(1) << 40;
+
+// Parses the decimal number in [begin, end). Returns 0 if it is empty, too long or has a leading zero, since the
+// encoder never writes such numbers.
+size_t parseCount(const char* begin, const char* end)
+{
+    const size_t digitCount = static_cast<size_t>(end - begin);
+    if (digitCount == 0 || digitCount > MAX_COUNT_DIGITS || *begin == '0')
+    {
+        return 0;
+    }
+
+    size_t count = 0;
+    for (const char* c = begin; c != end; c++)
+    {
+        if (*c < '0' || *c > '9')
+        {
+            return 0;
+        }
+        count = count * 10 + static_cast<size_t>(*c - '0');
+    }
+    return count;
+}
+
+// Throws std::runtime_error if count more pieces of pieceSize bytes take the output past MAX_DECODED_SIZE
+void checkDecodedSize(size_t decodedSize, size_t pieceSize, size_t count)
+{
+    // decodedSize is never past the limit, so this can't overflow
+    if (pieceSize != 0 && count > (MAX_DECODED_SIZE - decodedSize) / pieceSize)
+    {
+        throw std::runtime_error("Encoded data decodes to more than " + std::to_string(MAX_DECODED_SIZE) +
+                                 " bytes, it is corrupt");
+    }
+}
+
+class SizeCounter
+{
+  public:
+    void append(const char*, size_t size)
+    {
+        appendRun(nullptr, size, 1);
+    }
+
+    void appendRun(const char*, size_t unitSize, size_t count)
+    {
+        checkDecodedSize(decodedSize, unitSize, count);
+        decodedSize += unitSize * count;
+    }
+
+    void appendToken(std::string_view content, size_t count)
+    {
+        appendRun(nullptr, content.size() + 2, count);
+    }
+
+    size_t decodedSize = 0;
+};
+
+// Writes into memory that was sized with SizeCounter, which also checked the size
+class BufferWriter
+{
+  public:
+    explicit BufferWriter(char* buffer) : position(buffer)
+    {
+    }
+
+    void append(const char* data, size_t size)
+    {
+        std::memcpy(position, data, size);
+        position += size;
+    }
+
+    void appendRun(const char* unit, size_t unitSize, size_t count)
+    {
+        if (unitSize == 1)
+        {
+            std::memset(position, *unit, count);
+            position += count;
+            return;
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            std::memcpy(position, unit, unitSize);
+            position += unitSize;
+        }
+    }
+
+    void appendToken(std::string_view content, size_t count)
+    {
+        // Write the token once, then copy it for the remaining repetitions
+        char* token = position;
+        *position++ = '[';
+        append(content.data(), content.size());
+        *position++ = ']';
+        const size_t tokenSize = content.size() + 2;
+        for (size_t i = 1; i < count; i++)
+        {
+            std::memcpy(position, token, tokenSize);
+            position += tokenSize;
+        }
+    }
+
+  private:
+    char* position;
+};
+
+// Collects decoded output in a buffer of bounded size and hands it to the sink whenever it is full. The buffer and
+// the decoded size belong to RleStreamDecoder, so they carry over from one chunk to the next.
+class SinkWriter
+{
+  public:
+    static constexpr size_t BUFFER_SIZE = RP::Encoder::RleStreamDecoder::OUTPUT_BUFFER_SIZE;
+
+    SinkWriter(const RP::Encoder::RleStreamEncoder::Sink& sink, std::string& buffer, size_t& decodedSize)
+        : sink(sink), buffer(buffer), decodedSize(decodedSize)
+    {
+    }
+
+    void append(const char* data, size_t size)
+    {
+        checkDecodedSize(decodedSize, size, 1);
+        decodedSize += size;
+        while (size > 0)
+        {
+            const size_t count = std::min(size, BUFFER_SIZE - buffer.size());
+            buffer.append(data, count);
+            data += count;
+            size -= count;
+            flushIfFull();
+        }
+    }
+
+    void appendRun(const char* unit, size_t unitSize, size_t count)
+    {
+        // Checked up front, so a corrupt count is rejected before any of the run is handed to the sink
+        checkDecodedSize(decodedSize, unitSize, count);
+        if (unitSize > 1)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                append(unit, unitSize);
+            }
+            return;
+        }
+        decodedSize += count;
+        while (count > 0)
+        {
+            const size_t fill = std::min(count, BUFFER_SIZE - buffer.size());
+            buffer.append(fill, *unit);
+            count -= fill;
+            flushIfFull();
+        }
+    }
+
+    void appendToken(std::string_view content, size_t count)
+    {
+        checkDecodedSize(decodedSize, content.size() + 2, count);
+        for (size_t i = 0; i < count; i++)
+        {
+            append("[", 1);
+            append(content.data(), content.size());
+            append("]", 1);
+        }
+    }
+
+    void flush()
+    {
+        if (!buffer.empty())
+        {
+            sink(buffer);
+            buffer.clear();
+        }
+    }
+
+  private:
+    void flushIfFull()
+    {
+        if (buffer.size() == BUFFER_SIZE)
+        {
+            flush();
+        }
+    }
+
+    const RP::Encoder::RleStreamEncoder::Sink& sink;
+    std::string& buffer;
+    size_t& decodedSize;
+};
+
+// Returns the index of the first occurrence of c at or after 'from', or size if there is none
+size_t findByte(const char* data, size_t size, size_t from, char c)
+{
+    if (from >= size)
+    {
+        return size;
+    }
+    const void* found = std::memchr(data + from, c, size - from);
+    return found ? static_cast<size_t>(static_cast<const char*>(found) - data) : size;
+}
+
+// Decodes encoded and returns the number of bytes decoded. prevChar is the last decoded character, a '[' right after a
+// '\' is escaped, and is updated for the next call. Unless final, decoding stops in front of anything that may
+// continue in the next input, see RleStreamDecoder.
+template <typename Output> size_t decode(std::string_view encoded, Output& output, char& prevChar, bool final)
+{
+    const char* data = encoded.data();
+    const size_t size = encoded.size();
+    // A run count may follow the last character, which is up to four bytes long
+    const size_t decodeEnd = final ? size : size - std::min<size_t>(size, 4);
+    size_t i = 0;
+
+    // Positions of the next '[' and of the next '{' after the current character, only searched again once passed.
+    // runStart is where the character in front of nextBrace starts.
+    size_t nextOpen = findByte(data, size, 0, '[');
+    size_t nextBrace = findByte(data, size, 1, '{');
+    size_t runStart = nextBrace < size ? RP::Encoder::Kernels::findUtf8CharacterStart(data, 0, nextBrace) : size - 1;
+
+    while (i < decodeEnd)
+    {
+        if (nextOpen < i)
+        {
+            nextOpen = findByte(data, size, i, '[');
+        }
+        if (nextBrace <= i)
+        {
+            nextBrace = findByte(data, size, i + 1, '{');
+            runStart = nextBrace < size ? RP::Encoder::Kernels::findUtf8CharacterStart(data, i, nextBrace) : size - 1;
+        }
+
+        // Copy literal text up to the next token or the character in front of the next run
+        const size_t end = std::min({nextOpen, runStart, decodeEnd});
+        if (end > i)
+        {
+            output.append(data + i, end - i);
+            prevChar = data[end - 1];
+            i = end;
+            continue;
+        }
+
+        const char c = data[i];
+        if (i == nextOpen && prevChar != '\\')
+        {
+            // Find the closing character of the token (']'), it must not be escaped
+            size_t close = i + 1;
+            while (close < size && !(data[close] == ']' && data[close - 1] != '\\'))
+            {
+                close = findByte(data, size, close + 1, ']');
+            }
+            if (close == size && !final)
+            {
+                return i;
+            }
+            if (close == size)
+            {
+                // Unclosed token, the encoder copied the rest of the input as is
+                output.append(data + i, size - i);
+                return size;
+            }
+
+            const std::string_view content(data + i + 1, close - i - 1);
+            const size_t countStart = content.find_last_not_of("0123456789");
+            const size_t count = countStart == std::string_view::npos || content[countStart] != 'x' || countStart == 0
+                                     ? 0
+                                     : parseCount(content.data() + countStart + 1, content.data() + content.size());
+            if (count > 0)
+            {
+                output.appendToken(content.substr(0, countStart), count);
+            }
+            else
+            {
+                output.append(data + i, close + 1 - i);
+            }
+            prevChar = ']';
+            i = close + 1;
+            continue;
+        }
+
+        if (i == runStart && nextBrace < size)
+        {
+            // 'c{n}' is a run of c
+            const size_t limit = std::min(size, nextBrace + 2 + MAX_COUNT_DIGITS);
+            const size_t close = findByte(data, limit, nextBrace + 1, '}');
+            if (close == size && !final)
+            {
+                return i;
+            }
+            const size_t count = close == limit ? 0 : parseCount(data + nextBrace + 1, data + close);
+            if (count >= MIN_RUN_LENGTH)
+            {
+                output.appendRun(data + i, nextBrace - i, count);
+                prevChar = data[nextBrace - 1];
+                i = close + 1;
+                continue;
+            }
+        }
+
+        output.append(&c, 1);
+        prevChar = c;
+        i++;
+    }
+    return i;
+}
+} // namespace
+
+namespace RP::Encoder
+{
+std::string rleDecode(std::string_view encodedString)
+{
+    SizeCounter counter;
+    char prevChar = '\0';
+    decode(encodedString, counter, prevChar, true);
+
+    std::string decodedString(counter.decodedSize, '\0');
+    BufferWriter writer(decodedString.data());
+    prevChar = '\0';
+    decode(encodedString, writer, prevChar, true);
+
+    LOG_DEBUG("Decoded {} bytes into {} bytes", encodedString.size(), decodedString.size());
+    return decodedString;
+}
+
+void rleDecode(std::string_view encodedString, const RleStreamEncoder::Sink& sink)
+{
+    RleStreamDecoder decoder(sink);
+    decoder.feed(encodedString);
+    decoder.finish();
+}
+
+RleStreamDecoder::RleStreamDecoder(RleStreamEncoder::Sink sink) : sink(std::move(sink))
+{
+    output.reserve(OUTPUT_BUFFER_SIZE);
+}
+
+void RleStreamDecoder::feed(std::string_view chunk)
+{
+    SinkWriter writer(sink, output, decodedSize);
+    if (pending.empty())
+    {
+        // Decode straight from the chunk, only what is held back is copied
+        pending.assign(chunk.substr(decode(chunk, writer, prevChar, false)));
+    }
+    else
+    {
+        const bool canClose = !pendingToken || chunk.find(']') != std::string_view::npos;
+        pending.append(chunk);
+        if (!canClose)
+        {
+            // Don't decode a long unclosed token again for every chunk
+            return;
+        }
+        pending.erase(0, decode(pending, writer, prevChar, false));
+    }
+    pendingToken =
+        !pending.empty() && pending[0] == '[' && prevChar != '\\' && pending.find(']') == std::string::npos;
+}
+
+void RleStreamDecoder::finish()
+{
+    SinkWriter writer(sink, output, decodedSize);
+    decode(pending, writer, prevChar, true);
+    pending.clear();
+    writer.flush();
+}
+} // namespace RP::Encoder
@@ -0,0 +1,421 @@
+#include "scan_kernels.h"
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define RP_X86_64_SIMD 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC compiles AVX2 intrinsics without extra flags, GCC and Clang need the target enabled per function
+#if defined(__GNUC__) || defined(__clang__)
+#define RP_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define RP_TARGET_AVX2
+#endif
+
+namespace RP::Encoder::Kernels
+{
+namespace
+{
+bool isDelimiter(char c)
+{
+    return c == '[' || c == ']' || c == '\\';
+}
+
+// --- Scalar kernels, also used for the tail of the SIMD kernels --- //
+
+size_t findDelimiterScalar(const char* data, size_t size, size_t from = 0)
+{
+    for (size_t i = from; i < size; i++)
+    {
+        if (isDelimiter(data[i]))
+        {
+            return i;
+        }
+    }
+    return size;
+}
+
+size_t countRunScalar(const char* data, size_t size, char c, size_t from = 0)
+{
+    size_t i = from;
+    while (i < size && data[i] == c)
+    {
+        i++;
+    }
+    return i;
+}
+
+size_t findRepeatScalar(const char* data, size_t size, size_t from = 0)
+{
+    for (size_t i = from; i + 1 < size; i++)
+    {
+        if (data[i] == data[i + 1])
+        {
+            return i;
+        }
+    }
+    return size;
+}
+
+size_t findNonAsciiScalar(const char* data, size_t size, size_t from = 0)
+{
+    for (size_t i = from; i < size; i++)
+    {
+        if (static_cast<unsigned char>(data[i]) >= 0x80)
+        {
+            return i;
+        }
+    }
+    return size;
+}
+
+size_t countBase64Scalar(const char* data, size_t size, size_t from = 0)
+{
+    size_t i = from;
+    while (i < size && isBase64Character(data[i]))
+    {
+        i++;
+    }
+    return i;
+}
+
+#ifdef RP_X86_64_SIMD
+
+inline unsigned countTrailingZeros(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+// --- SSE2 kernels, SSE2 is always available on x86-64 --- //
+
+size_t findDelimiterSSE2(const char* data, size_t size)
+{
+    const __m128i open = _mm_set1_epi8('[');
+    const __m128i close = _mm_set1_epi8(']');
+    const __m128i escape = _mm_set1_epi8('\\');
+
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const __m128i matches = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, open), _mm_cmpeq_epi8(block, close)),
+                                             _mm_cmpeq_epi8(block, escape));
+        const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(matches));
+        if (mask != 0)
+        {
+            return i + countTrailingZeros(mask);
+        }
+    }
+    return findDelimiterScalar(data, size, i);
+}
+
+size_t countRunSSE2(const char* data, size_t size, char c)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+        if (mask != 0xFFFF)
+        {
+            return i + countTrailingZeros(~mask);
+        }
+    }
+    return countRunScalar(data, size, c, i);
+}
+
+size_t findRepeatSSE2(const char* data, size_t size)
+{
+    // Compare every byte with the one after it
+    size_t i = 0;
+    for (; i + 17 <= size; i += 16)
+    {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 1));
+        const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, next)));
+        if (mask != 0)
+        {
+            return i + countTrailingZeros(mask);
+        }
+    }
+    return findRepeatScalar(data, size, i);
+}
+
+size_t findNonAsciiSSE2(const char* data, size_t size)
+{
+    // The mask is made of the high bits of the bytes
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(block));
+        if (mask != 0)
+        {
+            return i + countTrailingZeros(mask);
+        }
+    }
+    return findNonAsciiScalar(data, size, i);
+}
+
+// Bytes are compared as signed values, so everything outside of ASCII is negative and never in a range
+inline __m128i isInRangeSSE2(__m128i block, char low, char high)
+{
+    return _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8(static_cast<char>(low - 1))),
+                         _mm_cmplt_epi8(block, _mm_set1_epi8(static_cast<char>(high + 1))));
+}
+
+size_t countBase64SSE2(const char* data, size_t size)
+{
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const __m128i letters = _mm_or_si128(isInRangeSSE2(block, 'A', 'Z'), isInRangeSSE2(block, 'a', 'z'));
+        const __m128i symbols = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('+')),
+                                                          _mm_cmpeq_epi8(block, _mm_set1_epi8('/'))),
+                                             _mm_cmpeq_epi8(block, _mm_set1_epi8('=')));
+        const __m128i matches = _mm_or_si128(_mm_or_si128(letters, isInRangeSSE2(block, '0', '9')), symbols);
+        const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(matches));
+        if (mask != 0xFFFF)
+        {
+            return i + countTrailingZeros(~mask);
+        }
+    }
+    return countBase64Scalar(data, size, i);
+}
+
+// --- AVX2 kernels --- //
+
+RP_TARGET_AVX2 size_t findDelimiterAVX2(const char* data, size_t size)
+{
+    const __m256i open = _mm256_set1_epi8('[');
+    const __m256i close = _mm256_set1_epi8(']');
+    const __m256i escape = _mm256_set1_epi8('\\');
+
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        const __m256i matches =
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, open), _mm256_cmpeq_epi8(block, close)),
+                            _mm256_cmpeq_epi8(block, escape));
+        const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(matches));
+        if (mask != 0)
+        {
+            return i + countTrailingZeros(mask);
+        }
+    }
+    return findDelimiterScalar(data, size, i);
+}
+
+RP_TARGET_AVX2 size_t countRunAVX2(const char* data, size_t size, char c)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+        if (mask != 0xFFFFFFFF)
+        {
+            return i + countTrailingZeros(~mask);
+        }
+    }
+    return countRunScalar(data, size, c, i);
+}
+
+RP_TARGET_AVX2 size_t findRepeatAVX2(const char* data, size_t size)
+{
+    size_t i = 0;
+    for (; i + 33 <= size; i += 32)
+    {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        const __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 1));
+        const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, next)));
+        if (mask != 0)
+        {
+            return i + countTrailingZeros(mask);
+        }
+    }
+    return findRepeatScalar(data, size, i);
+}
+
+RP_TARGET_AVX2 size_t findNonAsciiAVX2(const char* data, size_t size)
+{
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(block));
+        if (mask != 0)
+        {
+            return i + countTrailingZeros(mask);
+        }
+    }
+    return findNonAsciiScalar(data, size, i);
+}
+
+RP_TARGET_AVX2 inline __m256i isInRangeAVX2(__m256i block, char low, char high)
+{
+    return _mm256_and_si256(_mm256_cmpgt_epi8(block, _mm256_set1_epi8(static_cast<char>(low - 1))),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(high + 1)), block));
+}
+
+RP_TARGET_AVX2 size_t countBase64AVX2(const char* data, size_t size)
+{
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        const __m256i letters = _mm256_or_si256(isInRangeAVX2(block, 'A', 'Z'), isInRangeAVX2(block, 'a', 'z'));
+        const __m256i symbols = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('+')),
+                                                                _mm256_cmpeq_epi8(block, _mm256_set1_epi8('/'))),
+                                                _mm256_cmpeq_epi8(block, _mm256_set1_epi8('=')));
+        const __m256i matches = _mm256_or_si256(_mm256_or_si256(letters, isInRangeAVX2(block, '0', '9')), symbols);
+        const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(matches));
+        if (mask != 0xFFFFFFFF)
+        {
+            return i + countTrailingZeros(~mask);
+        }
+    }
+    return countBase64Scalar(data, size, i);
+}
+
+#endif
+
+struct KernelTable
+{
+    SimdLevel level;
+    size_t (*findDelimiter)(const char*, size_t);
+    size_t (*countRun)(const char*, size_t, char);
+    size_t (*findRepeat)(const char*, size_t);
+    size_t (*findNonAscii)(const char*, size_t);
+    size_t (*countBase64)(const char*, size_t);
+};
+
+KernelTable getKernelTable(SimdLevel level)
+{
+    switch (level)
+    {
+#ifdef RP_X86_64_SIMD
+    case SimdLevel::AVX2:
+        return {SimdLevel::AVX2, findDelimiterAVX2, countRunAVX2, findRepeatAVX2, findNonAsciiAVX2, countBase64AVX2};
+    case SimdLevel::SSE2:
+        return {SimdLevel::SSE2, findDelimiterSSE2, countRunSSE2, findRepeatSSE2, findNonAsciiSSE2, countBase64SSE2};
+#endif
+    default:
+        return {SimdLevel::Scalar, [](const char* data, size_t size) { return findDelimiterScalar(data, size); },
+                [](const char* data, size_t size, char c) { return countRunScalar(data, size, c); },
+                [](const char* data, size_t size) { return findRepeatScalar(data, size); },
+                [](const char* data, size_t size) { return findNonAsciiScalar(data, size); },
+                [](const char* data, size_t size) { return countBase64Scalar(data, size); }};
+    }
+}
+
+// Picked on the first call, so scans from static initializers of other translation units work too
+const KernelTable& getActiveKernels()
+{
+    static const KernelTable activeKernels = getKernelTable(detectSimdLevel());
+    return activeKernels;
+}
+} // namespace
+
+SimdLevel detectSimdLevel()
+{
+#ifdef RP_X86_64_SIMD
+#ifdef _MSC_VER
+    // AVX2 support is reported in EBX bit 5 of leaf 7, and the OS must save the YMM registers (XCR0 bits 1 and 2)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7)
+    {
+        __cpuid(info, 1);
+        const bool osSavesYmm = (info[2] & (1 << 27)) && ((_xgetbv(0) & 0x6) == 0x6);
+        __cpuidex(info, 7, 0);
+        if (osSavesYmm && (info[1] & (1 << 5)))
+        {
+            return SimdLevel::AVX2;
+        }
+    }
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return SimdLevel::AVX2;
+    }
+#endif
+    return SimdLevel::SSE2;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+SimdLevel getActiveSimdLevel()
+{
+    return getActiveKernels().level;
+}
+
+size_t findDelimiter(const char* data, size_t size)
+{
+    return getActiveKernels().findDelimiter(data, size);
+}
+
+size_t findDelimiter(const char* data, size_t size, SimdLevel level)
+{
+    return getKernelTable(level).findDelimiter(data, size);
+}
+
+size_t countRun(const char* data, size_t size, char c)
+{
+    return getActiveKernels().countRun(data, size, c);
+}
+
+size_t countRun(const char* data, size_t size, char c, SimdLevel level)
+{
+    return getKernelTable(level).countRun(data, size, c);
+}
+
+size_t findRepeat(const char* data, size_t size)
+{
+    return getActiveKernels().findRepeat(data, size);
+}
+
+size_t findRepeat(const char* data, size_t size, SimdLevel level)
+{
+    return getKernelTable(level).findRepeat(data, size);
+}
+
+size_t findNonAscii(const char* data, size_t size)
+{
+    return getActiveKernels().findNonAscii(data, size);
+}
+
+size_t findNonAscii(const char* data, size_t size, SimdLevel level)
+{
+    return getKernelTable(level).findNonAscii(data, size);
+}
+
+size_t countBase64(const char* data, size_t size)
+{
+    return getActiveKernels().countBase64(data, size);
+}
+
+size_t countBase64(const char* data, size_t size, SimdLevel level)
+{
+    return getKernelTable(level).countBase64(data, size);
+}
+} // namespace RP::Encoder::Kernels
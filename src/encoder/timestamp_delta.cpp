@@ -0,0 +1,248 @@
+#include "timestamp_delta.h"
+#include <charconv>
+
+namespace
+{
+using RP::Tokens::TokenId;
+
+// Written by UserWindowActivityEventSource between the window title and the timestamp
+constexpr std::string_view TIMESTAMP_MARKER = "\" TIMESTAMP: ";
+
+int minuteOfDay(const RP::Utils::LLMReadableTimestamp& timestamp)
+{
+    return timestamp.hour * 60 + timestamp.minute;
+}
+
+bool isSameDay(const RP::Utils::LLMReadableTimestamp& a, const RP::Utils::LLMReadableTimestamp& b)
+{
+    return a.year == b.year && a.month == b.month && a.day == b.day;
+}
+} // namespace
+
+namespace RP::Encoder
+{
+TimestampDeltaStage::TimestampDeltaStage(RleStreamEncoder::Sink sink, Direction direction, size_t outputBufferSize)
+    : direction(direction), output(std::move(sink), outputBufferSize)
+{
+    timestamp.reserve(MAX_TIMESTAMP_LENGTH);
+}
+
+void TimestampDeltaStage::feed(std::string_view chunk)
+{
+    scanner.feed(chunk, *this);
+}
+
+void TimestampDeltaStage::finish()
+{
+    scanner.finish(*this);
+    if (collectingTimestamp)
+    {
+        flushTimestamp();
+    }
+    output.flush();
+}
+
+size_t TimestampDeltaStage::getDeltaCount() const
+{
+    return deltaCount;
+}
+
+void TimestampDeltaStage::onText(const char* data, size_t size)
+{
+    if (inRecord)
+    {
+        appendRecordText(data, size);
+        return;
+    }
+    output.append(data, size);
+}
+
+void TimestampDeltaStage::onToken(std::string_view content)
+{
+    const TokenId tokenId = RP::Tokens::lookupToken(content);
+    if (!inRecord)
+    {
+        inRecord = tokenId == TokenId::ChangeWindow;
+        markerMatched = 0;
+    }
+    else if (tokenId == TokenId::ChangeWindowEnd)
+    {
+        endRecord();
+        inRecord = false;
+    }
+    else
+    {
+        // Brackets in a window title are part of the record text
+        appendRecordText("[", 1);
+        appendRecordText(content.data(), content.size());
+        appendRecordText("]", 1);
+        return;
+    }
+
+    output.append("[", 1);
+    output.append(content.data(), content.size());
+    output.append("]", 1);
+}
+
+// The rest of the input is copied as is
+void TimestampDeltaStage::onUnclosedToken(std::string_view content)
+{
+    if (inRecord)
+    {
+        appendRecordText("[", 1);
+        appendRecordText(content.data(), content.size());
+        return;
+    }
+    output.append("[", 1);
+    output.append(content.data(), content.size());
+}
+
+void TimestampDeltaStage::appendRecordText(const char* data, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        const char c = data[i];
+        if (!collectingTimestamp)
+        {
+            output.append(&c, 1);
+        }
+        else if (direction == Direction::Decode && !escaped && c == '+' && timestamp == "+")
+        {
+            escaped = true;
+        }
+        else if (timestamp.size() < MAX_TIMESTAMP_LENGTH)
+        {
+            timestamp += c;
+        }
+        else
+        {
+            // Too long to be a timestamp
+            flushTimestamp();
+            output.append(&c, 1);
+        }
+
+        if (c == TIMESTAMP_MARKER[markerMatched])
+        {
+            markerMatched++;
+        }
+        else
+        {
+            // The marker starts with the only '"' in it, so a partial match can only restart at this character
+            markerMatched = c == TIMESTAMP_MARKER[0] ? 1 : 0;
+        }
+        if (markerMatched == TIMESTAMP_MARKER.size())
+        {
+            // Only the text after the last marker is the timestamp
+            if (collectingTimestamp)
+            {
+                flushTimestamp();
+            }
+            markerMatched = 0;
+            collectingTimestamp = true;
+        }
+    }
+}
+
+void TimestampDeltaStage::flushTimestamp()
+{
+    if (direction == Direction::Encode && !timestamp.empty() && timestamp[0] == '+')
+    {
+        output.append("+", 1);
+    }
+    output.append(timestamp.data(), timestamp.size());
+    timestamp.clear();
+    escaped = false;
+    collectingTimestamp = false;
+}
+
+void TimestampDeltaStage::endRecord()
+{
+    if (!collectingTimestamp)
+    {
+        hasPreviousTimestamp = false;
+        return;
+    }
+
+    if (direction == Direction::Decode && !escaped && !timestamp.empty() && timestamp[0] == '+' && expandDelta())
+    {
+        deltaCount++;
+    }
+
+    // When decoding, the timestamp is the expanded one here, so both directions see the same timestamps
+    RP::Utils::LLMReadableTimestamp parsed{};
+    const bool isTimestamp = RP::Utils::parseLLMReadableTimestamp(timestamp, parsed);
+    if (direction == Direction::Encode && isTimestamp && writeDelta(parsed))
+    {
+        deltaCount++;
+        timestamp.clear();
+        collectingTimestamp = false;
+    }
+    else
+    {
+        flushTimestamp();
+    }
+
+    hasPreviousTimestamp = isTimestamp;
+    previousTimestamp = parsed;
+}
+
+// Writes the timestamp as the minutes since the previous one, returns false if it needs to be written in full
+bool TimestampDeltaStage::writeDelta(const RP::Utils::LLMReadableTimestamp& current)
+{
+    if (!hasPreviousTimestamp || !isSameDay(current, previousTimestamp))
+    {
+        return false;
+    }
+    const int delta = minuteOfDay(current) - minuteOfDay(previousTimestamp);
+    if (delta < 0 || delta > MAX_DELTA_MINUTES)
+    {
+        return false;
+    }
+
+    char deltaText[8] = {'+'};
+    char* end = std::to_chars(deltaText + 1, deltaText + sizeof(deltaText) - 1, delta).ptr;
+    *end++ = 'm';
+    output.append(deltaText, end - deltaText);
+    return true;
+}
+
+// Replaces a '+<minutes>m' delta in timestamp with the full timestamp, returns false if it isn't a valid delta
+bool TimestampDeltaStage::expandDelta()
+{
+    int delta = 0;
+    const char* begin = timestamp.data() + 1;
+    const char* end = timestamp.data() + timestamp.size();
+    const auto result = std::from_chars(begin, end, delta);
+    if (!hasPreviousTimestamp || result.ec != std::errc() || result.ptr + 1 != end || *result.ptr != 'm' ||
+        delta < 0 || delta > MAX_DELTA_MINUTES || minuteOfDay(previousTimestamp) + delta >= 24 * 60)
+    {
+        return false;
+    }
+
+    RP::Utils::LLMReadableTimestamp expanded = previousTimestamp;
+    expanded.hour = (minuteOfDay(previousTimestamp) + delta) / 60;
+    expanded.minute = (minuteOfDay(previousTimestamp) + delta) % 60;
+    char formatted[RP::Utils::MAX_LLM_READABLE_TIMESTAMP_LENGTH];
+    const size_t length = RP::Utils::formatTimestampToLLMReadable(expanded, formatted, sizeof(formatted));
+    if (length == 0)
+    {
+        return false;
+    }
+    timestamp.assign(formatted, length);
+    return true;
+}
+
+void timestampDeltaDecode(std::string_view encodedString, const RleStreamEncoder::Sink& sink)
+{
+    TimestampDeltaStage stage(sink, TimestampDeltaStage::Direction::Decode);
+    stage.feed(encodedString);
+    stage.finish();
+}
+
+std::string timestampDeltaDecode(std::string_view encodedString)
+{
+    std::string decoded;
+    timestampDeltaDecode(encodedString, [&decoded](std::string_view piece) { decoded.append(piece); });
+    return decoded;
+}
+} // namespace RP::Encoder
@@ -0,0 +1,100 @@
+#include "token_filter.h"
+
+namespace
+{
+using RP::Tokens::TokenId;
+
+bool contains(const RP::Encoder::TokenSet& tokens, TokenId tokenId)
+{
+    return tokenId != TokenId::Unknown && tokens.test(static_cast<size_t>(tokenId));
+}
+} // namespace
+
+namespace RP::Encoder
+{
+TokenFilterStage::TokenFilterStage(RleStreamEncoder::Sink sink, const TokenSet& removedTokens, size_t outputBufferSize)
+    : removedTokens(removedTokens), output(std::move(sink), outputBufferSize)
+{
+    // End tokens go with their records. One outside of a record is only removed if every record it can end is.
+    this->removedTokens.set(static_cast<size_t>(TokenId::ChangeWindowEnd));
+    this->removedTokens.set(static_cast<size_t>(TokenId::ScreenshotEnd));
+    for (size_t id = 0; id < RP::Tokens::TOKEN_COUNT; id++)
+    {
+        const TokenId endToken = RP::Tokens::getRecordEndToken(static_cast<TokenId>(id));
+        if (endToken != TokenId::Unknown && !removedTokens.test(id))
+        {
+            this->removedTokens.reset(static_cast<size_t>(endToken));
+        }
+    }
+}
+
+void TokenFilterStage::feed(std::string_view chunk)
+{
+    scanner.feed(chunk, *this);
+}
+
+void TokenFilterStage::finish()
+{
+    scanner.finish(*this);
+    output.flush();
+}
+
+size_t TokenFilterStage::getRemovedTokenCount() const
+{
+    return removedTokenCount;
+}
+
+void TokenFilterStage::onText(const char* data, size_t size)
+{
+    if (skippingRecord)
+    {
+        return;
+    }
+    output.append(data, size);
+}
+
+void TokenFilterStage::onToken(std::string_view content)
+{
+    const TokenId tokenId = RP::Tokens::lookupToken(content);
+
+    if (recordEndToken != TokenId::Unknown)
+    {
+        // Everything in a record is copied or skipped as a whole
+        const bool skipped = skippingRecord;
+        if (tokenId == recordEndToken)
+        {
+            recordEndToken = TokenId::Unknown;
+            skippingRecord = false;
+        }
+        if (skipped)
+        {
+            return;
+        }
+    }
+    else
+    {
+        recordEndToken = RP::Tokens::getRecordEndToken(tokenId);
+        if (contains(removedTokens, tokenId))
+        {
+            removedTokenCount++;
+            skippingRecord = recordEndToken != TokenId::Unknown;
+            return;
+        }
+    }
+
+    output.append("[", 1);
+    output.append(content.data(), content.size());
+    output.append("]", 1);
+}
+
+// The rest of the input is copied as is, unless it is part of a removed record
+void TokenFilterStage::onUnclosedToken(std::string_view content)
+{
+    if (skippingRecord)
+    {
+        return;
+    }
+    output.append("[", 1);
+    output.append(content.data(), content.size());
+}
+} // namespace RP::Encoder
@@ -0,0 +1,226 @@
+#include "window_storm.h"
+#include <charconv>
+
+namespace
+{
+using RP::Tokens::TokenId;
+
+// Written by UserWindowActivityEventSource between the window title and the timestamp
+constexpr std::string_view TIMESTAMP_MARKER = "\" TIMESTAMP: ";
+// Text between window change records that doesn't count as activity
+constexpr std::string_view IDLE_CHARACTERS = "\r\n ";
+
+// Keys pressed to switch windows, they don't count as activity between window change records
+bool isWindowSwitchKey(TokenId tokenId)
+{
+    return tokenId == TokenId::Alt || tokenId == TokenId::AltTab || tokenId == TokenId::Tab ||
+           tokenId == TokenId::LeftShift || tokenId == TokenId::RightShift;
+}
+
+// Returns false if the record has no timestamp in the format UserWindowActivityEventSource writes
+bool parseRecordTimestamp(std::string_view record, RP::Utils::LLMReadableTimestamp& timestamp)
+{
+    const std::string_view endToken = RP::Tokens::getTokenString(TokenId::ChangeWindowEnd);
+    const size_t marker = record.rfind(TIMESTAMP_MARKER);
+    if (marker == std::string_view::npos || record.size() < marker + TIMESTAMP_MARKER.size() + endToken.size())
+    {
+        return false;
+    }
+    const size_t start = marker + TIMESTAMP_MARKER.size();
+    return RP::Utils::parseLLMReadableTimestamp(record.substr(start, record.size() - endToken.size() - start),
+                                                timestamp);
+}
+} // namespace
+
+namespace RP::Encoder
+{
+WindowStormStage::WindowStormStage(RleStreamEncoder::Sink sink, int maxGapMinutes, size_t outputBufferSize)
+    : maxGapMinutes(maxGapMinutes), output(std::move(sink), outputBufferSize)
+{
+    record.reserve(MAX_HELD_SIZE);
+    heldRecord.reserve(MAX_HELD_SIZE);
+    idle.reserve(MAX_HELD_SIZE);
+}
+
+void WindowStormStage::feed(std::string_view chunk)
+{
+    scanner.feed(chunk, *this);
+}
+
+void WindowStormStage::finish()
+{
+    scanner.finish(*this);
+    flushHeld();
+    if (inRecord && !copyingRecord)
+    {
+        output.append(record.data(), record.size());
+    }
+    output.flush();
+}
+
+size_t WindowStormStage::getCollapsedRecordCount() const
+{
+    return collapsedRecordCount;
+}
+
+void WindowStormStage::onText(const char* data, size_t size)
+{
+    if (inRecord)
+    {
+        appendRecord(data, size);
+        return;
+    }
+    if (!heldRecord.empty())
+    {
+        if (std::string_view(data, size).find_first_not_of(IDLE_CHARACTERS) == std::string_view::npos)
+        {
+            appendIdle(data, size);
+            return;
+        }
+        flushHeld();
+    }
+    output.append(data, size);
+}
+
+void WindowStormStage::onToken(std::string_view content)
+{
+    const TokenId tokenId = RP::Tokens::lookupToken(content);
+    if (inRecord)
+    {
+        appendRecord("[", 1);
+        appendRecord(content.data(), content.size());
+        appendRecord("]", 1);
+        if (tokenId == TokenId::ChangeWindowEnd)
+        {
+            endRecord();
+        }
+        return;
+    }
+
+    if (tokenId == TokenId::ChangeWindow)
+    {
+        inRecord = true;
+        appendRecord("[", 1);
+        appendRecord(content.data(), content.size());
+        appendRecord("]", 1);
+        return;
+    }
+    if (!heldRecord.empty() && isWindowSwitchKey(tokenId))
+    {
+        appendIdle("[", 1);
+        appendIdle(content.data(), content.size());
+        appendIdle("]", 1);
+        return;
+    }
+
+    flushHeld();
+    output.append("[", 1);
+    output.append(content.data(), content.size());
+    output.append("]", 1);
+}
+
+// The rest of the input is copied as is
+void WindowStormStage::onUnclosedToken(std::string_view content)
+{
+    if (inRecord)
+    {
+        appendRecord("[", 1);
+        appendRecord(content.data(), content.size());
+        return;
+    }
+    flushHeld();
+    output.append("[", 1);
+    output.append(content.data(), content.size());
+}
+
+void WindowStormStage::appendRecord(const char* data, size_t size)
+{
+    if (!copyingRecord && record.size() + size > MAX_HELD_SIZE)
+    {
+        // Too long to hold back, write out what came before it and copy the rest of the record
+        flushHeld();
+        output.append(record.data(), record.size());
+        record.clear();
+        copyingRecord = true;
+    }
+    if (copyingRecord)
+    {
+        output.append(data, size);
+    }
+    else
+    {
+        record.append(data, size);
+    }
+}
+
+void WindowStormStage::appendIdle(const char* data, size_t size)
+{
+    if (idle.size() + size > MAX_HELD_SIZE)
+    {
+        flushHeld();
+        output.append(data, size);
+        return;
+    }
+    idle.append(data, size);
+}
+
+void WindowStormStage::endRecord()
+{
+    inRecord = false;
+    if (copyingRecord)
+    {
+        copyingRecord = false;
+        return;
+    }
+
+    RP::Utils::LLMReadableTimestamp timestamp{};
+    const bool hasTimestamp = parseRecordTimestamp(record, timestamp);
+    const int gap = (timestamp.hour - heldTimestamp.hour) * 60 + timestamp.minute - heldTimestamp.minute;
+    if (!heldRecord.empty() && heldHasTimestamp && hasTimestamp && timestamp.year == heldTimestamp.year &&
+        timestamp.month == heldTimestamp.month && timestamp.day == heldTimestamp.day && gap >= 0 &&
+        gap <= maxGapMinutes)
+    {
+        // The held window was only passed through, this record replaces it
+        heldWindowCount++;
+        collapsedRecordCount++;
+        idle.clear();
+    }
+    else
+    {
+        flushHeld();
+    }
+
+    heldRecord.swap(record);
+    record.clear();
+    heldHasTimestamp = hasTimestamp;
+    heldTimestamp = timestamp;
+}
+
+void WindowStormStage::flushHeld()
+{
+    if (heldRecord.empty())
+    {
+        return;
+    }
+
+    if (heldWindowCount > 0)
+    {
+        const std::string_view startToken = RP::Tokens::getTokenString(TokenId::ChangeWindow);
+        char count[24];
+        output.append(startToken.data(), startToken.size());
+        output.append(count, std::to_chars(count, count + sizeof(count), heldWindowCount).ptr - count);
+        const std::string_view summary = heldWindowCount == 1 ? " brief window, then " : " brief windows, then ";
+        output.append(summary.data(), summary.size());
+        output.append(heldRecord.data() + startToken.size(), heldRecord.size() - startToken.size());
+    }
+    else
+    {
+        output.append(heldRecord.data(), heldRecord.size());
+    }
+    output.append(idle.data(), idle.size());
+
+    heldRecord.clear();
+    idle.clear();
+    heldWindowCount = 0;
+}
+} // namespace RP::Encoder
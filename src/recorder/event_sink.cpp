@@ -1,94 +1,582 @@
 #include "recorder/event_sink.h"
 
 #include "utils/logging.h"
+#include "utils/timestamp_utils.h"
+#include "utils/utf8.h"
 
+#include <algorithm>
+#include <ctime>
 #include <iostream>
 
-EventSink::EventSink(const std::string& name)
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using RP::EventLog::RecordType;
+
+// Number of buffers allocated up front, more are allocated if the writer falls behind
+constexpr size_t INITIAL_RECORDING_BUFFER_COUNT = 3;
+
+namespace
+{
+int64_t getSteadyMilliseconds()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Offset of the local time from UTC, as std::localtime applies it at that time
+int32_t getUtcOffsetMinutes(std::time_t time)
+{
+    const std::tm local = *std::localtime(&time);
+    const std::tm utc = *std::gmtime(&time);
+    int dayDifference = local.tm_yday - utc.tm_yday;
+    if (local.tm_year != utc.tm_year)
+    {
+        dayDifference = local.tm_year > utc.tm_year ? 1 : -1;
+    }
+    return dayDifference * 24 * 60 + (local.tm_hour - utc.tm_hour) * 60 + (local.tm_min - utc.tm_min);
+}
+} // namespace
+
+EventSink::EventSink(const std::string& name, const FlushPolicy& policy, RecordingFormat format)
+    : policy(policy), format(format)
 {
-    file.open(name, std::ios::out | std::ios::app | std::ios::binary);
-    LOG_CLASS_INFO("EventSink", "Max recording buffer size: {}", MAX_RECORDING_BUFFER_SIZE);
-    if (!file.is_open())
+    file = std::fopen(name.c_str(), "ab");
+    LOG_CLASS_INFO("EventSink", "Recording buffer size: {}, max age: {}ms, group commit delay: {}ms, durability: {}",
+                   policy.maxBytes, policy.maxAge.count(), policy.groupCommitDelay.count(),
+                   static_cast<int>(policy.durability));
+    if (file == nullptr)
     {
         throw std::runtime_error("Failed to open output file for EventSink - " + name + ", " + std::strerror(errno));
     }
+    if (policy.maxBytes == 0)
+    {
+        std::fclose(file);
+        throw std::runtime_error("EventSink recording buffers need room for at least one byte");
+    }
+
+    for (size_t i = 0; i < INITIAL_RECORDING_BUFFER_COUNT; i++)
+    {
+        buffers.push_back(std::make_unique<RecordingBuffer>(policy.maxBytes));
+        freeBuffers.push_back(buffers.back().get());
+    }
+    RecordingBuffer* first = freeBuffers.back();
+    freeBuffers.pop_back();
+    first->reserved.store(0, std::memory_order_relaxed);
+    activeBuffer.store(first, std::memory_order_release);
+
+    if (format == RecordingFormat::Binary)
+    {
+        // Every sink starts a session, also when it appends to an earlier recording
+        const auto now = std::chrono::system_clock::now();
+        const int64_t unixMilliseconds =
+            std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+        char payload[RP::EventLog::MAX_SESSION_PAYLOAD_LENGTH];
+        const size_t payloadLength = RP::EventLog::writeSessionPayload(
+            unixMilliseconds, getUtcOffsetMinutes(std::chrono::system_clock::to_time_t(now)), payload);
+        lastRecordTime = getSteadyMilliseconds();
+        appendRecord(RecordType::SessionStart, payloadLength,
+                     [&](char* destination) { std::memcpy(destination, payload, payloadLength); });
+    }
+
+    writerRunning = true;
+    writer = std::thread(&EventSink::runWriter, this);
 }
 
 EventSink::~EventSink()
 {
     LOG_CLASS_DEBUG("EventSink", "Destructor called");
-    if (file.is_open())
+    drain();
+    std::fclose(file);
+}
+
+template <typename WriteText>
+void EventSink::append(size_t length, const WriteText& writeText)
+{
+    if (length == 0)
     {
-        flushData();
-        file.close();
+        return;
     }
+    if (length > policy.maxBytes)
+    {
+        std::string oversizedEvent(length, '\0');
+        writeText(oversizedEvent.data());
+        while (!sealBuffer(activeBuffer.load(std::memory_order_acquire), &oversizedEvent))
+        {
+        }
+        return;
+    }
+
+    while (true)
+    {
+        RecordingBuffer* buffer = activeBuffer.load(std::memory_order_acquire);
+        uint64_t reserved = buffer->reserved.load(std::memory_order_acquire);
+        while ((reserved & SEALED_FLAG) == 0 && reserved + length <= policy.maxBytes)
+        {
+            if (buffer->reserved.compare_exchange_weak(reserved, reserved + length, std::memory_order_acq_rel))
+            {
+                // The first event starts the buffer's max age, which costs one clock read per buffer
+                if (reserved == 0 && policy.maxAge.count() > 0)
+                {
+                    buffer->firstEventTime.store(std::chrono::steady_clock::now().time_since_epoch().count(),
+                                                 std::memory_order_relaxed);
+                }
+                writeText(buffer->data.get() + reserved);
+                buffer->committed.fetch_add(length, std::memory_order_release);
+                return;
+            }
+        }
+        // The event doesn't fit, so the buffer is full
+        sealBuffer(buffer, nullptr);
+    }
+}
+
+template <typename WritePayload>
+void EventSink::appendRecord(RecordType type, size_t payloadLength, const WritePayload& writePayload)
+{
+    char header[RP::EventLog::MAX_RECORD_HEADER_LENGTH];
+    const size_t headerLength =
+        RP::EventLog::writeRecordHeader(type, takeElapsedMilliseconds(), payloadLength, header);
+    append(headerLength + payloadLength,
+           [&](char* destination)
+           {
+               std::memcpy(destination, header, headerLength);
+               writePayload(destination + headerLength);
+           });
 }
 
-EventSink& EventSink::operator<<(const char* data)
+uint64_t EventSink::takeElapsedMilliseconds()
 {
-    // Get buffer size needed to perform the conversion
-    int len = MultiByteToWideChar(CP_UTF8, 0, data, -1, nullptr, 0);
-    if (len == 0)
+    // Producers take turns moving the time forward, so the times add up to the clock even if records of producers
+    // writing at the same moment end up in the other order
+    const int64_t now = getSteadyMilliseconds();
+    int64_t last = lastRecordTime.load(std::memory_order_relaxed);
+    while (now > last && !lastRecordTime.compare_exchange_weak(last, now, std::memory_order_relaxed))
     {
-        LOG_CLASS_ERROR("EventSink", "Failed to calculate buffer size for UTF-8 to UTF-16 conversion: {}",
-                        GetLastError());
-        return *this;
     }
+    return now > last ? static_cast<uint64_t>(now - last) : 0;
+}
+
+EventSink& EventSink::operator<<(std::string_view data)
+{
+    return write({data});
+}
 
-    std::unique_ptr<wchar_t[]> output = std::make_unique<wchar_t[]>(len);
-    int convertResult = MultiByteToWideChar(
-        CP_UTF8, 0, data, -1, output.get(),
-        len); // https://learn.microsoft.com/en-us/windows/win32/api/stringapiset/nf-stringapiset-multibytetowidechar
-    if (convertResult == 0)
+EventSink& EventSink::operator<<(std::u16string_view data)
+{
+    const size_t length = RP::Utils::getUtf8Length(data);
+    auto convert = [&](char* destination) { RP::Utils::convertUtf16ToUtf8(data, destination); };
+    if (format == RecordingFormat::Binary)
     {
-        LOG_CLASS_ERROR("EventSink", "UTF-8 to UTF-16 conversion failed: {}", GetLastError());
+        appendRecord(RecordType::Text, length, convert);
+    }
+    else
+    {
+        append(length, convert);
+    }
+    return *this;
+}
+
+EventSink& EventSink::operator<<(const wchar_t* data)
+{
+    if constexpr (sizeof(wchar_t) == sizeof(char16_t))
+    {
+        return *this << std::u16string_view(reinterpret_cast<const char16_t*>(data), wcslen(data));
+    }
+    else
+    {
+        const std::u32string_view text(reinterpret_cast<const char32_t*>(data), wcslen(data));
+        const size_t length = RP::Utils::getUtf8Length(text);
+        auto convert = [&](char* destination) { RP::Utils::convertUtf32ToUtf8(text, destination); };
+        if (format == RecordingFormat::Binary)
+        {
+            appendRecord(RecordType::Text, length, convert);
+        }
+        else
+        {
+            append(length, convert);
+        }
         return *this;
     }
+}
 
-    recordingBuffer.insert(recordingBuffer.end(), output.get(), output.get() + len - 1);
-    flushIfMaxSizeExceeded();
+EventSink& EventSink::write(std::initializer_list<std::string_view> pieces)
+{
+    size_t length = 0;
+    for (std::string_view piece : pieces)
+    {
+        length += piece.size();
+    }
+    auto copyPieces = [&](char* destination)
+    {
+        for (std::string_view piece : pieces)
+        {
+            std::memcpy(destination, piece.data(), piece.size());
+            destination += piece.size();
+        }
+    };
+    if (format == RecordingFormat::Binary)
+    {
+        appendRecord(RecordType::Text, length, copyPieces);
+    }
+    else
+    {
+        append(length, copyPieces);
+    }
     return *this;
 }
 
-EventSink& EventSink::operator<<(const wchar_t* data)
+EventSink& EventSink::writeToken(RP::Tokens::TokenId token)
 {
-    size_t len = wcslen(data);
+    if (format == RecordingFormat::Text)
+    {
+        return write({RP::Tokens::TOKEN_STRINGS[static_cast<size_t>(token)]});
+    }
+    char record[RP::EventLog::MAX_RECORD_HEADER_LENGTH];
+    const size_t length = RP::EventLog::writeTokenRecord(token, takeElapsedMilliseconds(), record);
+    append(length, [&](char* destination) { std::memcpy(destination, record, length); });
+    return *this;
+}
 
-    recordingBuffer.insert(recordingBuffer.end(), data, (data + len));
-    flushIfMaxSizeExceeded();
+EventSink& EventSink::writeWindowChange(std::string_view windowTitle)
+{
+    if (format == RecordingFormat::Text)
+    {
+        std::time_t now = std::time(nullptr);
+        const std::string timestamp = RP::Utils::formatTimestampToLLMReadable(std::localtime(&now));
+        return write({"\n", WINDOW_CHANGE_TOKEN, "\"", windowTitle, "\" TIMESTAMP: ", timestamp,
+                      WINDOW_CHANGE_END_TOKEN, "\n"});
+    }
+    appendRecord(RecordType::WindowChange, windowTitle.size(),
+                 [&](char* destination) { std::memcpy(destination, windowTitle.data(), windowTitle.size()); });
     return *this;
 }
 
-inline void EventSink::flushData()
+EventSink& EventSink::writeScreenshotPath(std::string_view path)
 {
-    if (!recordingBuffer.empty())
+    if (format == RecordingFormat::Text)
     {
-        LOG_CLASS_INFO("EventSink", "Flushing {} bytes from recording buffer", recordingBuffer.size());
+        return write({SCREENSHOT_PATH_TOKEN, "\"", path, "\"", SCREENSHOT_END_TOKEN});
+    }
+    appendRecord(RecordType::ScreenshotPath, path.size(),
+                 [&](char* destination) { std::memcpy(destination, path.data(), path.size()); });
+    return *this;
+}
 
-        // Convert recording buffer's wchar_t array to an std::string so we can
-        // save to UTF-8
-        std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+EventSink& EventSink::writeScreenshotBase64(std::string_view base64Data)
+{
+    if (format == RecordingFormat::Text)
+    {
+        return write({SCREENSHOT_BASE64_TOKEN, base64Data, SCREENSHOT_END_TOKEN});
+    }
+    appendRecord(RecordType::ScreenshotBase64, base64Data.size(),
+                 [&](char* destination) { std::memcpy(destination, base64Data.data(), base64Data.size()); });
+    return *this;
+}
 
-        try
+void EventSink::flush()
+{
+    // If another thread is sealing the active buffer, its events are queued once sealBuffer() returns
+    sealBuffer(activeBuffer.load(std::memory_order_acquire), nullptr);
+
+    std::unique_lock<std::mutex> lock(writerMutex);
+    const uint64_t target = sealedCount;
+    flushTarget = std::max(flushTarget, target);
+    if (writerRunning)
+    {
+        // Cuts the group commit delay short
+        bufferQueued.notify_all();
+        bufferWritten.wait(lock, [&]() { return writtenCount >= target; });
+    }
+    else
+    {
+        lock.unlock();
+        while (writeQueuedBuffers())
         {
-            std::string text =
-                converter.to_bytes(recordingBuffer.data(), (recordingBuffer.data() + recordingBuffer.size()));
-            file.write(text.data(), text.size());
         }
-        catch (const std::range_error& e)
+        lock.lock();
+    }
+    if (flushedCount >= target)
+    {
+        return;
+    }
+    lock.unlock();
+
+    // The buffers were written before the target was raised, e.g. the writer took the one sealed above right away
+    std::lock_guard<std::mutex> fileLock(fileMutex);
+    commitFile(true);
+    lock.lock();
+    flushedCount = std::max(flushedCount, target);
+}
+
+void EventSink::drain()
+{
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        writerRunning = false;
+    }
+    bufferQueued.notify_all();
+    if (writer.joinable())
+    {
+        writer.join();
+    }
+    // Buffers queued after the writer stopped looking
+    while (writeQueuedBuffers())
+    {
+    }
+}
+
+bool EventSink::sealBuffer(RecordingBuffer* buffer, std::string* oversizedEvent)
+{
+    // Sealing and activating the next buffer happen under the mutex, so a thread that finds the buffer sealed
+    // already knows the next one is active
+    std::unique_lock<std::mutex> lock(writerMutex);
+    // Once the flag is set, no producer can reserve space in the buffer anymore, so the size is final
+    const uint64_t size = buffer->reserved.fetch_or(SEALED_FLAG, std::memory_order_acq_rel);
+    if (size & SEALED_FLAG)
+    {
+        return false;
+    }
+
+    if (freeBuffers.empty())
+    {
+        LOG_CLASS_DEBUG("EventSink", "Writer is behind, allocating recording buffer {}", buffers.size() + 1);
+        buffers.push_back(std::make_unique<RecordingBuffer>(policy.maxBytes));
+        freeBuffers.push_back(buffers.back().get());
+    }
+    RecordingBuffer* next = freeBuffers.back();
+    freeBuffers.pop_back();
+
+    // Queued before the next buffer is activated, so buffers are queued in the order they were active
+    writeQueue.push_back({buffer, static_cast<size_t>(size), {}});
+    sealedCount++;
+    if (oversizedEvent != nullptr)
+    {
+        writeQueue.push_back({nullptr, oversizedEvent->size(), std::move(*oversizedEvent)});
+        sealedCount++;
+    }
+    next->committed.store(0, std::memory_order_relaxed);
+    next->firstEventTime.store(0, std::memory_order_relaxed);
+    next->reserved.store(0, std::memory_order_release);
+    activeBuffer.store(next, std::memory_order_release);
+    const bool writeHere = !writerRunning;
+    lock.unlock();
+
+    if (writeHere)
+    {
+        while (writeQueuedBuffers())
+        {
+        }
+    }
+    else
+    {
+        bufferQueued.notify_one();
+    }
+    return true;
+}
+
+bool EventSink::writeQueuedBuffers()
+{
+    std::lock_guard<std::mutex> fileLock(fileMutex);
+    {
+        // The queues swap places, so both keep their capacity and queueing doesn't allocate once they're big enough
+        std::lock_guard<std::mutex> lock(writerMutex);
+        if (writeQueue.empty())
+        {
+            return false;
+        }
+        std::swap(writeQueue, writingQueue);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    for (const SealedBuffer& sealed : writingQueue)
+    {
+        const char* text = sealed.oversizedEvent.data();
+        if (sealed.buffer != nullptr)
+        {
+            // Producers that reserved space may still be copying their event in
+            while (sealed.buffer->committed.load(std::memory_order_acquire) != sealed.size)
+            {
+                std::this_thread::yield();
+            }
+            text = sealed.buffer->data.get();
+        }
+
+        size_t size = sealed.size;
+        if (format == RecordingFormat::Binary && sealed.buffer != nullptr && size > 0)
+        {
+            // Producers can't see each other's records, so keystrokes are joined here
+            mergedRecords.clear();
+            const size_t merged = RP::EventLog::mergeTextRecords(std::string_view(text, size),
+                                                                 RP::EventLog::MAX_TEXT_MERGE_GAP_MILLISECONDS,
+                                                                 mergedRecords);
+            mergedRecords.append(text + merged, size - merged);
+            text = mergedRecords.data();
+            size = mergedRecords.size();
+        }
+
+        if (size > 0)
+        {
+            LOG_CLASS_INFO("EventSink", "Flushing {} bytes from recording buffer", size);
+            if (std::fwrite(text, 1, size, file) != size)
+            {
+                LOG_CLASS_ERROR("EventSink", "Failed to write recording buffer: {}", std::strerror(errno));
+            }
+            stats.bytesWritten += size;
+        }
+    }
+    bool flushRequested = false;
+    {
+        // Read after writing, so a flush() that raised the target meanwhile is served by this commit
+        std::lock_guard<std::mutex> lock(writerMutex);
+        flushRequested = flushTarget > writtenCount;
+    }
+    commitFile(flushRequested);
+
+    const auto latency =
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    stats.flushCount++;
+    stats.bufferCount += writingQueue.size();
+    stats.totalFlushLatency += latency;
+    stats.maxFlushLatency = std::max(stats.maxFlushLatency, latency);
+
+    {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        for (const SealedBuffer& sealed : writingQueue)
+        {
+            if (sealed.buffer != nullptr)
+            {
+                freeBuffers.push_back(sealed.buffer);
+            }
+        }
+        writtenCount += writingQueue.size();
+        if (flushRequested)
         {
-            LOG_CLASS_ERROR("EventSink", "Error converting UTF-16 to UTF-8: {}", e.what());
+            flushedCount = writtenCount;
         }
+    }
+    writingQueue.clear();
+    bufferWritten.notify_all();
+    return true;
+}
+
+void EventSink::commitFile(bool flushRequested)
+{
+    // An explicit flush() always reaches the OS
+    if (policy.durability == FlushDurability::None && !flushRequested)
+    {
+        return;
+    }
+    std::fflush(file);
+    if (policy.durability != FlushDurability::Sync)
+    {
+        return;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (flushRequested || now >= syncDeadline)
+    {
+        syncFile();
+    }
+    else if (syncDeadline == std::chrono::steady_clock::time_point::max())
+    {
+        syncDeadline = now + policy.syncInterval;
+    }
+}
 
-        file.flush();
-        recordingBuffer.clear();
+void EventSink::syncFile()
+{
+#ifdef _WIN32
+    const int result = _commit(_fileno(file));
+#else
+    const int result = fdatasync(fileno(file));
+#endif
+    if (result != 0)
+    {
+        LOG_CLASS_ERROR("EventSink", "Failed to sync recording file: {}", std::strerror(errno));
     }
+    syncDeadline = std::chrono::steady_clock::time_point::max();
+    stats.syncCount++;
+}
+
+FlushStats EventSink::getFlushStats() const
+{
+    std::lock_guard<std::mutex> fileLock(fileMutex);
+    return stats;
 }
 
-inline void EventSink::flushIfMaxSizeExceeded()
+std::chrono::steady_clock::time_point EventSink::getAgeDeadline(RecordingBuffer* buffer) const
 {
-    if (recordingBuffer.size() >= MAX_RECORDING_BUFFER_SIZE)
+    const auto now = std::chrono::steady_clock::now();
+    const uint64_t reserved = buffer->reserved.load(std::memory_order_acquire);
+    const int64_t firstEventTime = buffer->firstEventTime.load(std::memory_order_relaxed);
+    // An empty buffer, or one whose first event is still being stamped, can't be older than now
+    if ((reserved & SEALED_FLAG) != 0 || reserved == 0 || firstEventTime == 0)
     {
-        flushData();
+        return now + policy.maxAge;
     }
-}
\ No newline at end of file
+    return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(firstEventTime)) +
+           policy.maxAge;
+}
+
+void EventSink::runWriter()
+{
+    const bool hasMaxAge = policy.maxAge.count() > 0;
+    auto nextSync = std::chrono::steady_clock::time_point::max();
+
+    std::unique_lock<std::mutex> lock(writerMutex);
+    while (true)
+    {
+        auto deadline = nextSync;
+        if (hasMaxAge)
+        {
+            deadline = std::min(deadline, getAgeDeadline(activeBuffer.load(std::memory_order_acquire)));
+        }
+        auto isQueuedOrStopping = [&]() { return !writeQueue.empty() || !writerRunning; };
+        if (deadline == std::chrono::steady_clock::time_point::max())
+        {
+            bufferQueued.wait(lock, isQueuedOrStopping);
+        }
+        else
+        {
+            bufferQueued.wait_until(lock, deadline, isQueuedOrStopping);
+        }
+        if (writeQueue.empty() && !writerRunning)
+        {
+            return;
+        }
+        if (!writeQueue.empty() && policy.groupCommitDelay.count() > 0)
+        {
+            // Buffers filled meanwhile are written with the same flush, unless someone waits for it
+            bufferQueued.wait_for(lock, policy.groupCommitDelay,
+                                  [&]() { return !writerRunning || flushTarget > writtenCount; });
+        }
+        lock.unlock();
+
+        // Hands events that waited for maxAge to the writer, even though their buffer isn't full
+        RecordingBuffer* buffer = activeBuffer.load(std::memory_order_acquire);
+        if (hasMaxAge && getAgeDeadline(buffer) <= std::chrono::steady_clock::now() && sealBuffer(buffer, nullptr))
+        {
+            std::lock_guard<std::mutex> fileLock(fileMutex);
+            stats.agedBufferCount++;
+        }
+        while (writeQueuedBuffers())
+        {
+        }
+        {
+            std::lock_guard<std::mutex> fileLock(fileMutex);
+            if (std::chrono::steady_clock::now() >= syncDeadline)
+            {
+                syncFile();
+            }
+            nextSync = syncDeadline;
+        }
+
+        lock.lock();
+    }
+}
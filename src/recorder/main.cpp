@@ -3,6 +3,7 @@
 #include <csignal>
 #include <iostream>
 #include <memory>
+#include <string_view>
 #include "event_sink.h"
 #include "screenshot_event_source.h"
 #include "user_input_event_source.h"
@@ -43,7 +44,10 @@ int main(int argc, char** argv)
     std::signal(SIGINT, signalHandler);
 
     // Initialize the windows hook manager (should be done before creating any event sources and in the main thread)
-    auto eventSink = std::make_shared<EventSink>("out.txt");
+    // --binary records the binary event log, which replay_render turns into the text format
+    const bool binaryFormat = argc > 1 && std::string_view(argv[1]) == "--binary";
+    auto eventSink = binaryFormat ? std::make_shared<EventSink>("out.rplog", FlushPolicy(), RecordingFormat::Binary)
+                                  : std::make_shared<EventSink>("out.txt");
 
     // Create EventSources to monitor user activity
     auto inputEventSource = UserInputEventSource::create();
@@ -73,4 +77,11 @@ int main(int argc, char** argv)
     }
 
     LOG_DEBUG("--- Shutting down... ---");
+    // Get everything recorded so far into the file before the event sources are torn down
+    eventSink->drain();
+
+    const FlushStats flushStats = eventSink->getFlushStats();
+    LOG_INFO("Recording flushed {} times ({} buffers, {} bytes, {} synced), max flush latency {}us",
+             flushStats.flushCount, flushStats.bufferCount, flushStats.bytesWritten, flushStats.syncCount,
+             flushStats.maxFlushLatency.count());
 }
\ No newline at end of file
@@ -56,11 +56,8 @@ bool FilePathSerializationStrategy::serializeScreenshot(const ScreenshotEventSou
         return false;
     }
 
-    // Convert to wide string
-    std::wstring wFilePath(filePath.begin(), filePath.end());
-
-    // Write the token and file path to the event sink
-    *sink << SCREENSHOT_PATH_TOKEN << "\"" << wFilePath.c_str() << "\"" << SCREENSHOT_END_TOKEN;
+    // Write the file path to the event sink, as one event so other events can't end up in between
+    sink->writeScreenshotPath(filePath);
 
     return true;
 }
@@ -82,8 +79,8 @@ bool Base64SerializationStrategy::serializeScreenshot(const ScreenshotEventSourc
     // Encode the image data as base64
     std::string base64Data = encodeBase64(imageData, dataSize);
 
-    // Write the token and base64 data to the event sink
-    *sink << SCREENSHOT_BASE64_TOKEN << base64Data.c_str() << SCREENSHOT_END_TOKEN;
+    // Write the base64 data to the event sink, as one event
+    sink->writeScreenshotBase64(base64Data);
 
     return true;
 }
@@ -4,6 +4,9 @@
 #include "event_sink.h"
 #include "utils/error_messages.h"
 #include "utils/logging.h"
+#include "utils/special_tokens.h"
+
+using RP::Tokens::TokenId;
 
 UserInputEventSource::~UserInputEventSource()
 {
@@ -50,25 +53,25 @@ bool handleSpecialKey(int vkCode, EventSink* outputSink)
     switch (vkCode)
     {
     case VK_RETURN:
-        *outputSink << "[ENTER]";
+        outputSink->writeToken(TokenId::Enter);
         break;
     case VK_BACK:
-        *outputSink << "[BACKSPACE]";
+        outputSink->writeToken(TokenId::Backspace);
         break;
     case VK_LCONTROL:
-        *outputSink << "[LCTRL]";
+        outputSink->writeToken(TokenId::LeftCtrl);
         break;
     case VK_LSHIFT:
-        *outputSink << "[LSHIFT]";
+        outputSink->writeToken(TokenId::LeftShift);
         break;
     case VK_RSHIFT:
-        *outputSink << "[RSHIFT]";
+        outputSink->writeToken(TokenId::RightShift);
         break;
     case VK_SPACE:
-        *outputSink << "[SPACE]";
+        outputSink->writeToken(TokenId::Space);
         break;
     case VK_CAPITAL:
-        *outputSink << "[CAPSLOCK]";
+        outputSink->writeToken(TokenId::CapsLock);
         break;
     default:
         return false;
@@ -102,7 +105,7 @@ void UserInputEventSource::onKeyboardInput(Replay::Windows::KeyboardInputEventDa
                 // false
                 if (!leftAltPressed)
                 {
-                    *outputSink << "[TAB]";
+                    outputSink->writeToken(TokenId::Tab);
                     tabPressed = false;
                 }
                 else
@@ -114,7 +117,7 @@ void UserInputEventSource::onKeyboardInput(Replay::Windows::KeyboardInputEventDa
             // Handle ALT+TAB
             if (leftAltPressed && tabPressed)
             {
-                *outputSink << "[ALT+TAB]";
+                outputSink->writeToken(TokenId::AltTab);
             }
             // Handle special key or everything else
             else if (!handleSpecialKey(pKeyboard->vkCode, outputSink.get()))
@@ -124,7 +127,7 @@ void UserInputEventSource::onKeyboardInput(Replay::Windows::KeyboardInputEventDa
                 // treat it as another combination (this is scuffed)
                 if (leftAltPressed)
                 {
-                    *outputSink << "[ALT]";
+                    outputSink->writeToken(TokenId::Alt);
                 }
 
                 wchar_t unicodeBuffer[2] = {0};
@@ -1,13 +1,8 @@
 #include "user_window_activity_event_source.h"
 
-#include <ctime>
-
-#include <sstream>
-
 #include "event_sink.h"
 #include "utils/error_messages.h"
 #include "utils/logging.h"
-#include "utils/timestamp_utils.h"
 
 std::shared_ptr<UserWindowActivityEventSource> UserWindowActivityEventSource::create()
 {
@@ -60,14 +55,7 @@ void UserWindowActivityEventSource::onFocusChange(HWND hwnd)
         // Special separator token, produced when focus enters and exits a window
         if (windowTitle != "Task Switching")
         {
-            std::time_t now = std::time(nullptr);
-            std::string timestampString = RP::Utils::formatTimestampToLLMReadable(std::localtime(&now));
-
-            std::ostringstream oss;
-            oss << "\n"
-                << WINDOW_CHANGE_TOKEN << "\"" << windowTitle << "\" TIMESTAMP: " << timestampString
-                << WINDOW_CHANGE_END_TOKEN << "\n";
-            *outputSink << oss.str().data();
+            outputSink->writeWindowChange(windowTitle);
         }
     }
 }
@@ -1,13 +1,44 @@
+#include <atomic>
+#include <chrono>
 #include <codecvt>
+#include <cstdlib>
 #include <filesystem>
 #include <fstream>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <memory>
+#include <new>
 #include <string>
+#include <thread>
+#include <vector>
 #include "recorder/event_sink.h"
 #include "recorder/event_source.h"
+#include "utils/binary_event_log.h"
 #include "utils/logging.h"
+#include "utils/timestamp_utils.h"
+
+// Heap allocations made by the current thread, the writer thread's allocations don't count
+static thread_local size_t threadAllocationCount = 0;
+
+void* operator new(size_t size)
+{
+    threadAllocationCount++;
+    if (void* memory = std::malloc(size == 0 ? 1 : size))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
 
 class EventSinkTest : public ::testing::Test
 {
@@ -41,17 +72,19 @@ TEST_F(EventSinkTest, WritesToFileAndFlushes)
     // Verify file exists as it should have been created by the EventSink constructor
     ASSERT_TRUE(std::filesystem::exists(testFilePath));
 
-    // Write some data that's smaller than MAX_RECORDING_BUFFER_SIZE
+    // Write some data that's smaller than DEFAULT_RECORDING_BUFFER_SIZE
     const wchar_t* smallData = L"This is a small test string";
     *eventSink << smallData;
 
     // At this point, data should be in the buffer but not yet flushed to file
 
-    // Create data larger than MAX_RECORDING_BUFFER_SIZE to force a flush
-    std::string largeData(MAX_RECORDING_BUFFER_SIZE + 100, 'X');
+    // Create data larger than DEFAULT_RECORDING_BUFFER_SIZE to force a flush
+    std::string largeData(DEFAULT_RECORDING_BUFFER_SIZE + 100, 'X');
     *eventSink << largeData.c_str();
 
-    // Data should now be flushed to the file
+    // Data should now be handed to the writer thread, wait until it's in the file
+    eventSink->flush();
+
     // Read the file to verify content
     std::ifstream inFile(testFilePath);
     ASSERT_TRUE(inFile.is_open());
@@ -67,6 +100,340 @@ TEST_F(EventSinkTest, WritesToFileAndFlushes)
     EXPECT_TRUE(fileContent.find(std::string(100, 'X')) != std::string::npos);
 }
 
+// Test: flush() waits until buffered events are in the file, and events written after drain() still end up in it.
+TEST_F(EventSinkTest, FlushAndDrainWriteBufferedEvents)
+{
+    auto readFile = [this]()
+    {
+        std::ifstream inFile(testFilePath, std::ios::in | std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
+    };
+
+    {
+        auto eventSink = std::make_shared<EventSink>(testFilePath);
+        *eventSink << "first";
+        eventSink->flush();
+        EXPECT_EQ(readFile(), "first");
+
+        // Flushing with nothing buffered is harmless
+        eventSink->flush();
+        *eventSink << L"second";
+        eventSink->drain();
+        EXPECT_EQ(readFile(), "firstsecond");
+
+        // Without the writer thread, a full buffer is written by the producer that filled it
+        const std::string largeData(DEFAULT_RECORDING_BUFFER_SIZE, 'X');
+        *eventSink << "third";
+        *eventSink << largeData.c_str();
+        EXPECT_EQ(readFile(), "firstsecondthird");
+        *eventSink << "fourth";
+    }
+    EXPECT_EQ(readFile(), "firstsecondthird" + std::string(DEFAULT_RECORDING_BUFFER_SIZE, 'X') + "fourth");
+}
+
+// Test: flush() hands the events to the OS even when the policy leaves flushing to the C runtime, however the
+// writer thread's writes interleave with it.
+TEST_F(EventSinkTest, FlushReachesTheFileWithoutDurability)
+{
+    FlushPolicy policy;
+    policy.durability = FlushDurability::None;
+    auto eventSink = std::make_shared<EventSink>(testFilePath, policy);
+
+    size_t expectedSize = 0;
+    for (int i = 0; i < 500; i++)
+    {
+        const std::string event = "event " + std::to_string(i) + "\n";
+        *eventSink << event;
+        expectedSize += event.size();
+        eventSink->flush();
+        ASSERT_EQ(std::filesystem::file_size(testFilePath), expectedSize) << "after event " << i;
+    }
+}
+
+// Test: UTF-8, UTF-16 and wide text end up in the file as UTF-8, without allocating once the sink is warmed up.
+TEST_F(EventSinkTest, AppendsWithoutAllocating)
+{
+    auto eventSink = std::make_shared<EventSink>(testFilePath);
+    const std::string expected = "caf\xc3\xa9 [ENTER]\xe6\x97\xa5\xf0\x9f\x98\x80\nwide\xc3\xa9\n";
+    auto writeEvents = [&]()
+    {
+        *eventSink << "caf\xc3\xa9 ";
+        eventSink->write({"[", "ENTER", "]"});
+        *eventSink << u"\u65e5\U0001F600\n";
+        *eventSink << L"wide\u00e9\n";
+    };
+
+    // Fills the queues of sealed buffers up to their steady state capacity
+    for (int i = 0; i < 10; i++)
+    {
+        writeEvents();
+        eventSink->flush();
+    }
+
+    const size_t allocationsBefore = threadAllocationCount;
+    for (int i = 0; i < 1000; i++)
+    {
+        writeEvents();
+        // Events that fill a buffer seal it, and flushing seals it too
+        if (i % 10 == 0)
+        {
+            eventSink->flush();
+        }
+    }
+    EXPECT_EQ(threadAllocationCount - allocationsBefore, 0u);
+
+    eventSink->flush();
+    std::ifstream inFile(testFilePath, std::ios::in | std::ios::binary);
+    const std::string fileContent((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
+    std::string expectedContent;
+    for (int i = 0; i < 1010; i++)
+    {
+        expectedContent += expected;
+    }
+    EXPECT_EQ(fileContent, expectedContent);
+}
+
+// Test: Events written by many threads at once all end up in the file, whole and in the order each thread wrote them.
+TEST_F(EventSinkTest, ConcurrentProducersWriteWholeEvents)
+{
+    constexpr int PRODUCER_COUNT = 16;
+    constexpr int EVENTS_PER_PRODUCER = 20000;
+
+    // Events look like '<producer:index:payload>', the payload repeats a letter that identifies the producer. Now
+    // and then an event is big enough to cross the flush size on its own.
+    auto getPayload = [](int producer, int index)
+    {
+        const size_t length = index % 97 == 0 ? DEFAULT_RECORDING_BUFFER_SIZE : index % 13;
+        return std::string(length, static_cast<char>('a' + producer));
+    };
+
+    // Every flush is logged, which would drown out the test output
+    spdlog::set_level(spdlog::level::warn);
+    const auto start = std::chrono::steady_clock::now();
+    {
+        auto eventSink = std::make_shared<EventSink>(testFilePath);
+        std::atomic<bool> started{false};
+        std::vector<std::thread> producers;
+        for (int producer = 0; producer < PRODUCER_COUNT; producer++)
+        {
+            producers.emplace_back(
+                [&, producer]()
+                {
+                    while (!started)
+                    {
+                        std::this_thread::yield();
+                    }
+                    for (int index = 0; index < EVENTS_PER_PRODUCER; index++)
+                    {
+                        const std::string id = std::to_string(producer) + ":" + std::to_string(index) + ":";
+                        const std::string payload = getPayload(producer, index);
+                        // Both ways of writing an event
+                        if (index % 2 == 0)
+                        {
+                            *eventSink << ("<" + id + payload + ">").c_str();
+                        }
+                        else
+                        {
+                            eventSink->write({"<", id, payload, ">"});
+                        }
+                    }
+                });
+        }
+        started = true;
+        for (std::thread& thread : producers)
+        {
+            thread.join();
+        }
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    spdlog::set_level(spdlog::level::info);
+
+    std::ifstream inFile(testFilePath, std::ios::in | std::ios::binary);
+    ASSERT_TRUE(inFile.is_open());
+    const std::string fileContent((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
+    LOG_INFO("{} producers wrote {} events ({} bytes) in {:.3f}s, {:.0f} events/s", PRODUCER_COUNT,
+             PRODUCER_COUNT * EVENTS_PER_PRODUCER, fileContent.size(), seconds,
+             PRODUCER_COUNT * EVENTS_PER_PRODUCER / seconds);
+
+    std::vector<int> nextIndex(PRODUCER_COUNT, 0);
+    size_t position = 0;
+    while (position < fileContent.size())
+    {
+        ASSERT_EQ(fileContent[position], '<') << "at offset " << position;
+        const size_t end = fileContent.find('>', position);
+        ASSERT_NE(end, std::string::npos);
+        const std::string event = fileContent.substr(position + 1, end - position - 1);
+        const size_t firstColon = event.find(':');
+        const size_t secondColon = event.find(':', firstColon + 1);
+        ASSERT_NE(secondColon, std::string::npos) << "torn event: " << event;
+
+        const int producer = std::stoi(event.substr(0, firstColon));
+        const int index = std::stoi(event.substr(firstColon + 1, secondColon - firstColon - 1));
+        ASSERT_GE(producer, 0);
+        ASSERT_LT(producer, PRODUCER_COUNT);
+        ASSERT_EQ(index, nextIndex[producer]) << "event of producer " << producer << " lost or out of order";
+        ASSERT_EQ(event.substr(secondColon + 1), getPayload(producer, index)) << "torn event: " << event;
+        nextIndex[producer]++;
+        position = end + 1;
+    }
+    for (int producer = 0; producer < PRODUCER_COUNT; producer++)
+    {
+        EXPECT_EQ(nextIndex[producer], EVENTS_PER_PRODUCER) << "events of producer " << producer << " lost";
+    }
+}
+
+// Test: Events in a buffer that never fills are written once they reach the policy's max age.
+TEST_F(EventSinkTest, MaxAgeWritesIdleEvents)
+{
+    FlushPolicy policy;
+    policy.maxAge = std::chrono::milliseconds(50);
+    auto eventSink = std::make_shared<EventSink>(testFilePath, policy);
+    *eventSink << "idle";
+
+    std::string fileContent;
+    const auto giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (fileContent.empty() && std::chrono::steady_clock::now() < giveUp)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        std::ifstream inFile(testFilePath, std::ios::in | std::ios::binary);
+        fileContent.assign(std::istreambuf_iterator<char>(inFile), std::istreambuf_iterator<char>());
+    }
+    EXPECT_EQ(fileContent, "idle");
+    EXPECT_EQ(eventSink->getFlushStats().agedBufferCount, 1u);
+}
+
+// Test: The buffer size comes from the policy, buffers are written with group commit and syncing, and counted.
+TEST_F(EventSinkTest, FlushPolicyControlsBuffersAndStats)
+{
+    FlushPolicy policy;
+    policy.maxBytes = 16;
+    policy.maxAge = std::chrono::milliseconds(0);
+    policy.groupCommitDelay = std::chrono::milliseconds(20);
+    policy.durability = FlushDurability::Sync;
+    policy.syncInterval = std::chrono::minutes(1);
+    auto eventSink = std::make_shared<EventSink>(testFilePath, policy);
+
+    std::string expected;
+    for (int i = 0; i < 20; i++)
+    {
+        const std::string event = "event " + std::to_string(i) + "\n";
+        *eventSink << event;
+        expected += event;
+    }
+    // Longer than a buffer
+    const std::string longEvent(40, 'X');
+    *eventSink << longEvent;
+    expected += longEvent;
+    eventSink->flush();
+
+    std::ifstream inFile(testFilePath, std::ios::in | std::ios::binary);
+    const std::string fileContent((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(fileContent, expected);
+
+    const FlushStats stats = eventSink->getFlushStats();
+    // Every event but the long one fits in a buffer with at most one more
+    EXPECT_GE(stats.bufferCount, 11u);
+    EXPECT_GE(stats.flushCount, 1u);
+    EXPECT_LE(stats.flushCount, stats.bufferCount);
+    EXPECT_EQ(stats.bytesWritten, expected.size());
+    EXPECT_EQ(stats.agedBufferCount, 0u);
+    // flush() syncs right away, the interval never passed
+    EXPECT_EQ(stats.syncCount, 1u);
+    EXPECT_GE(stats.maxFlushLatency.count(), 0);
+    EXPECT_LE(stats.maxFlushLatency, stats.totalFlushLatency);
+}
+
+// Test: A binary event log renders as the text the text format records for the same events, and is smaller.
+TEST_F(EventSinkTest, BinaryFormatRendersAsText)
+{
+    using RP::Tokens::TokenId;
+    auto recordEvents = [](const std::string& path, RecordingFormat format)
+    {
+        auto eventSink = std::make_shared<EventSink>(path, FlushPolicy(), format);
+        for (int i = 0; i < 20; i++)
+        {
+            *eventSink << L"héllo";
+            eventSink->writeToken(TokenId::Space);
+            eventSink->writeToken(TokenId::Backspace);
+            eventSink->writeToken(TokenId::Enter);
+        }
+        eventSink->writeWindowChange("main.cpp - replay-recorder - Visual Studio Code");
+        eventSink->writeScreenshotPath("./replay-screenshots/ss_2026-10-17_09-00-00.png");
+        eventSink->writeScreenshotBase64(std::string(100, 'A'));
+        *eventSink << "done";
+    };
+    auto readFile = [](const std::string& path)
+    {
+        std::ifstream inFile(path, std::ios::in | std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
+    };
+
+    // The two recordings may be stamped with different minutes, their timestamps are compared on their own
+    auto takeTimestamp = [](std::string& text)
+    {
+        const size_t start = text.find("TIMESTAMP: ") + std::string_view("TIMESTAMP: ").size();
+        const size_t end = text.find("[/CHANGE_WINDOW]", start);
+        const std::string timestamp = text.substr(start, end - start);
+        text.erase(start, end - start);
+        return timestamp;
+    };
+
+    const std::string binaryPath = testFilePath + ".rplog";
+    std::filesystem::remove(binaryPath);
+    recordEvents(binaryPath, RecordingFormat::Binary);
+    recordEvents(testFilePath, RecordingFormat::Text);
+    const std::string log = readFile(binaryPath);
+    std::string expected = readFile(testFilePath);
+    std::filesystem::remove(binaryPath);
+
+    RP::EventLog::TextRenderer renderer;
+    std::string text;
+    EXPECT_EQ(renderer.render(log, text), log.size());
+    const std::string timestamp = takeTimestamp(text);
+    const std::string expectedTimestamp = takeTimestamp(expected);
+    EXPECT_EQ(text, expected);
+    RP::Utils::LLMReadableTimestamp fields;
+    EXPECT_TRUE(RP::Utils::parseLLMReadableTimestamp(timestamp, fields)) << timestamp;
+    EXPECT_TRUE(RP::Utils::parseLLMReadableTimestamp(expectedTimestamp, fields)) << expectedTimestamp;
+    // The session start and one record per event
+    EXPECT_EQ(renderer.getRecordCount(), 1u + 80u + 4u);
+    // Tokens shrink to two bytes, while typed text grows by its header and time
+    EXPECT_LT(log.size() * 5, expected.size() * 3);
+}
+
+// Test: Text typed a character at a time costs about a byte per character in the binary format
+TEST_F(EventSinkTest, BinaryFormatMergesTypedText)
+{
+    const std::string binaryPath = testFilePath + ".rplog";
+    std::filesystem::remove(binaryPath);
+    const std::string typed = "the quick brown fox jumps over the lazy dog";
+    std::string expected;
+    {
+        auto eventSink = std::make_shared<EventSink>(binaryPath, FlushPolicy(), RecordingFormat::Binary);
+        for (int line = 0; line < 50; line++)
+        {
+            for (char c : typed)
+            {
+                *eventSink << std::string_view(&c, 1);
+            }
+            eventSink->writeToken(RP::Tokens::TokenId::Enter);
+            expected += typed + "[ENTER]";
+        }
+    }
+    std::ifstream inFile(binaryPath, std::ios::in | std::ios::binary);
+    const std::string log((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
+    inFile.close();
+    std::filesystem::remove(binaryPath);
+
+    RP::EventLog::TextRenderer renderer;
+    std::string text;
+    EXPECT_EQ(renderer.render(log, text), log.size());
+    EXPECT_EQ(text, expected);
+    // One record per event would take three bytes per character, merged lines take a few bytes more than the text
+    EXPECT_LT(renderer.getRecordCount(), 1u + 2 * 2 * 50u);
+    EXPECT_LT(log.size(), 50 * (typed.size() + 10));
+}
+
 int main(int argc, char** argv)
 {
 
@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include "encoder/encoder.h"
+
+// Every heap allocation in this test executable goes through these, so the tests can count them
+static std::atomic<size_t> allocationCount{0};
+
+void* operator new(size_t size)
+{
+    allocationCount++;
+    if (void* memory = std::malloc(size == 0 ? 1 : size))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+class RLEAllocationTest : public ::testing::Test
+{
+  protected:
+    // Covers special tokens longer than the small string buffer, runs, escapes and screenshot payloads
+    const std::string input = "Hello [LSHIFT]world[SPACE][SPACE][SPACE]AAAAAA\\[not a token]\n"
+                              "[CHANGE_WINDOW]\"Some window title\" TIMESTAMP: 2026 October seventeenth[/CHANGE_WINDOW]"
+                              "[SCREENSHOT_BASE64]AAAAAAAAAA//==[/SCREENSHOT][BACKSPACE][BACKSPACE]xyz[ENTER";
+};
+
+// Test: Once warmed up, encoding into a buffer with enough capacity doesn't allocate.
+TEST_F(RLEAllocationTest, NoAllocationsAfterWarmUp)
+{
+    std::string encoded;
+    encoded.reserve(input.size() * 2);
+    RP::Encoder::rle(input, encoded);
+    const std::string expected = encoded;
+
+    for (int i = 0; i < 100; i++)
+    {
+        encoded.clear();
+        const size_t allocationsBefore = allocationCount;
+        RP::Encoder::rle(input, encoded);
+        EXPECT_EQ(allocationCount - allocationsBefore, 0u);
+        EXPECT_EQ(encoded, expected);
+    }
+}
+
+// Test: Encoding appends to the buffer and gives the same result as rle().
+TEST_F(RLEAllocationTest, AppendsToBuffer)
+{
+    std::string encoded = "prefix:";
+    RP::Encoder::rle(input, encoded);
+    RP::Encoder::rle(std::string_view("AAAA"), encoded);
+    EXPECT_EQ(encoded, "prefix:" + RP::Encoder::rle(input) + "A{4}");
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
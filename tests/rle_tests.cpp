@@ -1,6 +1,17 @@
 #include <gtest/gtest.h>
 #include <string.h>
+#include <filesystem>
+#include <fstream>
+#include "encoder/batch.h"
+#include "encoder/edit_replay.h"
 #include "encoder/encoder.h"
+#include "encoder/file_io.h"
+#include "encoder/in_place.h"
+#include "encoder/incremental.h"
+#include "encoder/phrase_compaction.h"
+#include "encoder/timestamp_delta.h"
+#include "encoder/window_storm.h"
+#include "encoder/pipeline.h"
 
 class RLETest : public ::testing::Test
 {
@@ -69,8 +80,769 @@ TEST(RLETest, ComplexMixedInput)
     EXPECT_EQ(RP::Encoder::rle("[SPACE][SPACE][LSHIFT]BBBCCCCC"), "[SPACEx2][LSHIFT]BBBC{5}");
 }
 
+// Test: A malformed special token right after a special token. The pending token is written with its count.
+TEST(RLETest, MalformedSpecialTokenAfterSpecialToken)
+{
+    EXPECT_EQ(RP::Encoder::rle("[SPACE][LSHIFT AAAA"), "[SPACEx1][LSHIFT AAAA");
+}
+
+// Test: A run of escaped '[' characters continues into the special token that follows it.
+TEST(RLETest, EscapedBracketRunBeforeSpecialToken)
+{
+    EXPECT_EQ(RP::Encoder::rle("\\[[[[A][A]"), "\\[{4}A][A]");
+}
+
+// Test: Special tokens are collapsed and characters between them are still compressed.
+TEST(RLETest, CharacterRunsBetweenSpecialTokens)
+{
+    EXPECT_EQ(RP::Encoder::rle("AAAA[ENTER][ENTER]BBBB[ENTER]"), "A{4}[ENTERx2]B{4}[ENTER]");
+}
+
+// Test: Feeding the input in small chunks gives the same output as encoding it in one go, even when chunk boundaries
+// split special tokens, escape characters and character runs.
+// Test: Base64 screenshot payloads are copied untouched, the text around them is still encoded.
+TEST(RLETest, ScreenshotPayloadIsNotEncoded)
+{
+    EXPECT_EQ(RP::Encoder::rle("[SPACE][SPACE][SCREENSHOT_BASE64]AAAAB//8=[/SCREENSHOT]AAAA"),
+              "[SPACEx2][SCREENSHOT_BASE64]AAAAB//8=[/SCREENSHOT]A{4}");
+    // Screenshot paths are regular text
+    EXPECT_EQ(RP::Encoder::rle("[SCREENSHOT_PATH]\"aaaa.png\"[/SCREENSHOT]"),
+              "[SCREENSHOT_PATH]\"a{4}.png\"[/SCREENSHOT]");
+}
+
+// Test: A payload sink receives the payload, and its replacement is written to the output instead.
+TEST(RLETest, ScreenshotPayloadCanBeExternalized)
+{
+    std::string payload;
+    std::string output;
+    RP::Encoder::RleStreamEncoder encoder([&output](std::string_view encoded) { output.append(encoded); });
+    encoder.setPayloadSink([&payload](std::string_view piece, bool endOfPayload) {
+        payload.append(piece);
+        return endOfPayload ? std::string("\"screenshot_0.b64\"") : std::string();
+    });
+    encoder.feed("xx[SCREENSHOT_BASE64]AAAA");
+    encoder.feed("BBBB[/SCREENSHOT]");
+    encoder.finish();
+
+    EXPECT_EQ(payload, "AAAABBBB");
+    EXPECT_EQ(output, "xx[SCREENSHOT_BASE64]\"screenshot_0.b64\"[/SCREENSHOT]");
+}
+
+TEST(RLETest, StreamEncoderMatchesRleForAnyChunkSize)
+{
+    const std::string input =
+        "AAAA[SPACE][SPACE]\\[[[[B][B]CCCCC[SCREENSHOT_BASE64]AAAAA[/SCREENSHOT][ENTER]x[ENTER][LSHIFT AAAA";
+    for (size_t chunkSize = 1; chunkSize <= input.size(); chunkSize++)
+    {
+        std::string output;
+        RP::Encoder::RleStreamEncoder encoder([&output](std::string_view encoded) { output.append(encoded); }, 4);
+        for (size_t i = 0; i < input.size(); i += chunkSize)
+        {
+            encoder.feed(std::string_view(input).substr(i, chunkSize));
+        }
+        encoder.finish();
+        EXPECT_EQ(output, RP::Encoder::rle(input)) << "chunk size " << chunkSize;
+    }
+}
+
+// Test: Parallel encoding gives the same output as serial encoding, no matter where chunks would be split.
+TEST(RLETest, ParallelEncodingMatchesRle)
+{
+    const std::string input = "AAAA[SPACE][SPACE]xx[SPACE]\\[[[[B][B]CCCCC[]C[ENTER]x[SCREENSHOT_BASE64]AAAAB"
+                              "BBBB=[/SCREENSHOT]BB[SCREENSHOT_BASE64][SCREENSHOT_BASE64]CCCC[ENTER]  yyyyy"
+                              "[x[SCREENSHOT_BASE64]DDDD\\[SCREENSHOT_BASE64]EEEE[LSHIFT AAAA";
+    for (size_t chunkSize = 1; chunkSize <= input.size(); chunkSize++)
+    {
+        std::string output;
+        RP::Encoder::rleParallel(
+            input, 3, [&output](std::string_view encoded) { output.append(encoded); }, chunkSize);
+        EXPECT_EQ(output, RP::Encoder::rle(input)) << "chunk size " << chunkSize;
+    }
+}
+
+// Test: An encoder restored from a saved state continues exactly where the saved one stopped.
+TEST(RLETest, RestoredEncoderContinuesEncoding)
+{
+    const std::string input =
+        "AAAA[SPACE][SPACE]\\[[[[B][B]CCCCC[SCREENSHOT_BASE64]AAAAA[/SCREENSHOT][ENTER]x[LSHIFT AAAA";
+    for (size_t split = 0; split <= input.size(); split++)
+    {
+        std::string output;
+        const RP::Encoder::RleStreamEncoder::Sink sink = [&output](std::string_view encoded) {
+            output.append(encoded);
+        };
+
+        RP::Encoder::RleStreamEncoder first(sink);
+        first.feed(std::string_view(input).substr(0, split));
+        const std::string state = first.saveState();
+
+        RP::Encoder::RleStreamEncoder second(sink);
+        second.restoreState(state);
+        second.feed(std::string_view(input).substr(split));
+        second.finish();
+        EXPECT_EQ(output, RP::Encoder::rle(input)) << "split at " << split;
+    }
+
+    RP::Encoder::RleStreamEncoder encoder(nullptr);
+    EXPECT_THROW(encoder.restoreState("garbage"), std::runtime_error);
+}
+
+TEST(RLETest, DecodeExpandsRunsAndTokens)
+{
+    EXPECT_EQ(RP::Encoder::rleDecode("A{4}B[SPACEx3][LSHIFT]x{12}"), "AAAAB[SPACE][SPACE][SPACE][LSHIFT]xxxxxxxxxxxx");
+    // Escaped brackets are plain characters and can be part of runs
+    EXPECT_EQ(RP::Encoder::rleDecode("\\[{4}A][A]"), "\\[[[[A][A]");
+    // Things the encoder never writes are left alone
+    EXPECT_EQ(RP::Encoder::rleDecode("a{2}b{04}c{x}[x2][ENTERx0][LSHIFT AAAA"), "a{2}b{04}c{x}[x2][ENTERx0][LSHIFT AAAA");
+}
+
+// Test: Counts that add up to more than any recording are rejected instead of wrapping the decoded size.
+TEST(RLETest, DecodeRejectsHugeCounts)
+{
+    // 18 * 999999999999999999 + 446744073709551634 wraps a 64 bit size around to 16
+    std::string wrapping;
+    for (int i = 0; i < 18; i++)
+    {
+        wrapping += "A{999999999999999999}";
+    }
+    wrapping += "A{446744073709551634}";
+
+    const std::string inputs[] = {wrapping, "x[SPACEx999999999999999999]", "é{99999999999999}"};
+    for (const std::string& encoded : inputs)
+    {
+        EXPECT_THROW(RP::Encoder::rleDecode(encoded), std::runtime_error) << encoded;
+
+        size_t streamedSize = 0;
+        EXPECT_THROW(RP::Encoder::rleDecode(
+                         encoded, [&streamedSize](std::string_view decoded) { streamedSize += decoded.size(); }),
+                     std::runtime_error)
+            << encoded;
+        EXPECT_LT(streamedSize, 1024u) << encoded;
+    }
+}
+
+// Test: Decoding the encoded string gives back the original.
+TEST(RLETest, DecodeReversesEncode)
+{
+    const std::string inputs[] = {
+        "",
+        "AAAA[SPACE][SPACE]xx[SPACE]\\[[[[B][B]CCCCC[ENTER]x[ENTER]  yyyyy",
+        "[SPACE][LSHIFT AAAA",
+        "[SCREENSHOT_BASE64]AAAAB//8=[/SCREENSHOT]{{{{{{}}}}}}" + std::string(100000, 'z') + "[TAB]",
+    };
+    for (const std::string& input : inputs)
+    {
+        const std::string encoded = RP::Encoder::rle(input);
+        EXPECT_EQ(RP::Encoder::rleDecode(encoded), input);
+
+        std::string streamed;
+        RP::Encoder::rleDecode(encoded, [&streamed](std::string_view decoded) { streamed.append(decoded); });
+        EXPECT_EQ(streamed, input);
+    }
+}
+
+// Decodes the output of a pass with its streaming decoder, fed in chunks of chunkSize
+static std::string decodeInChunks(std::string_view passName, std::string_view encoded, size_t chunkSize)
+{
+    std::string decoded;
+    std::unique_ptr<RP::Encoder::EncoderPass> decoder = RP::Encoder::findPass(passName)->createDecoder(
+        [&decoded](std::string_view output) { decoded.append(output); });
+    for (size_t i = 0; i < encoded.size(); i += chunkSize)
+    {
+        decoder->feed(encoded.substr(i, chunkSize));
+    }
+    decoder->finish();
+    return decoded;
+}
+
+// Test: The streaming decoder gives the same output as rleDecode() wherever its input is split.
+TEST(RLETest, StreamDecoderMatchesDecodeForAnyChunkSize)
+{
+    const std::string inputs[] = {
+        "AAAA[SPACE][SPACE]xx[SPACE]\\[[[[B][B]CCCCC[ENTER]x[ENTER]  yyyyy",
+        "a{4}\xc3\xa9{12}\xe2\x82\xac{5}[SPACEx3]\\[{4}A][A]a{2}b{04}c{x}[x2][ENTERx0]\\{5}]{6}[LSHIFT AAAA",
+        "[SCREENSHOT_BASE64]AAAAB//8=[/SCREENSHOT]{{{{{{}}}}}}z{100000}[TAB]\\[",
+    };
+    for (const std::string& encoded : inputs)
+    {
+        const std::string expected = RP::Encoder::rleDecode(encoded);
+        for (size_t chunkSize = 1; chunkSize <= 70; chunkSize++)
+        {
+            EXPECT_EQ(decodeInChunks("rle", encoded, chunkSize), expected) << "chunk size " << chunkSize;
+        }
+    }
+}
+
+// Test: Runs of multi-byte UTF-8 characters are collapsed like ASCII ones, wherever the input is split.
+TEST(RLETest, UTF8CharacterRuns)
+{
+    EXPECT_EQ(RP::Encoder::rle("ééééé"), "é{5}");
+    EXPECT_EQ(RP::Encoder::rle("aéééé字字字字字😀😀😀😀"), "aé{4}字{5}😀{4}");
+    // 'é' and 'è' share their first byte, that doesn't make them a run
+    EXPECT_EQ(RP::Encoder::rle("éèéèéè"), "éèéèéè");
+    // Bytes that aren't valid UTF-8 are characters of their own
+    EXPECT_EQ(RP::Encoder::rle("\xc3\xc3\xc3\xc3"), "\xc3{4}");
+    EXPECT_EQ(RP::Encoder::rle("\xc3\xa9\xa9\xa9\xa9\xa9"), "\xc3\xa9\xa9\xa9\xa9\xa9");
+
+    const std::string input = "ééééé[SPACE]字字字字x😀😀😀😀😀é\xc3\xc3\xc3\xc3\xa9\xa9\xa9\xa9\xe5\xad[ENTER]ééé";
+    const std::string encoded = RP::Encoder::rle(input);
+    EXPECT_EQ(RP::Encoder::rleDecode(encoded), input);
+    for (size_t chunkSize = 1; chunkSize <= input.size(); chunkSize++)
+    {
+        std::string streamed;
+        RP::Encoder::RleStreamEncoder encoder([&streamed](std::string_view piece) { streamed.append(piece); }, 4);
+        for (size_t i = 0; i < input.size(); i += chunkSize)
+        {
+            encoder.feed(std::string_view(input).substr(i, chunkSize));
+        }
+        encoder.finish();
+        EXPECT_EQ(streamed, encoded) << "chunk size " << chunkSize;
+
+        std::string parallel;
+        RP::Encoder::rleParallel(
+            input, 3, [&parallel](std::string_view piece) { parallel.append(piece); }, chunkSize);
+        EXPECT_EQ(parallel, encoded) << "chunk size " << chunkSize;
+    }
+}
+
+static void writeTestFile(const std::string& path, std::string_view contents)
+{
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+}
+
+static std::string readTestFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+// Test: Encoding a file in place gives the same output as rle(), also when an earlier run stopped after any window.
+TEST(RLETest, InPlaceEncodingMatchesRle)
+{
+    const std::string path = "test_in_place.txt";
+    // The output of the unclosed token at the end is longer than the input
+    const std::string input = "abcdefghij[SPACE]kl\\[[[[AAAAAAAA[SPACE][SPACE][SPACE]xéééé[ENTER]" +
+                              std::string(100, 'z') + "[TAB][TAB]0123456789[LSHIFT][LSHIFT AAAA";
+    const std::string expected = RP::Encoder::rle(input);
+    for (size_t stopAfter = 0; stopAfter <= input.size() / 7 + 1; stopAfter += 3)
+    {
+        writeTestFile(path, input);
+        {
+            // Stop without finishing, like a process that was killed
+            RP::Encoder::InPlaceEncoder encoder(path, 7);
+            for (size_t i = 0; i < stopAfter && encoder.encodeWindow(); i++)
+            {
+            }
+        }
+
+        RP::Encoder::InPlaceEncoder encoder(path, 5);
+        EXPECT_EQ(encoder.getOriginalLength(), input.size());
+        encoder.finish();
+        EXPECT_EQ(encoder.getEncodedLength(), expected.size());
+        EXPECT_EQ(readTestFile(path), expected) << "stopped after " << stopAfter << " windows";
+        EXPECT_FALSE(std::filesystem::exists(RP::Encoder::getJournalPath(path)));
+    }
+    std::filesystem::remove(path);
+}
+
+// Test: BlockFileWriter writes pieces smaller and larger than a block, and a partial last block, in order.
+TEST(RLETest, BlockFileWriterWritesAllPieces)
+{
+    const std::string path = "test_block_writer.txt";
+    std::string expected;
+    {
+        RP::Encoder::BlockFileWriter writer(path, 16);
+        for (const size_t pieceSize : {3, 13, 1, 40, 16, 0, 7, 33})
+        {
+            const std::string piece(pieceSize, static_cast<char>('a' + expected.size() % 26));
+            writer.write(piece);
+            expected += piece;
+        }
+        writer.close();
+    }
+    ASSERT_NE(expected.size() % 16, 0u);
+    RP::Encoder::MappedFile file(path);
+    EXPECT_EQ(file.view(), expected);
+    std::filesystem::remove(path);
+}
+
+// Test: Reopening with keepLength keeps that many bytes and appends after them, keepLength 0 truncates.
+TEST(RLETest, BlockFileWriterKeepsLength)
+{
+    const std::string path = "test_block_writer_keep.txt";
+    writeTestFile(path, "0123456789abcdef");
+    {
+        RP::Encoder::BlockFileWriter writer(path, 4, 10);
+        writer.write("XYZ");
+    }
+    EXPECT_EQ(readTestFile(path), "0123456789XYZ");
+
+    {
+        RP::Encoder::BlockFileWriter writer(path, 4, 13);
+        writer.write(std::string(9, 'w'));
+        writer.close();
+    }
+    EXPECT_EQ(RP::Encoder::MappedFile(path).view(), "0123456789XYZwwwwwwwww");
+
+    {
+        RP::Encoder::BlockFileWriter writer(path, 4);
+        writer.close();
+    }
+    EXPECT_EQ(std::filesystem::file_size(path), 0u);
+    EXPECT_TRUE(RP::Encoder::MappedFile(path).view().empty());
+    std::filesystem::remove(path);
+}
+
+// Test: Mapping a file that doesn't exist throws.
+TEST(RLETest, MappedFileThrowsForMissingFile)
+{
+    EXPECT_THROW(RP::Encoder::MappedFile("test_missing_file.txt"), std::runtime_error);
+}
+
+// Test: A checkpoint reads back as it was saved, while missing, truncated and foreign checkpoint files are ignored.
+TEST(RLETest, CheckpointRoundTrip)
+{
+    const std::string path = "test_checkpoint.checkpoint";
+    RP::Encoder::EncodeCheckpoint checkpoint;
+    checkpoint.inputOffset = 1234;
+    checkpoint.inputHash = 0x0123456789abcdefULL;
+    checkpoint.committedLength = 100;
+    checkpoint.encodedLength = 107;
+    checkpoint.encoderState = std::string("state\0with a nul", 16);
+    RP::Encoder::saveCheckpoint(path, checkpoint);
+
+    RP::Encoder::EncodeCheckpoint loaded;
+    ASSERT_TRUE(RP::Encoder::loadCheckpoint(path, loaded));
+    EXPECT_EQ(loaded.inputOffset, checkpoint.inputOffset);
+    EXPECT_EQ(loaded.inputHash, checkpoint.inputHash);
+    EXPECT_EQ(loaded.committedLength, checkpoint.committedLength);
+    EXPECT_EQ(loaded.encodedLength, checkpoint.encodedLength);
+    EXPECT_EQ(loaded.encoderState, checkpoint.encoderState);
+
+    const std::string contents = readTestFile(path);
+    for (size_t length : {size_t(0), size_t(5), size_t(20), contents.size() - 1})
+    {
+        writeTestFile(path, contents.substr(0, length));
+        EXPECT_FALSE(RP::Encoder::loadCheckpoint(path, loaded)) << "truncated to " << length;
+    }
+    writeTestFile(path, contents + "x");
+    EXPECT_FALSE(RP::Encoder::loadCheckpoint(path, loaded));
+    writeTestFile(path, "X" + contents.substr(1));
+    EXPECT_FALSE(RP::Encoder::loadCheckpoint(path, loaded));
+    std::filesystem::remove(path);
+    EXPECT_FALSE(RP::Encoder::loadCheckpoint(path, loaded));
+}
+
+// Test: Encoding a growing recording incrementally continues where the last run stopped, and the encoded file is
+// the same as encoding the whole recording, wherever the recording was cut.
+TEST(RLETest, IncrementalEncodingResumesAfterAppend)
+{
+    const std::string path = "test_incremental_encoded.txt";
+    std::filesystem::remove(path);
+    std::filesystem::remove(RP::Encoder::getCheckpointPath(path));
+    const std::string input = "abc[ENTER][ENTER]aaaaaaaa[SPACE]x\xc3\xa9\xc3\xa9\xc3\xa9" + std::string(50, 'z') +
+                              "[TAB][TAB][TAB]\\[[SCREENSHOT_BASE64]AAAA[ENTER][/SCREENSHOT]end[LSHIFT";
+
+    // Cuts in the middle of tokens, runs, UTF-8 characters and screenshots
+    uint64_t previousEnd = 0;
+    for (size_t end : {size_t(0), size_t(5), size_t(14), size_t(20), size_t(30), size_t(35), size_t(36), size_t(60),
+                       size_t(95), size_t(110), size_t(120), input.size() - 3, input.size(), input.size()})
+    {
+        const std::string_view grown = std::string_view(input).substr(0, end);
+        const RP::Encoder::IncrementalEncodeResult result = RP::Encoder::encodeIncrementally(grown, path, 4);
+        EXPECT_EQ(result.resumedFrom, previousEnd) << "cut at " << end;
+        const std::string expected = RP::Encoder::rle(std::string(grown));
+        EXPECT_EQ(readTestFile(path), expected) << "cut at " << end;
+        previousEnd = end;
+    }
+    std::filesystem::remove(path);
+    std::filesystem::remove(RP::Encoder::getCheckpointPath(path));
+}
+
+// Test: An incremental encode starts over when the recording was replaced or truncated, the encoded file changed, or
+// the checkpoint is truncated or corrupt.
+TEST(RLETest, IncrementalEncodingStartsOverWhenFilesChanged)
+{
+    const std::string path = "test_incremental_changed.txt";
+    const std::filesystem::path checkpointPath = RP::Encoder::getCheckpointPath(path);
+    std::filesystem::remove(path);
+    std::filesystem::remove(checkpointPath);
+    auto encode = [&path](std::string_view input)
+    {
+        const RP::Encoder::IncrementalEncodeResult result = RP::Encoder::encodeIncrementally(input, path, 4);
+        EXPECT_EQ(readTestFile(path), RP::Encoder::rle(std::string(input))) << input;
+        return result.resumedFrom;
+    };
+
+    std::string input = "hello [ENTER][ENTER] wooooorld";
+    EXPECT_EQ(encode(input), 0u);
+    input += "[ENTER]";
+    EXPECT_EQ(encode(input), 30u);
+
+    // Replaced by a recording that is as long, then by a shorter one
+    input[0] = 'j';
+    EXPECT_EQ(encode(input), 0u);
+    input.resize(10);
+    EXPECT_EQ(encode(input), 0u);
+
+    // The encoded file was appended to, then removed
+    writeTestFile(path, readTestFile(path) + "x");
+    EXPECT_EQ(encode(input + "a"), 0u);
+    std::filesystem::remove(path);
+    EXPECT_EQ(encode(input + "ab"), 0u);
+    EXPECT_EQ(encode(input + "abc"), 12u);
+
+    // The checkpoint was cut off, then holds an encoder state that doesn't restore
+    const std::string checkpoint = readTestFile(checkpointPath.string());
+    writeTestFile(checkpointPath.string(), checkpoint.substr(0, checkpoint.size() / 2));
+    EXPECT_EQ(encode(input + "abcd"), 0u);
+    RP::Encoder::EncodeCheckpoint corrupt;
+    ASSERT_TRUE(RP::Encoder::loadCheckpoint(checkpointPath, corrupt));
+    corrupt.encoderState = "not an encoder state";
+    RP::Encoder::saveCheckpoint(checkpointPath, corrupt);
+    EXPECT_EQ(encode(input + "abcde"), 0u);
+    EXPECT_EQ(encode(input + "abcdef"), 15u);
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(checkpointPath);
+}
+
+// Test: Stage output reaches the sink in pieces of the buffer size, however much is written at once.
+TEST(RLETest, StageOutputHandsOnBoundedPieces)
+{
+    std::string written;
+    std::vector<size_t> pieceSizes;
+    RP::Encoder::StageOutput output(
+        [&](std::string_view piece) {
+            written.append(piece);
+            pieceSizes.push_back(piece.size());
+        },
+        8);
+    output.append("abc");
+    output.append(std::string(20, 'x'));
+    output.append("[SPACE]");
+    output.flush();
+    output.flush();
+    EXPECT_EQ(written, "abc" + std::string(20, 'x') + "[SPACE]");
+    EXPECT_EQ(pieceSizes, std::vector<size_t>({8, 8, 8, 6}));
+}
+
+static std::string replayEdits(std::string_view input, size_t chunkSize)
+{
+    std::string edited;
+    RP::Encoder::EditReplayStage stage([&edited](std::string_view output) { edited.append(output); }, 16);
+    for (size_t i = 0; i < input.size(); i += chunkSize)
+    {
+        stage.feed(input.substr(i, chunkSize));
+    }
+    stage.finish();
+    return edited;
+}
+
+// Test: Backspaces delete typed characters and tokens, shift keys are dropped.
+TEST(RLETest, EditReplayAppliesBackspaces)
+{
+    const std::string input = "[LSHIFT]Helo[BACKSPACE]lo[SPACE][BACKSPACE][SPACE]w\xc3\xb6rk[BACKSPACE][BACKSPACE]"
+                              "[BACKSPACE]orld[ENTER]";
+    for (size_t chunkSize : {1, 3, 1000})
+    {
+        EXPECT_EQ(replayEdits(input, chunkSize), "Hello[SPACE]world[ENTER]");
+    }
+}
+
+// Test: Backspaces that reach past text the stage can't edit are kept.
+TEST(RLETest, EditReplayKeepsBackspacesItCantApply)
+{
+    EXPECT_EQ(replayEdits("[BACKSPACE]ab[LCTRL][BACKSPACE]c[BACKSPACE][BACKSPACE]", 1000),
+              "[BACKSPACE]ab[LCTRL][BACKSPACE][BACKSPACE]");
+    EXPECT_EQ(replayEdits("x\n[CHANGE_WINDOW]\"a [b]\" TIMESTAMP: 1[/CHANGE_WINDOW]\n[BACKSPACE]y[LSHIFT", 1000),
+              "x\n[CHANGE_WINDOW]\"a [b]\" TIMESTAMP: 1[/CHANGE_WINDOW]\n[BACKSPACE]y[LSHIFT");
+}
+
+// Test: A backspace isn't applied if the '\\' before the erased character would escape the next token.
+TEST(RLETest, EditReplayKeepsTokensUnescaped)
+{
+    EXPECT_EQ(replayEdits("a\\b[BACKSPACE][SPACE]", 1000), "a\\b[BACKSPACE][SPACE]");
+    EXPECT_EQ(replayEdits("\\\\b[BACKSPACE][ENTER]", 1000), "\\\\b[BACKSPACE][ENTER]");
+    EXPECT_EQ(replayEdits("a\\bc[BACKSPACE]", 1000), "a\\b");
+
+    // Also when the '\\' was written out because the editable text grew too long
+    const std::string input =
+        std::string(RP::Encoder::EditReplayStage::MAX_EDITABLE_TEXT_SIZE, 'x') + "\\b[BACKSPACE][LCTRL]";
+    EXPECT_EQ(replayEdits(input, RP::Encoder::EditReplayStage::MAX_EDITABLE_TEXT_SIZE + 1), input);
+}
+
+// Test: Window change records and screenshots are copied untouched.
+TEST(RLETest, EditReplayCopiesRecords)
+{
+    const std::string input = "[CHANGE_WINDOW]\"[BACKSPACE]\"[/CHANGE_WINDOW][SCREENSHOT_BASE64]AAAA[/SCREENSHOT]"
+                              "[SCREENSHOT_PATH]\"a[LSHIFT].png\"[/SCREENSHOT]\\[BACKSPACE]";
+    EXPECT_EQ(replayEdits(input, 5), input);
+}
+
+// Test: Passes of a pipeline run in order and count the bytes going through them.
+TEST(RLETest, PipelineRunsPassesInOrder)
+{
+    const std::string input = "AAAAb[BACKSPACE][SPACE][SPACE]c[LSHIFT]";
+    std::string encoded;
+    RP::Encoder::EncoderPipeline pipeline({"edits", "rle"},
+                                          [&encoded](std::string_view output) { encoded.append(output); });
+    for (char c : input)
+    {
+        pipeline.feed(std::string_view(&c, 1));
+    }
+    pipeline.finish();
+    EXPECT_EQ(encoded, RP::Encoder::rle(replayEdits(input, input.size())));
+
+    const std::vector<RP::Encoder::PassStats>& stats = pipeline.getStats();
+    ASSERT_EQ(stats.size(), 2u);
+    EXPECT_EQ(stats[0].name, "edits");
+    EXPECT_EQ(stats[0].bytesIn, input.size());
+    EXPECT_EQ(stats[0].bytesOut, stats[1].bytesIn);
+    EXPECT_EQ(stats[1].bytesOut, encoded.size());
+
+    EXPECT_THROW(RP::Encoder::EncoderPipeline({"rle", "nope"}, nullptr), std::runtime_error);
+}
+
+static std::string filterTokens(std::string_view input, const RP::Encoder::TokenSet& removedTokens)
+{
+    std::string filtered;
+    RP::Encoder::TokenFilterStage stage([&filtered](std::string_view output) { filtered.append(output); },
+                                        removedTokens, 16);
+    for (size_t i = 0; i < input.size(); i += 3)
+    {
+        stage.feed(input.substr(i, 3));
+    }
+    stage.finish();
+    return filtered;
+}
+
+// Test: Only the chosen tokens are removed, brackets that aren't special tokens are text.
+TEST(RLETest, TokenFilterRemovesChosenTokens)
+{
+    RP::Encoder::TokenSet removedTokens;
+    removedTokens.set(static_cast<size_t>(RP::Tokens::TokenId::LeftShift));
+    removedTokens.set(static_cast<size_t>(RP::Tokens::TokenId::Space));
+    EXPECT_EQ(filterTokens("[LSHIFT]a[SPACE][x][ENTER]\\[SPACE][LSHIFT", removedTokens), "a[x][ENTER]\\[SPACE][LSHIFT");
+
+    removedTokens.set();
+    EXPECT_EQ(filterTokens("a[SPACE]b[ENTER][foo]", removedTokens), "ab[foo]");
+}
+
+// Test: Removing the token that starts a record removes the whole record.
+TEST(RLETest, TokenFilterRemovesWholeRecords)
+{
+    const std::string input = "a\n[CHANGE_WINDOW]\"[LSHIFT]\"[/CHANGE_WINDOW]\n[SCREENSHOT_BASE64]AAAA[/SCREENSHOT]b"
+                              "[SCREENSHOT_PATH]\"x.png\"[/SCREENSHOT]c";
+    RP::Encoder::TokenSet removedTokens;
+    removedTokens.set(static_cast<size_t>(RP::Tokens::TokenId::ScreenshotBase64));
+    removedTokens.set(static_cast<size_t>(RP::Tokens::TokenId::LeftShift));
+    EXPECT_EQ(filterTokens(input, removedTokens),
+              "a\n[CHANGE_WINDOW]\"[LSHIFT]\"[/CHANGE_WINDOW]\nb[SCREENSHOT_PATH]\"x.png\"[/SCREENSHOT]c");
+
+    removedTokens.set();
+    EXPECT_EQ(filterTokens(input, removedTokens), "a\n\nbc");
+}
+
+static std::string compactPhrases(std::string_view input, size_t chunkSize)
+{
+    std::string compacted;
+    RP::Encoder::PhraseCompactionStage stage([&compacted](std::string_view output) { compacted.append(output); }, 16);
+    for (size_t i = 0; i < input.size(); i += chunkSize)
+    {
+        stage.feed(input.substr(i, chunkSize));
+    }
+    stage.finish();
+    return compacted;
+}
+
+// Test: Repeated phrases become references, including ones that overlap what they produce.
+TEST(RLETest, PhraseCompactionReplacesRepeats)
+{
+    EXPECT_EQ(compactPhrases("abcabcabcabcabcabc", 1000), "abc[^3,15]");
+    EXPECT_EQ(compactPhrases("hello world, hello world, again", 1000), "hello world, [^13,13]again");
+    EXPECT_EQ(compactPhrases("short short", 1000), "short short");
+}
+
+// Test: Decoding the compacted input gives back the input, however it was split into chunks.
+TEST(RLETest, PhraseCompactionRoundTrip)
+{
+    std::string input = "[^3,4] [^^ \\[^1,1] ";
+    for (int i = 0; i < 200; i++)
+    {
+        input += "[CHANGE_WINDOW]\"Terminal\" TIMESTAMP: " + std::to_string(1700000000 + i * 7) +
+                 "[/CHANGE_WINDOW]\nls[SPACE]-la[ENTER]\\\\[ENTER]";
+        input += std::string(i % 13, 'x') + "[SPACE][^" + std::to_string(i) + "," + std::to_string(i % 5) + "]";
+    }
+    for (size_t chunkSize : {1, 7, 100000})
+    {
+        const std::string compacted = compactPhrases(input, chunkSize);
+        EXPECT_LT(compacted.size(), input.size() / 2);
+        EXPECT_EQ(RP::Encoder::phraseDecode(compacted), input);
+        EXPECT_EQ(decodeInChunks("phrases", compacted, chunkSize), input) << "chunk size " << chunkSize;
+    }
+}
+
+static std::string windowChange(std::string_view title, std::string_view timestamp)
+{
+    return "\n[CHANGE_WINDOW]\"" + std::string(title) + "\" TIMESTAMP: " + std::string(timestamp) +
+           "[/CHANGE_WINDOW]\n";
+}
+
+static std::string compactTimestamps(std::string_view input, size_t chunkSize)
+{
+    std::string compacted;
+    RP::Encoder::TimestampDeltaStage stage([&compacted](std::string_view output) { compacted.append(output); });
+    for (size_t i = 0; i < input.size(); i += chunkSize)
+    {
+        stage.feed(input.substr(i, chunkSize));
+    }
+    stage.finish();
+    return compacted;
+}
+
+// Test: Timestamps within the same day become deltas, a new day or a long gap gets a full timestamp.
+TEST(RLETest, TimestampDeltasWithinADay)
+{
+    const std::string input = windowChange("a", "2026 October seventeenth 14:03") + "typed" +
+                              windowChange("b [x]", "2026 October seventeenth 14:06") +
+                              windowChange("c", "2026 October seventeenth 14:06") +
+                              windowChange("d", "2026 October seventeenth 16:00") +
+                              windowChange("e", "2026 October eighteenth 00:01");
+    const std::string expected = windowChange("a", "2026 October seventeenth 14:03") + "typed" +
+                                 windowChange("b [x]", "+3m") + windowChange("c", "+0m") +
+                                 windowChange("d", "2026 October seventeenth 16:00") +
+                                 windowChange("e", "2026 October eighteenth 00:01");
+    for (size_t chunkSize : {1, 5, 1000})
+    {
+        EXPECT_EQ(compactTimestamps(input, chunkSize), expected);
+    }
+    EXPECT_EQ(RP::Encoder::timestampDeltaDecode(expected), input);
+}
+
+// Test: Text that looks like a delta or isn't a timestamp survives the round trip.
+TEST(RLETest, TimestampDeltaRoundTrip)
+{
+    const std::string input = windowChange("a", "2026 October seventeenth 14:03") + windowChange("b", "+3m") +
+                              windowChange("\" TIMESTAMP: +1m", "2026 October seventeenth 14:04") +
+                              windowChange("c", "2026 Octobre seventeenth 14:05") +
+                              windowChange("d", "2026 October seventeenth 14:05") + windowChange("e", "++") +
+                              windowChange("f", std::string(100, '+')) + "\\[CHANGE_WINDOW]\" TIMESTAMP: +1m]" +
+                              "[CHANGE_WINDOW]\" TIMESTAMP: 2026 October seventeenth 14:05";
+    for (size_t chunkSize : {1, 7, 1000})
+    {
+        EXPECT_EQ(RP::Encoder::timestampDeltaDecode(compactTimestamps(input, chunkSize)), input);
+    }
+}
+
+static std::string collapseStorms(std::string_view input, int maxGapMinutes)
+{
+    std::string collapsed;
+    RP::Encoder::WindowStormStage stage([&collapsed](std::string_view output) { collapsed.append(output); },
+                                        maxGapMinutes, 16);
+    for (size_t i = 0; i < input.size(); i += 3)
+    {
+        stage.feed(input.substr(i, 3));
+    }
+    stage.finish();
+    return collapsed;
+}
+
+// Test: Window changes with only window switching keys in between collapse into the last one.
+TEST(RLETest, WindowStormsCollapse)
+{
+    auto collapsedWindowChange = [](std::string_view windows, std::string_view title, std::string_view timestamp) {
+        return "\n[CHANGE_WINDOW]" + std::string(windows) + ", then " + windowChange(title, timestamp).substr(16);
+    };
+    const std::string first = "2026 October seventeenth 14:03";
+    const std::string second = "2026 October seventeenth 14:04";
+    const std::string input = "ab" + windowChange("a", first) + "[ALT+TAB]" + windowChange("b", first) + "[ALT][TAB]" +
+                              windowChange("c", second) + "typed" + windowChange("d", second) +
+                              windowChange("e", second) + "[ENTER]" + windowChange("f", second) + "[LSHIFT]";
+    EXPECT_EQ(collapseStorms(input, 0), "ab" + collapsedWindowChange("1 brief window", "b", first) + "[ALT][TAB]" +
+                                            windowChange("c", second) + "typed" +
+                                            collapsedWindowChange("1 brief window", "e", second) + "[ENTER]" +
+                                            windowChange("f", second) + "[LSHIFT]");
+    EXPECT_EQ(collapseStorms(input, 1), "ab" + collapsedWindowChange("2 brief windows", "c", second) + "typed" +
+                                            collapsedWindowChange("1 brief window", "e", second) + "[ENTER]" +
+                                            windowChange("f", second) + "[LSHIFT]");
+}
+
 int main(int argc, char **argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
-}
\ No newline at end of file
+}
+
+// Test: '*' matches any sequence, also after a partial match that has to be undone, and '?' any one character.
+TEST(RLETest, BatchPatternMatching)
+{
+    EXPECT_TRUE(RP::Encoder::matchesPattern("recording.txt", "*"));
+    EXPECT_TRUE(RP::Encoder::matchesPattern("", "*"));
+    EXPECT_TRUE(RP::Encoder::matchesPattern("recording.txt", "rec*.txt"));
+    EXPECT_TRUE(RP::Encoder::matchesPattern("recording.txt", "*.t?t"));
+    EXPECT_TRUE(RP::Encoder::matchesPattern("a.txt.txt", "*.txt"));
+    EXPECT_TRUE(RP::Encoder::matchesPattern("abcabcabd", "*abd"));
+    EXPECT_TRUE(RP::Encoder::matchesPattern("aXbXbXc", "a*b*c"));
+    EXPECT_TRUE(RP::Encoder::matchesPattern("day1_log.txt", "day?_*log*"));
+    EXPECT_FALSE(RP::Encoder::matchesPattern("recording.txt", "*.log"));
+    EXPECT_FALSE(RP::Encoder::matchesPattern("abcabcabc", "*abd"));
+    EXPECT_FALSE(RP::Encoder::matchesPattern("recording.txt", "recording.txt?"));
+    EXPECT_FALSE(RP::Encoder::matchesPattern("recording", ""));
+    EXPECT_FALSE(RP::Encoder::matchesPattern("aXbXc", "a*b*b*c"));
+}
+
+// Test: Encoded outputs are named after their input and recognized as such.
+TEST(RLETest, BatchEncodedFilenames)
+{
+    EXPECT_EQ(RP::Encoder::getEncodedFilename("dir/out.txt"), std::filesystem::path("dir/out_encoded.txt"));
+    EXPECT_TRUE(RP::Encoder::isEncodedFilename("dir/out_encoded.txt"));
+    EXPECT_TRUE(RP::Encoder::isEncodedFilename("_encoded"));
+    EXPECT_FALSE(RP::Encoder::isEncodedFilename("out.txt"));
+    EXPECT_FALSE(RP::Encoder::isEncodedFilename("out_encoded_2.txt"));
+}
+
+// Test: A batch lists the matching recordings largest first, skips encoded outputs and only counts a non-empty
+// output written after its input as up to date.
+TEST(RLETest, BatchCollectsFilesAndChecksOutputs)
+{
+    const std::filesystem::path directory = "test_batch";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    writeTestFile((directory / "small.txt").string(), "a");
+    writeTestFile((directory / "large.txt").string(), "abcdefgh");
+    writeTestFile((directory / "medium.txt").string(), "abcd");
+    writeTestFile((directory / "empty.txt").string(), "");
+    writeTestFile((directory / "medium.log").string(), "abcdefghijkl");
+    writeTestFile((directory / "large_encoded.txt").string(), "abcdefgh");
+
+    const std::vector<RP::Encoder::BatchFile> files = RP::Encoder::collectBatchFiles(directory / "*.txt", "");
+    ASSERT_EQ(files.size(), 4u);
+    EXPECT_EQ(files[0].inputFilename.filename(), "large.txt");
+    EXPECT_EQ(files[0].outputFilename, directory / "large_encoded.txt");
+    EXPECT_EQ(files[0].size, 8u);
+    EXPECT_EQ(files[1].inputFilename.filename(), "medium.txt");
+    EXPECT_EQ(files[2].inputFilename.filename(), "small.txt");
+    EXPECT_EQ(files[3].inputFilename.filename(), "empty.txt");
+    EXPECT_EQ(RP::Encoder::collectBatchFiles(directory, "out")[0].outputFilename,
+              std::filesystem::path("out") / "medium_encoded.log");
+
+    const auto inputTime = std::filesystem::last_write_time(directory / "large.txt");
+    // Written after the input
+    EXPECT_TRUE(RP::Encoder::isUpToDate(files[0]));
+    // No output yet
+    EXPECT_FALSE(RP::Encoder::isUpToDate(files[1]));
+    // An empty output is stale, unless the input is empty too
+    writeTestFile(files[2].outputFilename.string(), "");
+    writeTestFile(files[3].outputFilename.string(), "");
+    std::filesystem::last_write_time(files[2].outputFilename, inputTime + std::chrono::hours(1));
+    std::filesystem::last_write_time(files[3].outputFilename, inputTime + std::chrono::hours(1));
+    EXPECT_FALSE(RP::Encoder::isUpToDate(files[2]));
+    EXPECT_TRUE(RP::Encoder::isUpToDate(files[3]));
+    // Modifying the input makes the output stale
+    std::filesystem::last_write_time(files[0].inputFilename, inputTime + std::chrono::hours(2));
+    EXPECT_FALSE(RP::Encoder::isUpToDate(files[0]));
+
+    std::filesystem::remove_all(directory);
+}
@@ -0,0 +1,150 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "encoder/scan_kernels.h"
+
+using RP::Encoder::Kernels::SimdLevel;
+
+class ScanKernelsTest : public ::testing::Test
+{
+  protected:
+    // All SIMD levels this CPU can run, the scalar one is the reference
+    std::vector<SimdLevel> getSupportedLevels()
+    {
+        std::vector<SimdLevel> levels = {SimdLevel::Scalar};
+        const SimdLevel best = RP::Encoder::Kernels::detectSimdLevel();
+        if (best == SimdLevel::SSE2 || best == SimdLevel::AVX2)
+        {
+            levels.push_back(SimdLevel::SSE2);
+        }
+        if (best == SimdLevel::AVX2)
+        {
+            levels.push_back(SimdLevel::AVX2);
+        }
+        return levels;
+    }
+
+    // Random text with a few delimiters, runs and non-ASCII characters, long enough to cover the vector loops and
+    // their tails
+    std::string makeInput(std::mt19937& rng, size_t size)
+    {
+        std::string input;
+        while (input.size() < size)
+        {
+            const int kind = rng() % 20;
+            if (kind == 0)
+            {
+                input += "[]\\"[rng() % 3];
+            }
+            else if (kind == 1)
+            {
+                input.append(rng() % 70, static_cast<char>('a' + rng() % 26));
+            }
+            else if (kind == 2)
+            {
+                input += "\xc3\xa9";
+            }
+            else
+            {
+                input += static_cast<char>('a' + rng() % 26);
+            }
+        }
+        input.resize(size);
+        return input;
+    }
+};
+
+TEST_F(ScanKernelsTest, FindDelimiter)
+{
+    const std::string input = "hello world, this is a long line of text [SPACE] and more text";
+    for (SimdLevel level : getSupportedLevels())
+    {
+        EXPECT_EQ(RP::Encoder::Kernels::findDelimiter(input.data(), input.size(), level), input.find('['));
+        EXPECT_EQ(RP::Encoder::Kernels::findDelimiter(input.data(), 20, level), 20u);
+        EXPECT_EQ(RP::Encoder::Kernels::findDelimiter("ab\\c", 4, level), 2u);
+        EXPECT_EQ(RP::Encoder::Kernels::findDelimiter("", 0, level), 0u);
+    }
+}
+
+TEST_F(ScanKernelsTest, CountRun)
+{
+    const std::string input = std::string(100, 'A') + "B";
+    for (SimdLevel level : getSupportedLevels())
+    {
+        EXPECT_EQ(RP::Encoder::Kernels::countRun(input.data(), input.size(), 'A', level), 100u);
+        EXPECT_EQ(RP::Encoder::Kernels::countRun(input.data(), 64, 'A', level), 64u);
+        EXPECT_EQ(RP::Encoder::Kernels::countRun(input.data(), input.size(), 'B', level), 0u);
+    }
+}
+
+TEST_F(ScanKernelsTest, FindRepeat)
+{
+    const std::string input = "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzz";
+    for (SimdLevel level : getSupportedLevels())
+    {
+        EXPECT_EQ(RP::Encoder::Kernels::findRepeat(input.data(), input.size(), level), input.size() - 2);
+        EXPECT_EQ(RP::Encoder::Kernels::findRepeat(input.data(), input.size() - 1, level), input.size() - 1);
+        EXPECT_EQ(RP::Encoder::Kernels::findRepeat("a", 1, level), 1u);
+    }
+}
+
+TEST_F(ScanKernelsTest, FindNonAscii)
+{
+    const std::string input = "plain ASCII text that is long enough for the vector loops: caf\xc3\xa9";
+    for (SimdLevel level : getSupportedLevels())
+    {
+        EXPECT_EQ(RP::Encoder::Kernels::findNonAscii(input.data(), input.size(), level), input.size() - 2);
+        EXPECT_EQ(RP::Encoder::Kernels::findNonAscii(input.data(), 40, level), 40u);
+        EXPECT_EQ(RP::Encoder::Kernels::findNonAscii("\x80", 1, level), 0u);
+        EXPECT_EQ(RP::Encoder::Kernels::findNonAscii("", 0, level), 0u);
+    }
+}
+
+TEST_F(ScanKernelsTest, CountBase64)
+{
+    const std::string input = "iVBORw0KGgoAAAANSUhEUgAAAAEAAAABCAYAAAAfFcSJAAAADUlEQVR42mNk+M9QDwADhgGAWjR9awAAAABJRU5ErkJggg=="
+                              "[/SCREENSHOT]";
+    for (SimdLevel level : getSupportedLevels())
+    {
+        EXPECT_EQ(RP::Encoder::Kernels::countBase64(input.data(), input.size(), level), input.find('['));
+        EXPECT_EQ(RP::Encoder::Kernels::countBase64(input.data(), 40, level), 40u);
+        EXPECT_EQ(RP::Encoder::Kernels::countBase64("ab\xc3\xa9", 4, level), 2u);
+        EXPECT_EQ(RP::Encoder::Kernels::countBase64("", 0, level), 0u);
+    }
+}
+
+// Test: Every SIMD level gives the same results as the scalar kernels for all offsets and lengths.
+TEST_F(ScanKernelsTest, SimdMatchesScalar)
+{
+    std::mt19937 rng(42);
+    for (int iteration = 0; iteration < 200; iteration++)
+    {
+        const std::string input = makeInput(rng, rng() % 300);
+        for (size_t offset = 0; offset < std::min<size_t>(input.size(), 40); offset++)
+        {
+            const char* data = input.data() + offset;
+            const size_t size = input.size() - offset;
+            const size_t expectedDelimiter = RP::Encoder::Kernels::findDelimiter(data, size, SimdLevel::Scalar);
+            const size_t expectedRun = RP::Encoder::Kernels::countRun(data, size, data[0], SimdLevel::Scalar);
+            const size_t expectedRepeat = RP::Encoder::Kernels::findRepeat(data, size, SimdLevel::Scalar);
+            const size_t expectedNonAscii = RP::Encoder::Kernels::findNonAscii(data, size, SimdLevel::Scalar);
+            const size_t expectedBase64 = RP::Encoder::Kernels::countBase64(data, size, SimdLevel::Scalar);
+
+            for (SimdLevel level : getSupportedLevels())
+            {
+                EXPECT_EQ(RP::Encoder::Kernels::findDelimiter(data, size, level), expectedDelimiter);
+                EXPECT_EQ(RP::Encoder::Kernels::countRun(data, size, data[0], level), expectedRun);
+                EXPECT_EQ(RP::Encoder::Kernels::findRepeat(data, size, level), expectedRepeat);
+                EXPECT_EQ(RP::Encoder::Kernels::findNonAscii(data, size, level), expectedNonAscii);
+                EXPECT_EQ(RP::Encoder::Kernels::countBase64(data, size, level), expectedBase64);
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -1,10 +1,266 @@
 #include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include "utils/binary_event_log.h"
+#include "utils/special_tokens.h"
 #include "utils/timestamp_utils.h"
+#include "utils/utf8.h"
 
 class UtilsTest : public ::testing::Test
 {
 };
 
+using RP::Tokens::TokenId;
+
+TEST_F(UtilsTest, LookupFindsEveryKnownToken)
+{
+    for (size_t id = 0; id < RP::Tokens::TOKEN_COUNT; id++)
+    {
+        const TokenId tokenId = static_cast<TokenId>(id);
+        EXPECT_EQ(RP::Tokens::lookupToken(RP::Tokens::getTokenContent(tokenId)), tokenId)
+            << RP::Tokens::getTokenString(tokenId);
+    }
+    static_assert(RP::Tokens::lookupToken("SCREENSHOT_BASE64") == TokenId::ScreenshotBase64);
+}
+
+TEST_F(UtilsTest, LookupRejectsUnknownTokens)
+{
+    // Same length, first and last character as known tokens, so they land in a used slot of the table
+    EXPECT_EQ(RP::Tokens::lookupToken("EXTER"), TokenId::Unknown);
+    EXPECT_EQ(RP::Tokens::lookupToken("TXB"), TokenId::Unknown);
+    EXPECT_EQ(RP::Tokens::lookupToken(""), TokenId::Unknown);
+    EXPECT_EQ(RP::Tokens::lookupToken("enter"), TokenId::Unknown);
+    EXPECT_EQ(RP::Tokens::lookupToken("[ENTER]"), TokenId::Unknown);
+    EXPECT_EQ(RP::Tokens::lookupToken("ENTERx2"), TokenId::Unknown);
+}
+
+TEST_F(UtilsTest, TimestampParsingMatchesFormatting)
+{
+    std::tm time{};
+    time.tm_year = 2026 - 1900;
+    time.tm_mon = 8;
+    time.tm_mday = 27;
+    time.tm_hour = 9;
+    time.tm_min = 5;
+    const std::string formatted = RP::Utils::formatTimestampToLLMReadable(&time);
+    EXPECT_EQ(formatted.size(), RP::Utils::MAX_LLM_READABLE_TIMESTAMP_LENGTH);
+
+    RP::Utils::LLMReadableTimestamp timestamp;
+    ASSERT_TRUE(RP::Utils::parseLLMReadableTimestamp(formatted, timestamp));
+    EXPECT_EQ(timestamp.year, 2026);
+    EXPECT_EQ(timestamp.month, 9);
+    EXPECT_EQ(timestamp.day, 27);
+    EXPECT_EQ(timestamp.hour, 9);
+    EXPECT_EQ(timestamp.minute, 5);
+
+    char buffer[RP::Utils::MAX_LLM_READABLE_TIMESTAMP_LENGTH];
+    const size_t length = RP::Utils::formatTimestampToLLMReadable(timestamp, buffer, sizeof(buffer));
+    EXPECT_EQ(std::string_view(buffer, length), formatted);
+
+    EXPECT_FALSE(RP::Utils::parseLLMReadableTimestamp("2026 September twenty-seventh 9:05", timestamp));
+    EXPECT_FALSE(RP::Utils::parseLLMReadableTimestamp("2026 September 27th 09:05", timestamp));
+    EXPECT_FALSE(RP::Utils::parseLLMReadableTimestamp("2026 September twenty-seventh 24:00", timestamp));
+    EXPECT_FALSE(RP::Utils::parseLLMReadableTimestamp("2026  September twenty-seventh 09:05", timestamp));
+}
+
+TEST_F(UtilsTest, Utf16ConvertsToUtf8)
+{
+    auto convert = [](std::u16string_view text)
+    {
+        std::string converted(RP::Utils::getUtf8Length(text), '\0');
+        EXPECT_EQ(RP::Utils::convertUtf16ToUtf8(text, converted.data()), converted.size());
+        return converted;
+    };
+
+    // Long enough for blocks of eight ASCII characters, with non-ASCII characters inside and after blocks
+    EXPECT_EQ(convert(u"Hello, world! This is plain ASCII text"), "Hello, world! This is plain ASCII text");
+    EXPECT_EQ(convert(u"caf\u00e9 na\u00efve r\u00e9sum\u00e9 \u65e5\u672c\u8a9e and \U0001F600 at the end"),
+              "caf\xc3\xa9 na\xc3\xafve r\xc3\xa9sum\xc3\xa9 "
+              "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e and \xf0\x9f\x98\x80 at the end");
+    EXPECT_EQ(convert(u""), "");
+
+    // Unpaired surrogates become U+FFFD
+    const char16_t unpaired[] = {u'a', 0xD800, u'b', 0xDC00, 0xD83D};
+    EXPECT_EQ(convert(std::u16string_view(unpaired, 5)), "a\xef\xbf\xbd" "b\xef\xbf\xbd\xef\xbf\xbd");
+}
+
+TEST_F(UtilsTest, Utf32ConvertsToUtf8)
+{
+    const char32_t text[] = {U'A', 0xE9, 0x65E5, 0x1F600, 0xD800, 0x110000};
+    const std::u32string_view view(text, 6);
+    std::string converted(RP::Utils::getUtf8Length(view), '\0');
+    EXPECT_EQ(RP::Utils::convertUtf32ToUtf8(view, converted.data()), converted.size());
+    EXPECT_EQ(converted, "A\xc3\xa9\xe6\x97\xa5\xf0\x9f\x98\x80\xef\xbf\xbd\xef\xbf\xbd");
+}
+
+TEST_F(UtilsTest, TimestampFieldsFromEpochSeconds)
+{
+    auto expectFields = [](int64_t seconds, int year, int month, int day, int hour, int minute)
+    {
+        const RP::Utils::LLMReadableTimestamp timestamp = RP::Utils::getLLMReadableTimestamp(seconds);
+        EXPECT_EQ(timestamp.year, year) << seconds;
+        EXPECT_EQ(timestamp.month, month) << seconds;
+        EXPECT_EQ(timestamp.day, day) << seconds;
+        EXPECT_EQ(timestamp.hour, hour) << seconds;
+        EXPECT_EQ(timestamp.minute, minute) << seconds;
+    };
+    expectFields(0, 1970, 1, 1, 0, 0);
+    expectFields(-1, 1969, 12, 31, 23, 59);
+    expectFields(1709210096, 2024, 2, 29, 12, 34);
+    expectFields(1792227570, 2026, 10, 17, 8, 59);
+}
+
+TEST_F(UtilsTest, VarintsRoundTrip)
+{
+    for (uint64_t value : {uint64_t(0), uint64_t(127), uint64_t(128), uint64_t(1) << 32, ~uint64_t(0)})
+    {
+        char buffer[RP::EventLog::MAX_VARINT_LENGTH];
+        const size_t length = RP::EventLog::writeVarint(value, buffer);
+        size_t position = 0;
+        uint64_t read = 0;
+        ASSERT_TRUE(RP::EventLog::readVarint(std::string_view(buffer, length), position, read));
+        EXPECT_EQ(read, value);
+        EXPECT_EQ(position, length);
+
+        // A cut off varint is incomplete, not malformed
+        position = 0;
+        EXPECT_FALSE(RP::EventLog::readVarint(std::string_view(buffer, length - 1), position, read));
+        EXPECT_EQ(position, 0u);
+    }
+}
+
+TEST_F(UtilsTest, BinaryEventLogRendersAsText)
+{
+    using RP::EventLog::RecordType;
+    std::string log;
+    auto appendRecord = [&log](RecordType type, uint64_t elapsed, std::string_view payload)
+    {
+        char header[RP::EventLog::MAX_RECORD_HEADER_LENGTH];
+        log.append(header, RP::EventLog::writeRecordHeader(type, elapsed, payload.size(), header));
+        log.append(payload);
+    };
+
+    // 2026 October seventeenth 08:59:30 UTC, recorded two hours ahead of UTC
+    char session[RP::EventLog::MAX_SESSION_PAYLOAD_LENGTH];
+    appendRecord(RecordType::SessionStart, 0,
+                 std::string_view(session, RP::EventLog::writeSessionPayload(1792227570000, 120, session)));
+    char token[RP::EventLog::MAX_RECORD_HEADER_LENGTH];
+    log.append(token, RP::EventLog::writeTokenRecord(TokenId::Enter, 5, token));
+    appendRecord(RecordType::Text, 200, "h\xc3\xa9llo");
+    appendRecord(RecordType::WindowChange, 30000, "main.cpp - Visual Studio Code");
+    appendRecord(RecordType::ScreenshotPath, 70000, "./replay-screenshots/ss_2026-10-17_11-01-10.png");
+    appendRecord(RecordType::ScreenshotBase64, 1, "iVBORw0KGgoAAAANSUhEUgAA");
+
+    const std::string expected = "[ENTER]h\xc3\xa9llo\n[CHANGE_WINDOW]\"main.cpp - Visual Studio Code\" TIMESTAMP: "
+                                 "2026 October seventeenth 11:00[/CHANGE_WINDOW]\n"
+                                 "[SCREENSHOT_PATH]\"./replay-screenshots/ss_2026-10-17_11-01-10.png\"[/SCREENSHOT]"
+                                 "[SCREENSHOT_BASE64]iVBORw0KGgoAAAANSUhEUgAA[/SCREENSHOT]";
+    {
+        RP::EventLog::TextRenderer renderer;
+        std::string text;
+        EXPECT_EQ(renderer.render(log, text), log.size());
+        EXPECT_EQ(text, expected);
+        EXPECT_EQ(renderer.getRecordCount(), 6u);
+    }
+
+    // The length of a record is known from its header alone
+    {
+        RP::EventLog::TextRenderer renderer;
+        std::string text;
+        size_t position = 0;
+        while (position < log.size())
+        {
+            const std::string_view header = std::string_view(log).substr(position, RP::EventLog::MAX_RECORD_HEADER_LENGTH);
+            const uint64_t length = RP::EventLog::getRecordLength(header);
+            ASSERT_GT(length, 0u);
+            EXPECT_EQ(renderer.render(std::string_view(log).substr(position, length), text), length);
+            position += length;
+        }
+        EXPECT_EQ(position, log.size());
+        EXPECT_EQ(text, expected);
+        EXPECT_EQ(RP::EventLog::getRecordLength(std::string_view(log).substr(0, 1)), 0u);
+    }
+
+    // Fed a byte at a time, records are rendered once they are complete
+    RP::EventLog::TextRenderer renderer;
+    std::string text;
+    size_t rendered = 0;
+    for (size_t end = 1; end <= log.size(); end++)
+    {
+        rendered += renderer.render(std::string_view(log).substr(rendered, end - rendered), text);
+    }
+    EXPECT_EQ(rendered, log.size());
+    EXPECT_EQ(text, expected);
+}
+
+TEST_F(UtilsTest, BinaryEventLogMergesTextRecords)
+{
+    using RP::EventLog::RecordType;
+    auto appendRecord = [](std::string &log, RecordType type, uint64_t elapsed, std::string_view payload)
+    {
+        char header[RP::EventLog::MAX_RECORD_HEADER_LENGTH];
+        log.append(header, RP::EventLog::writeRecordHeader(type, elapsed, payload.size(), header));
+        log.append(payload);
+    };
+    auto appendToken = [](std::string &log, uint64_t elapsed)
+    {
+        char token[RP::EventLog::MAX_RECORD_HEADER_LENGTH];
+        log.append(token, RP::EventLog::writeTokenRecord(TokenId::Enter, elapsed, token));
+    };
+
+    char session[RP::EventLog::MAX_SESSION_PAYLOAD_LENGTH];
+    const std::string_view sessionPayload(session, RP::EventLog::writeSessionPayload(1792227570000, 120, session));
+    std::string log;
+    appendRecord(log, RecordType::SessionStart, 0, sessionPayload);
+    appendRecord(log, RecordType::Text, 3, "he");
+    appendRecord(log, RecordType::Text, 100, "llo");
+    appendToken(log, 5);
+    appendRecord(log, RecordType::Text, 10, "a");
+    appendRecord(log, RecordType::Text, 2000, "b");
+    appendRecord(log, RecordType::Text, 1, "c");
+    appendRecord(log, RecordType::WindowChange, 30000, "main.cpp - Visual Studio Code");
+
+    // Text runs are cut by other records and by long gaps, and end with the time of their last text
+    std::string expected;
+    appendRecord(expected, RecordType::SessionStart, 0, sessionPayload);
+    appendRecord(expected, RecordType::Text, 103, "hello");
+    appendToken(expected, 5);
+    appendRecord(expected, RecordType::Text, 10, "a");
+    appendRecord(expected, RecordType::Text, 2001, "bc");
+    const size_t windowChangeOffset = expected.size();
+    appendRecord(expected, RecordType::WindowChange, 30000, "main.cpp - Visual Studio Code");
+
+    std::string merged;
+    EXPECT_EQ(RP::EventLog::mergeTextRecords(log, 1000, merged), log.size());
+    EXPECT_EQ(merged, expected);
+
+    RP::EventLog::TextRenderer renderer;
+    RP::EventLog::TextRenderer mergedRenderer;
+    std::string text;
+    std::string mergedText;
+    renderer.render(log, text);
+    mergedRenderer.render(merged, mergedText);
+    EXPECT_EQ(mergedText, text);
+    EXPECT_EQ(mergedRenderer.getRecordCount(), 6u);
+
+    // A record cut off at the end is left for the caller
+    merged.clear();
+    const size_t copied = RP::EventLog::mergeTextRecords(std::string_view(log).substr(0, log.size() - 1), 1000, merged);
+    EXPECT_EQ(copied, log.size() - (expected.size() - windowChangeOffset));
+    EXPECT_EQ(merged, expected.substr(0, windowChangeOffset));
+}
+
+TEST_F(UtilsTest, BinaryEventLogRejectsMalformedRecords)
+{
+    std::string text;
+    // Text before a session start
+    EXPECT_THROW(RP::EventLog::TextRenderer().render(std::string("\x11\x00" "a", 3), text), std::runtime_error);
+    // Unknown record type
+    EXPECT_THROW(RP::EventLog::TextRenderer().render(std::string("\x0f\x00", 2), text), std::runtime_error);
+    // Session start without the magic
+    EXPECT_THROW(RP::EventLog::TextRenderer().render(std::string("\x20\x00" "ab", 4), text), std::runtime_error);
+}
+
 int main(int argc, char **argv)
 {
     RP::Utils::formatTimestampGetOrdinalDay(1);